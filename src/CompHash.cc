@@ -6,6 +6,7 @@
 #include <cstring>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "zeek/ZeekString.h"
 #include "zeek/Dict.h"
@@ -334,7 +335,17 @@ char* CompositeHash::SingleValHash(bool type_check, char* kp0,
 	}
 
 
-std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_check) const
+std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& v, bool type_check) const
+	{
+	auto k = MakeHashKeyValue(v, type_check);
+
+	if ( ! k )
+		return nullptr;
+
+	return std::make_unique<HashKey>(std::move(*k));
+	}
+
+std::optional<HashKey> CompositeHash::MakeHashKeyValue(const Val& argv, bool type_check) const
 	{
 	auto v = &argv;
 
@@ -350,77 +361,110 @@ std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_c
 		// be okay; the only thing is that the ListVal unref's it.
 		Val* ncv = (Val*) v;
 		lv.Append({NewRef{}, ncv});
-		return MakeHashKey(lv, type_check);
+		return MakeHashKeyValue(lv, type_check);
 		}
 
+	// Variable-size keys that turn out small get built on the stack,
+	// from where the HashKey copies them into its inline buffer. Like
+	// the heap buffers, this is aligned for doubles.
+	double stack_key[HashKey::INLINE_KEY_SIZE / sizeof(double)];
 	char* k = key;
 
+	// Holds a heap buffer until the HashKey takes it over, so that the
+	// failure paths below don't leak it.
+	std::unique_ptr<double[]> heap_key;
+
 	if ( ! k )
 		{
 		int sz = ComputeKeySize(v, type_check, false);
 		if ( sz == 0 )
-			return nullptr;
+			return std::nullopt;
+
+		if ( sz <= static_cast<int>(sizeof(stack_key)) )
+			k = reinterpret_cast<char*>(stack_key);
+		else
+			{
+			heap_key.reset(new double[sz/sizeof(double) + 1]);
+			k = reinterpret_cast<char*>(heap_key.get());
+			}
 
-		k = reinterpret_cast<char*>(new double[sz/sizeof(double) + 1]);
 		type_check = false;	// no need to type-check again.
 		}
 
 	const auto& tl = type->GetTypes();
 
 	if ( type_check && v->GetType()->Tag() != TYPE_LIST )
-		return nullptr;
+		return std::nullopt;
 
 	auto lv = v->AsListVal();
 
 	if ( type_check && lv->Length() != static_cast<int>(tl.size()) )
-		return nullptr;
+		return std::nullopt;
 
 	char* kp = k;
 	for ( auto i = 0u; i < tl.size(); ++i )
 		{
 		kp = SingleValHash(type_check, kp, tl[i].get(), lv->Idx(i).get(), false);
 		if ( ! kp )
-			return nullptr;
+			return std::nullopt;
 		}
 
-	return std::make_unique<HashKey>((k == key), (void*) k, kp - k);
+	// A heap buffer gets taken over by the HashKey, the others copied.
+	bool owned = heap_key.release() != nullptr;
+	return std::optional<HashKey>(std::in_place, ! owned, (void*) k, kp - k);
 	}
 
-std::unique_ptr<HashKey> CompositeHash::ComputeSingletonHash(const Val* v, bool type_check) const
+std::optional<HashKey> CompositeHash::ComputeSingletonHash(const Val* v, bool type_check) const
 	{
 	if ( v->GetType()->Tag() == TYPE_LIST )
 		{
 		auto lv = v->AsListVal();
 
 		if ( type_check && lv->Length() != 1 )
-			return nullptr;
+			return std::nullopt;
 
 		v = lv->Idx(0).get();
 		}
 
 	if ( type_check && v->GetType()->InternalType() != singleton_tag )
-		return nullptr;
+		return std::nullopt;
 
 	switch ( singleton_tag ) {
 	case TYPE_INTERNAL_INT:
-		return std::make_unique<HashKey>(v->AsInt());
+		return HashKey(v->AsInt());
 
 	case TYPE_INTERNAL_UNSIGNED:
-		return std::make_unique<HashKey>(v->AsCount());
+		return HashKey(v->AsCount());
 
 	case TYPE_INTERNAL_ADDR:
-		return v->AsAddr().MakeHashKey();
+		{
+		// Same key as IPAddr::MakeHashKey(), minus the allocation.
+		uint32_t bytes[4];
+		v->AsAddr().CopyIPv6(bytes);
+		return HashKey(static_cast<const void*>(bytes), sizeof(bytes));
+		}
 
 	case TYPE_INTERNAL_SUBNET:
-		return v->AsSubNet().MakeHashKey();
+		{
+		// Same key as IPPrefix::MakeHashKey(), minus the allocation.
+		struct {
+			in6_addr ip;
+			uint32_t len;
+		} key;
+
+		const auto& prefix = v->AsSubNet();
+		prefix.Prefix().CopyIPv6(&key.ip);
+		key.len = prefix.Length();
+		return HashKey(static_cast<const void*>(&key), sizeof(key));
+		}
 
 	case TYPE_INTERNAL_DOUBLE:
-		return std::make_unique<HashKey>(v->InternalDouble());
+		return HashKey(v->InternalDouble());
 
 	case TYPE_INTERNAL_VOID:
 	case TYPE_INTERNAL_OTHER:
 		if ( v->GetType()->Tag() == TYPE_FUNC )
-			return std::make_unique<HashKey>(v->AsFunc()->GetUniqueFuncID());
+			return HashKey(v->AsFunc()->GetUniqueFuncID());
 
 		if ( v->GetType()->Tag() == TYPE_PATTERN )
 			{
@@ -432,21 +476,21 @@ std::unique_ptr<HashKey> CompositeHash::ComputeSingletonHash(const Val* v, bool
 			char* key = new char[n];
 			std::memcpy(key, texts[0], strlen(texts[0]) + 1);
 			std::memcpy(key + strlen(texts[0]) + 1, texts[1], strlen(texts[1]) + 1);
-			return std::make_unique<HashKey>(false, key, n);
+			return std::optional<HashKey>(std::in_place, false, key, n);
 			}
 
 		reporter->InternalError("bad index type in CompositeHash::ComputeSingletonHash");
-		return nullptr;
+		return std::nullopt;
 
 	case TYPE_INTERNAL_STRING:
-		return std::make_unique<HashKey>(v->AsString());
+		return HashKey(v->AsString());
 
 	case TYPE_INTERNAL_ERROR:
-		return nullptr;
+		return std::nullopt;
 
 	default:
 		reporter->InternalError("bad internal type in CompositeHash::ComputeSingletonHash");
-		return nullptr;
+		return std::nullopt;
 	}
 	}
 
@@ -3,9 +3,11 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 
 #include "zeek/Type.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/Hash.h"
 
 namespace zeek {
 
@@ -16,8 +18,6 @@ using ListValPtr = zeek::IntrusivePtr<ListVal>;
 
 namespace zeek::detail {
 
-class HashKey;
-
 class CompositeHash {
 public:
 	explicit CompositeHash(TypeListPtr composite_type);
@@ -27,13 +27,19 @@ public:
 	// or nullptr if it fails to typecheck.
 	std::unique_ptr<HashKey> MakeHashKey(const Val& v, bool type_check) const;
 
+	// Same, but returns the key by value, or nothing if it fails to
+	// typecheck. Lookups can keep such a key on the stack: unless it's
+	// larger than HashKey::INLINE_KEY_SIZE or indexed by a pattern,
+	// building it doesn't allocate any memory.
+	std::optional<HashKey> MakeHashKeyValue(const Val& v, bool type_check) const;
+
 	// Given a hash key, recover the values used to create it.
 	ListValPtr RecoverVals(const HashKey& k) const;
 
 	unsigned int MemoryAllocation() const { return padded_sizeof(*this) + util::pad_size(size); }
 
 protected:
-	std::unique_ptr<HashKey> ComputeSingletonHash(const Val* v, bool type_check) const;
+	std::optional<HashKey> ComputeSingletonHash(const Val* v, bool type_check) const;
 
 	// Computes the piece of the hash for Val*, returning the new kp.
 	// Used as a helper for ComputeHash in the non-singleton case.
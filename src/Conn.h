@@ -114,10 +114,18 @@ public:
 	const detail::ConnKey& Key() const	{ return key; }
 	session::detail::Key SessionKey(bool copy) const override
 		{
+		static_assert(sizeof(detail::ConnKey) <= session::detail::Key::MAX_INLINE_SIZE,
+		              "connection keys must fit into the session key's inline storage");
 		return session::detail::Key{
 			&key, sizeof(key), session::detail::Key::CONNECTION_KEY_TYPE, copy};
 		}
 
+	bool MatchesKey(const session::detail::Key& arg_key) const override
+		{
+		return arg_key.Matches(&key, sizeof(key),
+		                       session::detail::Key::CONNECTION_KEY_TYPE);
+		}
+
 	const IPAddr& OrigAddr() const		{ return orig_addr; }
 	const IPAddr& RespAddr() const		{ return resp_addr; }
 
@@ -20,6 +20,8 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 	nfa_states = arg_nfa_states;
 	accept = arg_accept;
 	mark = nullptr;
+	looping_bytes = nullptr;
+	looping_bytes_computed = false;
 
 	SymPartition(ec);
 
@@ -35,6 +37,7 @@ DFA_State::~DFA_State()
 	delete nfa_states;
 	delete accept;
 	delete meta_ec;
+	delete [] looping_bytes;
 	}
 
 void DFA_State::AddXtion(int sym, DFA_State* next_state)
@@ -108,6 +111,28 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	return xtions[sym];
 	}
 
+const u_char* DFA_State::ComputeLoopingBytes(DFA_Machine* machine)
+	{
+	looping_bytes_computed = true;
+
+	const int* ecs = machine->EC()->EquivClasses();
+	u_char* loops = new u_char[256];
+	int num_loops = 0;
+
+	for ( int c = 0; c < 256; ++c )
+		{
+		loops[c] = Xtion(ecs[c], machine) == this;
+		num_loops += loops[c];
+		}
+
+	if ( num_loops < 128 )
+		delete [] loops;
+	else
+		looping_bytes = loops;
+
+	return looping_bytes;
+	}
+
 void DFA_State::AppendIfNew(int sym, int_list* sym_list)
 	{
 	for ( auto value : *sym_list )
@@ -287,7 +312,8 @@ unsigned int DFA_State::Size()
 		+ util::pad_size(sizeof(DFA_State*) * num_sym)
 		+ (accept ? util::pad_size(sizeof(int) * accept->size()) : 0)
 		+ (nfa_states ? util::pad_size(sizeof(NFA_State*) * nfa_states->length()) : 0)
-		+ (meta_ec ? meta_ec->Size() : 0);
+		+ (meta_ec ? meta_ec->Size() : 0)
+		+ (looping_bytes ? util::pad_size(256) : 0);
 	}
 
 DFA_State_Cache::DFA_State_Cache()
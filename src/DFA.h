@@ -37,6 +37,16 @@ public:
 	const AcceptingSet* Accept() const	{ return accept; }
 	void SymPartition(const EquivClass* ec);
 
+	// Returns a table telling for each input byte whether it leads
+	// back to this state, or nil if less than half of them do. The
+	// table is computed on first use, which computes all of the
+	// state's transitions.
+	const u_char* LoopingBytes(DFA_Machine* machine)
+		{
+		return looping_bytes_computed ?
+			looping_bytes : ComputeLoopingBytes(machine);
+		}
+
 	// ec_sym is an equivalence class, not a character.
 	NFA_state_list* SymFollowSet(int ec_sym, const EquivClass* ec);
 
@@ -56,6 +66,7 @@ protected:
 	friend class DFA_State_Cache;
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
+	const u_char* ComputeLoopingBytes(DFA_Machine* machine);
 	void AppendIfNew(int sym, int_list* sym_list);
 
 	int state_num;
@@ -68,6 +79,9 @@ protected:
 	EquivClass* meta_ec;	// which ec's make same transition
 	DFA_State* mark;
 
+	u_char* looping_bytes;
+	bool looping_bytes_computed;
+
 	static unsigned int transition_counter;	// see Xtion()
 };
 
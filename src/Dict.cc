@@ -535,6 +535,70 @@ TEST_CASE("dict iterator invalidation")
 	delete key3;
 	}
 
+TEST_CASE("dict inline and out-of-line keys")
+	{
+	PDict<uint32_t> dict(ORDERED);
+
+	// Keys just below, at, and just above the inline size.
+	const int sizes[] = { 4, detail::DICT_INLINE_KEY_SIZE, detail::DICT_INLINE_KEY_SIZE + 1, 64 };
+	uint32_t vals[] = { 1, 2, 3, 4 };
+	char bytes[64];
+
+	for ( int i = 0; i < 4; i++ )
+		{
+		memset(bytes, 'a' + i, sizeof(bytes));
+		detail::HashKey key(bytes, sizes[i]);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	CHECK(dict.Length() == 4);
+
+	for ( int i = 0; i < 4; i++ )
+		{
+		memset(bytes, 'a' + i, sizeof(bytes));
+		detail::HashKey key(bytes, sizes[i]);
+		uint32_t* lookup = dict.Lookup(&key);
+		REQUIRE(lookup != nullptr);
+		CHECK(*lookup == vals[i]);
+
+		const char* nth_key;
+		CHECK(dict.NthEntry(i, nth_key) == &vals[i]);
+		CHECK(memcmp(nth_key, bytes, sizes[i]) == 0);
+		}
+
+	memset(bytes, 'b', sizeof(bytes));
+	detail::HashKey key(bytes, sizes[1]);
+	CHECK(dict.RemoveEntry(&key) == &vals[1]);
+	CHECK(dict.Lookup(&key) == nullptr);
+	CHECK(dict.Length() == 3);
+	}
+
+TEST_CASE("dict position follows iteration order")
+	{
+	PDict<uint32_t> dict;
+	uint32_t vals[100];
+
+	for ( uint32_t i = 0; i < 100; i++ )
+		{
+		vals[i] = i;
+		detail::HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	int last = -1;
+
+	for ( const auto& entry : dict )
+		{
+		auto key = entry.GetHashKey();
+		int position = dict.Position(key.get());
+		CHECK(position > last);
+		last = position;
+		}
+
+	detail::HashKey missing(uint32_t(100));
+	CHECK(dict.Position(&missing) == -1);
+	}
+
 TEST_SUITE_END();
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -737,7 +801,7 @@ size_t Dictionary::MemoryAllocation() const
 		{
 		size += zeek::util::pad_size(Capacity() * sizeof(detail::DictEntry));
 		for ( int i = Capacity()-1; i>=0; i-- )
-			if ( ! table[i].Empty() && table[i].key_size > 8 )
+			if ( ! table[i].Empty() && ! table[i].KeyInline() )
 				size += zeek::util::pad_size(table[i].key_size);
 		}
 
@@ -953,6 +1017,12 @@ void* Dictionary::Lookup(const void* key, int key_size, detail::hash_t h) const
 	return position >= 0 ? table[position].value : nullptr;
 	}
 
+int Dictionary::Position(const detail::HashKey* key) const
+	{
+	Dictionary* d = const_cast<Dictionary*>(this);
+	return d->LookupIndex(key->Key(), key->Size(), key->Hash());
+	}
+
 //for verification purposes
 int Dictionary::LinearLookupIndex(const void* key, int key_size, detail::hash_t hash) const
 	{
@@ -1023,9 +1093,15 @@ int Dictionary::LookupIndex(const void* key, int key_size, detail::hash_t hash,
 	{
 	ASSERT(bucket>=0 && bucket < Buckets());
 	int i = bucket;
-	for ( ; i < end && ! table[i].Empty() && BucketByPosition(i) <= bucket; i++ )
-		if ( BucketByPosition(i) == bucket && table[i].Equal((char*)key, key_size, hash) )
+	for ( ; i < end && ! table[i].Empty(); i++ )
+		{
+		int b = BucketByPosition(i);
+		if ( b > bucket )
+			break;
+
+		if ( b == bucket && table[i].Equal((char*)key, key_size, hash) )
 			return i;
+		}
 
 	//no such cluster, or not found in the cluster.
 	if ( insert_position )
@@ -1135,7 +1211,11 @@ void Dictionary::InsertRelocateAndAdjust(detail::DictEntry& entry, int insert_po
 	entry.bucket = BucketByHash(entry.hash,log2_buckets);
 #endif//DEBUG
 	int last_affected_position = insert_position;
-	InsertAndRelocate(entry, insert_position, &last_affected_position);
+
+	// InsertAndRelocate() hands displaced entries back through its argument. Give it a copy
+	// so that entry still describes the new item for the adjustments below and for the caller.
+	detail::DictEntry relocated = entry;
+	InsertAndRelocate(relocated, insert_position, &last_affected_position);
 
 	// If remapping in progress, adjust the remap_end to step back a little to cover the new
 	// range if the changed range straddles over remap_end.
@@ -1421,7 +1501,8 @@ void* Dictionary::NthEntry(int n, const void*& key, int& key_size) const
 	{
 	if ( ! order || n < 0 || n >= Length() )
 		return nullptr;
-	detail::DictEntry entry = (*order)[n];
+	// Take a reference, since an inline key lives inside the entry itself.
+	const detail::DictEntry& entry = (*order)[n];
 	key = entry.GetKey();
 	key_size = entry.key_size;
 	return entry.value;
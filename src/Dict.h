@@ -6,6 +6,7 @@
 #include <vector>
 #include <memory>
 
+#include "zeek/zeek-config.h"
 #include "zeek/Hash.h"
 
 // Type for function to be called when deleting elements.
@@ -51,6 +52,14 @@ constexpr uint8_t DICT_THRESHOLD_BITS = 3;
 // bucket at which to start looking for the next value to return.
 constexpr uint16_t TOO_FAR_TO_REACH = 0xFFFF;
 
+// Keys up to this many bytes are stored directly in the entry, larger ones in a separate
+// allocation. The default of 16 covers count, int, double, port and single-address keys
+// and short strings, at 32 bytes per entry. Configuring with --dict-inline-key-size=8
+// covers only the first four, at 24 bytes per entry.
+constexpr uint8_t DICT_INLINE_KEY_SIZE = ZEEK_DICT_INLINE_KEY_SIZE;
+static_assert(DICT_INLINE_KEY_SIZE >= sizeof(char*),
+              "the inline key buffer shares its space with a pointer");
+
 /**
  * An entry stored in the dictionary.
  */
@@ -64,8 +73,8 @@ public:
 	// Distance from the expected position in the table. 0xFFFF means that the entry is empty.
 	uint16_t distance = TOO_FAR_TO_REACH;
 
-	// The size of the key. Less than 8 bytes we'll store directly in the entry, otherwise we'll
-	// store it as a pointer. This avoids extra allocations if we can help it.
+	// The size of the key. Up to DICT_INLINE_KEY_SIZE bytes we'll store directly in the entry,
+	// otherwise we'll store it as a pointer. This avoids extra allocations if we can help it.
 	uint16_t key_size = 0;
 
 	// Lower 4 bytes of the 8-byte hash, which is used to calculate the position in the table.
@@ -73,7 +82,7 @@ public:
 
 	void* value = nullptr;
 	union {
-		char key_here[8]; //hold key len<=8. when over 8, it's a pointer to real keys.
+		char key_here[DICT_INLINE_KEY_SIZE]; //hold short keys. when longer, it's a pointer to real keys.
 		char* key;
 	};
 
@@ -84,7 +93,7 @@ public:
 		if ( ! arg_key )
 			return;
 
-		if ( key_size <= 8 )
+		if ( KeyInline() )
 			{
 			memcpy(key_here, arg_key, key_size);
 			if ( ! copy_key )
@@ -120,12 +129,13 @@ public:
 
 	void Clear()
 		{
-		if( key_size > 8 )
+		if( ! KeyInline() )
 			delete [] key;
 		SetEmpty();
 		}
 
-	const char* GetKey() const { return key_size <= 8 ? key_here : key; }
+	bool KeyInline() const { return key_size <= DICT_INLINE_KEY_SIZE; }
+	const char* GetKey() const { return KeyInline() ? key_here : key; }
 	std::unique_ptr<detail::HashKey> GetHashKey() const
 		{
 		return std::make_unique<detail::HashKey>(GetKey(), key_size, hash);
@@ -252,11 +262,23 @@ public:
 	void* Lookup(const detail::HashKey* key) const;
 	void* Lookup(const void* key, int key_size, detail::hash_t h) const;
 
+	// Returns the position of the key's entry in the table, or -1 if there's
+	// no such entry. For unordered dictionaries, iteration visits entries by
+	// increasing position. Positions change as the dictionary gets modified.
+	int Position(const detail::HashKey* key) const;
+
 	// Returns previous value, or 0 if none.
 	// If iterators_invalidated is supplied, its value is set to true
 	// if the removal may have invalidated any existing iterators.
+	// Keys short enough to be stored inline get copied straight into their entry, which
+	// spares the intermediate copy that TakeKey() would make of a key it doesn't own.
 	void* Insert(detail::HashKey* key, void* val, bool* iterators_invalidated = nullptr)
-		{ return Insert(key->TakeKey(), key->Size(), key->Hash(), val, false, iterators_invalidated); }
+		{
+		if ( key->Size() <= detail::DICT_INLINE_KEY_SIZE )
+			return Insert(const_cast<void*>(key->Key()), key->Size(), key->Hash(), val, true, iterators_invalidated);
+
+		return Insert(key->TakeKey(), key->Size(), key->Hash(), val, false, iterators_invalidated);
+		}
 
 	// If copy_key is true, then the key is copied, otherwise it's assumed
 	// that it's a heap pointer that now belongs to the Dictionary to
@@ -0,0 +1,158 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ExpireBuckets.h"
+
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+static size_t key_words(int size)
+	{
+	return 2 + (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	}
+
+bool ExpireKeyList::Append(const HashKey& key)
+	{
+	if ( last < words.size() && words[last] == key.Hash() &&
+	     words[last + 1] == static_cast<uint64_t>(key.Size()) &&
+	     memcmp(&words[last + 2], key.Key(), key.Size()) == 0 )
+		return false;
+
+	size_t offset = words.size();
+	words.resize(offset + key_words(key.Size()));
+	words[offset] = key.Hash();
+	words[offset + 1] = key.Size();
+	memcpy(&words[offset + 2], key.Key(), key.Size());
+	last = offset;
+	++num_keys;
+	return true;
+	}
+
+HashKey ExpireKeyList::Next(size_t* offset) const
+	{
+	size_t o = *offset;
+	int size = static_cast<int>(words[o + 1]);
+	*offset = o + key_words(size);
+	return HashKey(&words[o + 2], size, words[o], true);
+	}
+
+void ExpireKeyList::Consume(size_t offset)
+	{
+	for ( size_t o = 0; o < offset; o += key_words(static_cast<int>(words[o + 1])) )
+		--num_keys;
+
+	words.erase(words.begin(), words.begin() + offset);
+	last = last >= offset ? last - offset : words.size();
+	}
+
+void ExpireKeyList::Prepend(const ExpireKeyList& other)
+	{
+	words.insert(words.begin(), other.words.begin(), other.words.end());
+	num_keys += other.num_keys;
+	last += other.words.size();
+	}
+
+void ExpireBuckets::Add(int second, const HashKey& key)
+	{
+	if ( buckets[second].Append(key) )
+		++num_keys;
+	}
+
+bool ExpireBuckets::Earliest(int* second) const
+	{
+	if ( buckets.empty() )
+		return false;
+
+	*second = buckets.begin()->first;
+	return true;
+	}
+
+bool ExpireBuckets::TakeEarliest(int* second, ExpireKeyList* keys)
+	{
+	if ( buckets.empty() )
+		return false;
+
+	auto it = buckets.begin();
+	*second = it->first;
+	*keys = std::move(it->second);
+	num_keys -= keys->NumKeys();
+	buckets.erase(it);
+	return true;
+	}
+
+void ExpireBuckets::PutBack(int second, const ExpireKeyList& keys)
+	{
+	if ( ! keys.Empty() )
+		{
+		buckets[second].Prepend(keys);
+		num_keys += keys.NumKeys();
+		}
+	}
+
+size_t ExpireBuckets::MemoryAllocation() const
+	{
+	size_t size = 0;
+
+	for ( const auto& [second, keys] : buckets )
+		size += keys.MemoryAllocation() + 4 * sizeof(void*);
+
+	return size;
+	}
+
+TEST_SUITE_BEGIN("ExpireBuckets");
+
+TEST_CASE("expire buckets order and put back")
+	{
+	ExpireBuckets b;
+	uint32_t a[4] = { 1, 2, 3, 4 };
+
+	b.Add(20, HashKey(static_cast<const void*>(a), 16, 1, true));
+	b.Add(10, HashKey(static_cast<const void*>(a), 3, 2, true));
+	b.Add(10, HashKey(static_cast<const void*>(a), 8, 3, true));
+	CHECK(b.NumBuckets() == 2);
+	CHECK(b.NumKeys() == 3);
+
+	// Filing the same key again right away doesn't add a duplicate.
+	b.Add(10, HashKey(static_cast<const void*>(a), 8, 3, true));
+	CHECK(b.NumKeys() == 3);
+
+	int second;
+	ExpireKeyList keys;
+	REQUIRE(b.TakeEarliest(&second, &keys));
+	CHECK(second == 10);
+	CHECK(keys.NumKeys() == 2);
+	CHECK(b.NumKeys() == 1);
+
+	size_t offset = 0;
+	auto k1 = keys.Next(&offset);
+	CHECK(k1.Size() == 3);
+	CHECK(k1.Hash() == 2);
+	CHECK(memcmp(k1.Key(), a, 3) == 0);
+	CHECK(reinterpret_cast<uintptr_t>(k1.Key()) % sizeof(uint64_t) == 0);
+
+	// Something gets filed under the taken second while processing it,
+	// then the unprocessed rest goes back ahead of it.
+	b.Add(10, HashKey(static_cast<const void*>(a), 4, 4, true));
+	keys.Consume(offset);
+	CHECK(keys.NumKeys() == 1);
+	b.PutBack(second, keys);
+	CHECK(b.NumKeys() == 3);
+
+	REQUIRE(b.TakeEarliest(&second, &keys));
+	CHECK(second == 10);
+	offset = 0;
+	CHECK(keys.Next(&offset).Hash() == 3);
+	CHECK(keys.Next(&offset).Hash() == 4);
+	CHECK(offset == keys.End());
+
+	REQUIRE(b.Earliest(&second));
+	CHECK(second == 20);
+	b.Clear();
+	CHECK(! b.Earliest(&second));
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::detail
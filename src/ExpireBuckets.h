@@ -0,0 +1,144 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "zeek/Hash.h"
+
+namespace zeek::detail {
+
+/**
+ * A compact list of hash keys, stored back to back in a single buffer.
+ */
+class ExpireKeyList {
+public:
+	/**
+	 * Appends a copy of the given key, unless it equals the last one.
+	 *
+	 * @return True if the key got appended.
+	 */
+	bool Append(const HashKey& key);
+
+	/**
+	 * Returns true if the list holds no keys.
+	 */
+	bool Empty() const	{ return words.empty(); }
+
+	/**
+	 * Returns the number of keys in the list.
+	 */
+	size_t NumKeys() const	{ return num_keys; }
+
+	/**
+	 * Returns the offset just past the last key, to compare the offsets
+	 * returned by Next() against.
+	 */
+	size_t End() const	{ return words.size(); }
+
+	/**
+	 * Returns a key pointing into the list (so it must not outlive the
+	 * list or its modification) and advances the offset to the next one.
+	 * Start iterating at offset 0.
+	 */
+	HashKey Next(size_t* offset) const;
+
+	/**
+	 * Removes all keys ahead of the given offset.
+	 */
+	void Consume(size_t offset);
+
+	/**
+	 * Inserts the keys of the other list ahead of this list's keys.
+	 */
+	void Prepend(const ExpireKeyList& other);
+
+	size_t MemoryAllocation() const
+		{ return words.capacity() * sizeof(uint64_t); }
+
+private:
+	// Each key takes one word for its hash, one for its size, and as
+	// many as needed for its bytes. Keeping them word-aligned means the
+	// bytes can be handed out as keys directly, including to
+	// CompositeHash::RecoverVals().
+	std::vector<uint64_t> words;
+	size_t num_keys = 0;
+
+	// Offset of the last appended key, or End() if there's none.
+	size_t last = 0;
+};
+
+/**
+ * Keeps the keys of a table's entries in buckets ordered by the second of
+ * the entries' last expiration-relevant access, so that expiring the table
+ * only needs to visit the buckets that have come due.
+ *
+ * Filing is lazy: accesses don't move an entry to a new bucket. Instead,
+ * when an entry's bucket comes due and the entry turns out to have been
+ * accessed since, the table files it anew under its current access time.
+ * Each entry remembers the bucket holding its current filing (see
+ * \a TableEntryVal), which lets the table recognize and skip filings left
+ * behind by entries that got removed or replaced.
+ */
+class ExpireBuckets {
+public:
+	/**
+	 * Files a key under the given second. Filing the same key twice in a
+	 * row is a no-op, which covers entries that get deleted and re-added
+	 * within a second.
+	 */
+	void Add(int second, const HashKey& key);
+
+	/**
+	 * Retrieves the second of the earliest bucket, returning false if
+	 * there's no bucket.
+	 */
+	bool Earliest(int* second) const;
+
+	/**
+	 * Takes the earliest bucket out for processing.
+	 *
+	 * @param second Set to the bucket's second.
+	 *
+	 * @param keys Set to the bucket's keys.
+	 *
+	 * @return False if there's no bucket.
+	 */
+	bool TakeEarliest(int* second, ExpireKeyList* keys);
+
+	/**
+	 * Returns the unprocessed keys of a bucket taken with TakeEarliest(),
+	 * ahead of keys filed under the same second in the meantime.
+	 */
+	void PutBack(int second, const ExpireKeyList& keys);
+
+	/**
+	 * Removes all buckets.
+	 */
+	void Clear()
+		{
+		buckets.clear();
+		num_keys = 0;
+		}
+
+	/**
+	 * Returns the number of keys in all buckets, not counting those taken
+	 * out with TakeEarliest() and not put back.
+	 */
+	size_t NumKeys() const	{ return num_keys; }
+
+	/**
+	 * Returns the number of buckets.
+	 */
+	size_t NumBuckets() const	{ return buckets.size(); }
+
+	size_t MemoryAllocation() const;
+
+private:
+	std::map<int, ExpireKeyList> buckets;
+	size_t num_keys = 0;
+};
+
+} // namespace zeek::detail
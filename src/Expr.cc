@@ -76,6 +76,31 @@ const char* expr_name(BroExprTag t)
 	return expr_names[int(t)];
 	}
 
+bool track_expr_allocs = false;
+uint64_t expr_val_allocs[NUM_EXPRS];
+
+static ExprAllocTracker* current_alloc_tracker = nullptr;
+
+void ExprAllocTracker::Start(BroExprTag t)
+	{
+	active = true;
+	tag = t;
+	start = Val::NumCreated();
+	parent = current_alloc_tracker;
+	current_alloc_tracker = this;
+	}
+
+void ExprAllocTracker::Finish()
+	{
+	auto n = Val::NumCreated() - start;
+	expr_val_allocs[tag] += n - nested;
+
+	if ( parent )
+		parent->nested += n;
+
+	current_alloc_tracker = parent;
+	}
+
 Expr::Expr(BroExprTag arg_tag) : tag(arg_tag), type(nullptr), paren(false)
 	{
 	SetLocationInfo(&start_location, &end_location);
@@ -211,6 +236,41 @@ ExprPtr Expr::MakeLvalue()
 	return {NewRef{}, this};
 	}
 
+// Whether values of the given representation have a native ZVal form
+// that EvalNative() produces.
+static bool is_native_rep(InternalTypeTag it)
+	{
+	return it == TYPE_INTERNAL_INT || it == TYPE_INTERNAL_UNSIGNED ||
+	       it == TYPE_INTERNAL_DOUBLE;
+	}
+
+bool Expr::EvalNative(Frame* f, ZVal& z) const
+	{
+	auto v = Eval(f);
+
+	if ( ! v )
+		return false;
+
+	switch ( v->GetType()->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+		z = ZVal(v->InternalInt());
+		break;
+
+	case TYPE_INTERNAL_UNSIGNED:
+		z = ZVal(v->InternalUnsigned());
+		break;
+
+	case TYPE_INTERNAL_DOUBLE:
+		z = ZVal(v->InternalDouble());
+		break;
+
+	default:
+		RuntimeErrorWithCallStack("bad type in Expr::EvalNative");
+	}
+
+	return true;
+	}
+
 void Expr::EvalIntoAggregate(const zeek::Type* /* t */, Val* /* aggr */,
                              Frame* /* f */) const
 	{
@@ -485,7 +545,7 @@ const IDPtr& NameExpr::IdPtr() const
 	return id;
 	}
 
-ValPtr NameExpr::Eval(Frame* f) const
+ValPtr NameExpr::DoEval(Frame* f) const
 	{
 	ValPtr v;
 
@@ -579,7 +639,7 @@ void ConstExpr::ExprDescribe(ODesc* d) const
 	val->Describe(d);
 	}
 
-ValPtr ConstExpr::Eval(Frame* /* f */) const
+ValPtr ConstExpr::DoEval(Frame* /* f */) const
 	{
 	return {NewRef{}, Value()};
 	}
@@ -600,7 +660,7 @@ UnaryExpr::UnaryExpr(BroExprTag arg_tag, ExprPtr arg_op)
 		SetError();
 	}
 
-ValPtr UnaryExpr::Eval(Frame* f) const
+ValPtr UnaryExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -690,11 +750,21 @@ void UnaryExpr::ExprDescribe(ODesc* d) const
 		}
 	}
 
-ValPtr BinaryExpr::Eval(Frame* f) const
+ValPtr BinaryExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
 
+	if ( HasNativeFold() )
+		{
+		ZVal z;
+
+		if ( ! EvalNative(f, z) )
+			return nullptr;
+
+		return NativeToVal(z);
+		}
+
 	auto v1 = op1->Eval(f);
 
 	if ( ! v1 )
@@ -756,6 +826,20 @@ ValPtr BinaryExpr::Eval(Frame* f) const
 	return Fold(v1.get(), v2.get());
 	}
 
+bool BinaryExpr::EvalNative(Frame* f, ZVal& z) const
+	{
+	if ( ! HasNativeFold() )
+		return Expr::EvalNative(f, z);
+
+	ZVal z1, z2;
+
+	if ( ! op1->EvalNative(f, z1) || ! op2->EvalNative(f, z2) )
+		return false;
+
+	z = NativeFold(op1->GetType()->InternalType(), z1, z2);
+	return true;
+	}
+
 bool BinaryExpr::IsPure() const
 	{
 	return op1->IsPure() && op2->IsPure();
@@ -806,6 +890,62 @@ ValPtr BinaryExpr::Fold(Val* v1, Val* v2) const
 	if ( it == TYPE_INTERNAL_SUBNET )
 		return SubNetFold(v1, v2);
 
+	ZVal z1, z2;
+
+	if ( it == TYPE_INTERNAL_INT )
+		{
+		z1 = ZVal(v1->InternalInt());
+		z2 = ZVal(v2->InternalInt());
+		}
+	else if ( it == TYPE_INTERNAL_UNSIGNED )
+		{
+		z1 = ZVal(v1->InternalUnsigned());
+		z2 = ZVal(v2->InternalUnsigned());
+		}
+	else if ( it == TYPE_INTERNAL_DOUBLE )
+		{
+		z1 = ZVal(v1->InternalDouble());
+		z2 = ZVal(v2->InternalDouble());
+		}
+	else
+		RuntimeErrorWithCallStack("bad type in BinaryExpr::Fold");
+
+	return NativeToVal(NativeFold(it, z1, z2));
+	}
+
+bool BinaryExpr::HasNativeFold() const
+	{
+	switch ( tag ) {
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+	case EXPR_AND:
+	case EXPR_OR:
+	case EXPR_XOR:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		break;
+
+	default:
+		return false;
+	}
+
+	if ( IsError() || IsVector(GetType()->Tag()) )
+		return false;
+
+	auto it = op1->GetType()->InternalType();
+
+	return is_native_rep(it) && op2->GetType()->InternalType() == it;
+	}
+
+ZVal BinaryExpr::NativeFold(InternalTypeTag it, const ZVal& z1, const ZVal& z2) const
+	{
 	bro_int_t i1 = 0, i2 = 0, i3 = 0;
 	bro_uint_t u1 = 0, u2 = 0, u3 = 0;
 	double d1 = 0.0, d2 = 0.0, d3 = 0.0;
@@ -814,23 +954,21 @@ ValPtr BinaryExpr::Fold(Val* v1, Val* v2) const
 
 	if ( it == TYPE_INTERNAL_INT )
 		{
-		i1 = v1->InternalInt();
-		i2 = v2->InternalInt();
+		i1 = z1.AsInt();
+		i2 = z2.AsInt();
 		is_integral = true;
 		}
 	else if ( it == TYPE_INTERNAL_UNSIGNED )
 		{
-		u1 = v1->InternalUnsigned();
-		u2 = v2->InternalUnsigned();
+		u1 = z1.AsCount();
+		u2 = z2.AsCount();
 		is_unsigned = true;
 		}
-	else if ( it == TYPE_INTERNAL_DOUBLE )
+	else
 		{
-		d1 = v1->InternalDouble();
-		d2 = v2->InternalDouble();
+		d1 = z1.AsDouble();
+		d2 = z2.AsDouble();
 		}
-	else
-		RuntimeErrorWithCallStack("bad type in BinaryExpr::Fold");
 
 	switch ( tag ) {
 #define DO_INT_FOLD(op) \
@@ -940,18 +1078,30 @@ ValPtr BinaryExpr::Fold(Val* v1, Val* v2) const
 
 	const auto& ret_type = IsVector(GetType()->Tag()) ? GetType()->Yield() : GetType();
 
+	if ( ret_type->InternalType() == TYPE_INTERNAL_DOUBLE )
+		return ZVal(d3);
+	else if ( ret_type->InternalType() == TYPE_INTERNAL_UNSIGNED )
+		return ZVal(u3);
+	else
+		return ZVal(i3);
+	}
+
+ValPtr BinaryExpr::NativeToVal(const ZVal& z) const
+	{
+	const auto& ret_type = IsVector(GetType()->Tag()) ? GetType()->Yield() : GetType();
+
 	if ( ret_type->Tag() == TYPE_INTERVAL )
-		return make_intrusive<IntervalVal>(d3);
+		return make_intrusive<IntervalVal>(z.AsDouble());
 	else if ( ret_type->Tag() == TYPE_TIME )
-		return make_intrusive<TimeVal>(d3);
+		return make_intrusive<TimeVal>(z.AsDouble());
 	else if ( ret_type->Tag() == TYPE_DOUBLE )
-		return make_intrusive<DoubleVal>(d3);
+		return make_intrusive<DoubleVal>(z.AsDouble());
 	else if ( ret_type->InternalType() == TYPE_INTERNAL_UNSIGNED )
-		return val_mgr->Count(u3);
+		return val_mgr->Count(z.AsCount());
 	else if ( ret_type->Tag() == TYPE_BOOL )
-		return val_mgr->Bool(i3);
+		return val_mgr->Bool(z.AsInt());
 	else
-		return val_mgr->Int(i3);
+		return val_mgr->Int(z.AsInt());
 	}
 
 ValPtr BinaryExpr::StringFold(Val* v1, Val* v2) const
@@ -1170,7 +1320,7 @@ CloneExpr::CloneExpr(ExprPtr arg_op)
 	SetType(op->GetType());
 	}
 
-ValPtr CloneExpr::Eval(Frame* f) const
+ValPtr CloneExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -1237,7 +1387,7 @@ ValPtr IncrExpr::DoSingleEval(Frame* f, Val* v) const
 	}
 
 
-ValPtr IncrExpr::Eval(Frame* f) const
+ValPtr IncrExpr::DoEval(Frame* f) const
 	{
 	auto v = op->Eval(f);
 
@@ -1380,6 +1530,28 @@ ValPtr NegExpr::Fold(Val* v) const
 		return val_mgr->Int(- v->CoerceToInt());
 	}
 
+bool NegExpr::EvalNative(Frame* f, ZVal& z) const
+	{
+	auto it = op->GetType()->InternalType();
+
+	if ( IsError() || ! is_native_rep(it) )
+		return Expr::EvalNative(f, z);
+
+	ZVal z_op;
+
+	if ( ! op->EvalNative(f, z_op) )
+		return false;
+
+	if ( it == TYPE_INTERNAL_DOUBLE )
+		z = ZVal(- z_op.AsDouble());
+	else if ( it == TYPE_INTERNAL_UNSIGNED )
+		z = ZVal(- static_cast<bro_int_t>(z_op.AsCount()));
+	else
+		z = ZVal(- z_op.AsInt());
+
+	return true;
+	}
+
 SizeExpr::SizeExpr(ExprPtr arg_op)
 	: UnaryExpr(EXPR_SIZE, std::move(arg_op))
 	{
@@ -1394,7 +1566,7 @@ SizeExpr::SizeExpr(ExprPtr arg_op)
 		SetType(base_type(TYPE_COUNT));
 	}
 
-ValPtr SizeExpr::Eval(Frame* f) const
+ValPtr SizeExpr::DoEval(Frame* f) const
 	{
 	auto v = op->Eval(f);
 
@@ -1502,7 +1674,7 @@ AddToExpr::AddToExpr(ExprPtr arg_op1, ExprPtr arg_op2)
 		ExprError("requires two arithmetic or two string operands");
 	}
 
-ValPtr AddToExpr::Eval(Frame* f) const
+ValPtr AddToExpr::DoEval(Frame* f) const
 	{
 	auto v1 = op1->Eval(f);
 
@@ -1598,7 +1770,7 @@ RemoveFromExpr::RemoveFromExpr(ExprPtr arg_op1, ExprPtr arg_op2)
 		ExprError("requires two arithmetic operands");
 	}
 
-ValPtr RemoveFromExpr::Eval(Frame* f) const
+ValPtr RemoveFromExpr::DoEval(Frame* f) const
 	{
 	auto v1 = op1->Eval(f);
 
@@ -1799,7 +1971,7 @@ ValPtr BoolExpr::DoSingleEval(Frame* f, ValPtr v1, Expr* op2) const
 		}
 	}
 
-ValPtr BoolExpr::Eval(Frame* f) const
+ValPtr BoolExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -2192,7 +2364,7 @@ CondExpr::CondExpr(ExprPtr arg_op1, ExprPtr arg_op2, ExprPtr arg_op3)
 		}
 	}
 
-ValPtr CondExpr::Eval(Frame* f) const
+ValPtr CondExpr::DoEval(Frame* f) const
 	{
 	if ( ! is_vector(op1) )
 		{
@@ -2510,7 +2682,7 @@ bool AssignExpr::TypeCheckArithmetics(TypeTag bt1, TypeTag bt2)
 	}
 
 
-ValPtr AssignExpr::Eval(Frame* f) const
+ValPtr AssignExpr::DoEval(Frame* f) const
 	{
 	if ( is_init )
 		{
@@ -2733,7 +2905,7 @@ IndexSliceAssignExpr::IndexSliceAssignExpr(ExprPtr op1, ExprPtr op2, bool is_ini
 	{
 	}
 
-ValPtr IndexSliceAssignExpr::Eval(Frame* f) const
+ValPtr IndexSliceAssignExpr::DoEval(Frame* f) const
 	{
 	if ( is_init )
 		{
@@ -2799,6 +2971,9 @@ IndexExpr::IndexExpr(ExprPtr arg_op1, ListExprPtr arg_op2, bool arg_is_slice)
 
 	else
 		ExprError("Unknown MatchesIndex() return value");
+
+	if ( ! IsError() && op1->GetType()->Tag() == TYPE_TABLE )
+		atomic_table_index = op1->GetType()->AsTableType()->IsAtomicIndex();
 	}
 
 bool IndexExpr::CanAdd() const
@@ -2882,13 +3057,31 @@ ExprPtr IndexExpr::MakeLvalue()
 	return make_intrusive<RefExpr>(IntrusivePtr{NewRef{}, this});
 	}
 
-ValPtr IndexExpr::Eval(Frame* f) const
+ValPtr IndexExpr::DoEval(Frame* f) const
 	{
 	auto v1 = op1->Eval(f);
 
 	if ( ! v1 )
 		return nullptr;
 
+	if ( atomic_table_index )
+		{
+		// The table keys the value directly, no need for a ListVal.
+		auto ind = op2->AsListExpr()->Exprs()[0]->Eval(f);
+
+		if ( ! ind )
+			{
+			RuntimeError("uninitialized list value");
+			return nullptr;
+			}
+
+		if ( auto v = v1->AsTableVal()->FindOrDefault(ind) )
+			return v;
+
+		RuntimeError("no such index");
+		return nullptr;
+		}
+
 	auto v2 = op2->Eval(f);
 
 	if ( ! v2 )
@@ -3110,6 +3303,33 @@ void FieldExpr::Delete(Frame* f)
 	Assign(f, nullptr);
 	}
 
+bool FieldExpr::EvalNative(Frame* f, ZVal& z) const
+	{
+	if ( IsError() || field < 0 || ! is_native_rep(GetType()->InternalType()) )
+		return Expr::EvalNative(f, z);
+
+	auto v = op->Eval(f);
+
+	if ( ! v )
+		return false;
+
+	auto rv = v->AsRecordVal();
+
+	if ( rv->HasField(field) )
+		{
+		z = rv->RawField(field);
+		return true;
+		}
+
+	auto fv = Fold(v.get());
+
+	if ( ! fv )
+		return false;
+
+	z = ZVal(fv, GetType());
+	return true;
+	}
+
 ValPtr FieldExpr::Fold(Val* v) const
 	{
 	if ( const auto& result = v->AsRecordVal()->GetField(field) )
@@ -3254,7 +3474,7 @@ ValPtr RecordConstructorExpr::InitVal(const zeek::Type* t, ValPtr aggr) const
 	return nullptr;
 	}
 
-ValPtr RecordConstructorExpr::Eval(Frame* f) const
+ValPtr RecordConstructorExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -3394,7 +3614,7 @@ TableConstructorExpr::TableConstructorExpr(ListExprPtr constructor_list,
 		}
 	}
 
-ValPtr TableConstructorExpr::Eval(Frame* f) const
+ValPtr TableConstructorExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -3509,7 +3729,7 @@ SetConstructorExpr::SetConstructorExpr(ListExprPtr constructor_list,
 		}
 	}
 
-ValPtr SetConstructorExpr::Eval(Frame* f) const
+ValPtr SetConstructorExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -3606,7 +3826,7 @@ VectorConstructorExpr::VectorConstructorExpr(ListExprPtr constructor_list,
 		ExprError("inconsistent types in vector constructor");
 	}
 
-ValPtr VectorConstructorExpr::Eval(Frame* f) const
+ValPtr VectorConstructorExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -3739,6 +3959,50 @@ ArithCoerceExpr::ArithCoerceExpr(ExprPtr arg_op, TypeTag t)
 		ExprError("bad coercion value");
 	}
 
+bool ArithCoerceExpr::EvalNative(Frame* f, ZVal& z) const
+	{
+	auto from = op->GetType()->InternalType();
+	auto to = GetType()->InternalType();
+
+	// Vectors don't have a native representation, so this also
+	// covers coercions of their elements.
+	if ( IsError() || ! is_native_rep(from) || ! is_native_rep(to) )
+		return Expr::EvalNative(f, z);
+
+	ZVal z_op;
+
+	if ( ! op->EvalNative(f, z_op) )
+		return false;
+
+	if ( from == to )
+		{
+		z = z_op;
+		return true;
+		}
+
+	switch ( to ) {
+	case TYPE_INTERNAL_DOUBLE:
+		z = ZVal(from == TYPE_INTERNAL_INT ?
+		         static_cast<double>(z_op.AsInt()) :
+		         static_cast<double>(z_op.AsCount()));
+		break;
+
+	case TYPE_INTERNAL_INT:
+		z = ZVal(from == TYPE_INTERNAL_DOUBLE ?
+		         static_cast<bro_int_t>(z_op.AsDouble()) :
+		         static_cast<bro_int_t>(z_op.AsCount()));
+		break;
+
+	default:
+		z = ZVal(from == TYPE_INTERNAL_DOUBLE ?
+		         static_cast<bro_uint_t>(z_op.AsDouble()) :
+		         static_cast<bro_uint_t>(z_op.AsInt()));
+		break;
+	}
+
+	return true;
+	}
+
 ValPtr ArithCoerceExpr::FoldSingleVal(Val* v, InternalTypeTag t) const
 	{
 	switch ( t ) {
@@ -4106,7 +4370,7 @@ bool ScheduleExpr::IsPure() const
 	return false;
 	}
 
-ValPtr ScheduleExpr::Eval(Frame* f) const
+ValPtr ScheduleExpr::DoEval(Frame* f) const
 	{
 	if ( run_state::terminating )
 		return nullptr;
@@ -4214,8 +4478,35 @@ InExpr::InExpr(ExprPtr arg_op1, ExprPtr arg_op2)
 		if ( ! op2->GetType()->MatchesIndex(lop1) )
 			SetError("not an index type");
 		else
+			{
 			SetType(base_type(TYPE_BOOL));
+
+			if ( op2->GetType()->Tag() == TYPE_TABLE )
+				atomic_table_index = op2->GetType()->AsTableType()->IsAtomicIndex();
+			}
+		}
+	}
+
+ValPtr InExpr::DoEval(Frame* f) const
+	{
+	if ( ! atomic_table_index || IsError() )
+		return BinaryExpr::DoEval(f);
+
+	// The table keys the value directly, no need for a ListVal.
+	auto ind = op1->AsListExpr()->Exprs()[0]->Eval(f);
+
+	if ( ! ind )
+		{
+		RuntimeError("uninitialized list value");
+		return nullptr;
 		}
+
+	auto t = op2->Eval(f);
+
+	if ( ! t )
+		return nullptr;
+
+	return val_mgr->Bool(t->AsTableVal()->Find(ind) != nullptr);
 	}
 
 ValPtr InExpr::Fold(Val* v1, Val* v2) const
@@ -4365,7 +4656,7 @@ bool CallExpr::IsPure() const
 	return pure;
 	}
 
-ValPtr CallExpr::Eval(Frame* f) const
+ValPtr CallExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -4559,7 +4850,7 @@ Scope* LambdaExpr::GetScope() const
 	return ingredients->scope.get();
 	}
 
-ValPtr LambdaExpr::Eval(Frame* f) const
+ValPtr LambdaExpr::DoEval(Frame* f) const
 	{
 	auto lamb = make_intrusive<ScriptFunc>(
 		ingredients->id,
@@ -4640,7 +4931,7 @@ EventExpr::EventExpr(const char* arg_name, ListExprPtr arg_args)
 		}
 	}
 
-ValPtr EventExpr::Eval(Frame* f) const
+ValPtr EventExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -4710,7 +5001,7 @@ bool ListExpr::IsPure() const
 	return true;
 	}
 
-ValPtr ListExpr::Eval(Frame* f) const
+ValPtr ListExpr::DoEval(Frame* f) const
 	{
 	auto v = make_intrusive<ListVal>(TYPE_ANY);
 
@@ -5106,7 +5397,7 @@ CastExpr::CastExpr(ExprPtr arg_op, TypePtr t)
 		ExprError("cast not supported");
 	}
 
-ValPtr CastExpr::Eval(Frame* f) const
+ValPtr CastExpr::DoEval(Frame* f) const
 	{
 	if ( IsError() )
 		return nullptr;
@@ -81,6 +81,40 @@ enum BroExprTag : int {
 
 extern const char* expr_name(BroExprTag t);
 
+// Per type of expression, the number of Val's that evaluating such
+// expressions has created, not counting those created when evaluating
+// their operands.  Only tracked while track_expr_allocs is set, which
+// profiling does.
+extern bool track_expr_allocs;
+extern uint64_t expr_val_allocs[NUM_EXPRS];
+
+// Attributes the Val's created during its lifetime to the given type of
+// expression, minus those attributed to nested ones.
+class ExprAllocTracker {
+public:
+	explicit ExprAllocTracker(BroExprTag t)
+		{
+		if ( track_expr_allocs )
+			Start(t);
+		}
+
+	~ExprAllocTracker()
+		{
+		if ( active )
+			Finish();
+		}
+
+private:
+	void Start(BroExprTag t);
+	void Finish();
+
+	bool active = false;
+	BroExprTag tag;
+	uint64_t start;
+	uint64_t nested = 0;
+	ExprAllocTracker* parent;
+};
+
 class AddToExpr;
 class AnyIndexExpr;
 class AssignExpr;
@@ -127,8 +161,24 @@ public:
 	ExprPtr ThisPtr()		{ return {NewRef{}, this}; }
 
 	// Evaluates the expression and returns a corresponding Val*,
-	// or nil if the expression's value isn't fixed.
-	virtual ValPtr Eval(Frame* f) const = 0;
+	// or nil if the expression's value isn't fixed.  The Val's
+	// created along the way are attributed to the expression's
+	// type when tracking allocations.
+	ValPtr Eval(Frame* f) const
+		{
+		ExprAllocTracker tracker(tag);
+		return DoEval(f);
+		}
+
+	// Does the actual work of Eval() for the given type of expression.
+	virtual ValPtr DoEval(Frame* f) const = 0;
+
+	// Evaluates an expression whose value is represented as an int,
+	// count or double (such as bool, port or time, too) into its
+	// native value, which for arithmetic avoids creating Val's for
+	// intermediary results.  Returns false if there's no value, i.e.,
+	// when Eval() would return nil.
+	virtual bool EvalNative(Frame* f, ZVal& v) const;
 
 	// Same, but the context is that we are adding an element
 	// into the given aggregate of the given type.  Note that
@@ -413,7 +463,7 @@ public:
 	ID* Id() const		{ return id.get(); }
 	const IDPtr& IdPtr() const;
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 	void Assign(Frame* f, ValPtr v) override;
 	ExprPtr MakeLvalue() override;
 	bool IsPure() const override;
@@ -447,7 +497,7 @@ public:
 	Val* Value() const	{ return val.get(); }
 	ValPtr ValuePtr() const	{ return val; }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -464,10 +514,10 @@ class UnaryExpr : public Expr {
 public:
 	Expr* Op() const	{ return op.get(); }
 
-	// UnaryExpr::Eval correctly handles vector types.  Any child
-	// class that overrides Eval() should be modified to handle
+	// UnaryExpr::DoEval correctly handles vector types.  Any child
+	// class that overrides DoEval() should be modified to handle
 	// vectors correctly as necessary.
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	bool IsPure() const override;
 
@@ -502,10 +552,11 @@ public:
 
 	bool IsPure() const override;
 
-	// BinaryExpr::Eval correctly handles vector types.  Any child
-	// class that overrides Eval() should be modified to handle
+	// BinaryExpr::DoEval correctly handles vector types.  Any child
+	// class that overrides DoEval() should be modified to handle
 	// vectors correctly as necessary.
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
+	bool EvalNative(Frame* f, ZVal& v) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -537,6 +588,18 @@ protected:
 	// Returns the expression folded using the given constants.
 	virtual ValPtr Fold(Val* v1, Val* v2) const;
 
+	// True if the expression is arithmetic or a comparison on operands
+	// with native values, which then get folded without Val's.
+	bool HasNativeFold() const;
+
+	// Folds the native values of the operands, which are represented
+	// as given by "it".
+	ZVal NativeFold(InternalTypeTag it, const ZVal& z1, const ZVal& z2) const;
+
+	// Returns the Val for a native value of the expression's (scalar)
+	// type.
+	ValPtr NativeToVal(const ZVal& z) const;
+
 	// Same for when the constants are strings.
 	virtual ValPtr StringFold(Val* v1, Val* v2) const;
 
@@ -576,7 +639,7 @@ protected:
 class CloneExpr final : public UnaryExpr {
 public:
 	explicit CloneExpr(ExprPtr op);
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -589,7 +652,7 @@ class IncrExpr final : public UnaryExpr {
 public:
 	IncrExpr(BroExprTag tag, ExprPtr op);
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 	ValPtr DoSingleEval(Frame* f, Val* v) const;
 	bool IsPure() const override;
 
@@ -646,6 +709,8 @@ class NegExpr final : public UnaryExpr {
 public:
 	explicit NegExpr(ExprPtr op);
 
+	bool EvalNative(Frame* f, ZVal& v) const override;
+
 	// Optimization-related:
 	ExprPtr Duplicate() override;
 	bool WillTransform(Reducer* c) const override;
@@ -658,7 +723,7 @@ protected:
 class SizeExpr final : public UnaryExpr {
 public:
 	explicit SizeExpr(ExprPtr op);
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -684,7 +749,7 @@ protected:
 class AddToExpr final : public BinaryExpr {
 public:
 	AddToExpr(ExprPtr op1, ExprPtr op2);
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -695,7 +760,7 @@ public:
 class RemoveFromExpr final : public BinaryExpr {
 public:
 	RemoveFromExpr(ExprPtr op1, ExprPtr op2);
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -749,7 +814,7 @@ class BoolExpr final : public BinaryExpr {
 public:
 	BoolExpr(BroExprTag tag, ExprPtr op1, ExprPtr op2);
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 	ValPtr DoSingleEval(Frame* f, ValPtr v1, Expr* op2) const;
 
 	// Optimization-related:
@@ -806,7 +871,7 @@ public:
 	const Expr* Op2() const	{ return op2.get(); }
 	const Expr* Op3() const	{ return op3.get(); }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 	bool IsPure() const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -865,7 +930,7 @@ public:
 	           const AttributesPtr& attrs = nullptr,
 		   bool type_check = true);
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 	void EvalIntoAggregate(const zeek::Type* t, Val* aggr, Frame* f) const override;
 	TypePtr InitType() const override;
 	bool IsRecordElement(TypeDecl* td) const override;
@@ -901,7 +966,7 @@ class IndexSliceAssignExpr final : public AssignExpr {
 public:
 	IndexSliceAssignExpr(ExprPtr op1,
 	                     ExprPtr op2, bool is_init);
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -923,7 +988,7 @@ public:
 
 	// Need to override Eval since it can take a vector arg but does
 	// not necessarily return a vector.
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	bool IsSlice() const { return is_slice; }
 
@@ -939,6 +1004,10 @@ protected:
 	void ExprDescribe(ODesc* d) const override;
 
 	bool is_slice;
+
+	// True if op1 is a table indexed by a single atomic value, which
+	// then gets looked up without wrapping it into a ListVal.
+	bool atomic_table_index = false;
 };
 
 // The following execute the heart of IndexExpr functionality for
@@ -979,9 +1048,9 @@ public:
 	    : IndexExpr(std::move(op1), std::move(op2), is_slice)
 		{ }
 
-	ValPtr Eval(Frame* f) const override
+	ValPtr DoEval(Frame* f) const override
 		{
-		auto v = IndexExpr::Eval(f);
+		auto v = IndexExpr::DoEval(f);
 
 		if ( v && evaluating > 0 )
 			results.emplace_back(v);
@@ -1006,6 +1075,9 @@ public:
 	void Assign(Frame* f, ValPtr v) override;
 	void Delete(Frame* f) override;
 
+	// Fields of native type load straight from their slot.
+	bool EvalNative(Frame* f, ZVal& v) const override;
+
 	ExprPtr MakeLvalue() override;
 
 	// Optimization-related:
@@ -1050,7 +1122,7 @@ public:
 
 	ListExpr* Op() const	{ return op.get(); }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	bool IsPure() const override;
 
@@ -1081,7 +1153,7 @@ public:
 	const AttributesPtr& GetAttrs() const
 		{ return attrs; }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -1108,7 +1180,7 @@ public:
 	const AttributesPtr& GetAttrs() const
 		{ return attrs; }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -1130,7 +1202,7 @@ public:
 	explicit VectorConstructorExpr(ListExprPtr constructor_list,
 	                               TypePtr arg_type = nullptr);
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	// Optimization-related:
 	ExprPtr Duplicate() override;
@@ -1168,6 +1240,8 @@ class ArithCoerceExpr final : public UnaryExpr {
 public:
 	ArithCoerceExpr(ExprPtr op, TypeTag t);
 
+	bool EvalNative(Frame* f, ZVal& v) const override;
+
 	// Optimization-related:
 	ExprPtr Duplicate() override;
 
@@ -1242,7 +1316,7 @@ public:
 
 	bool IsPure() const override;
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	Expr* When() const	{ return when.get(); }
 	EventExpr* Event() const	{ return event.get(); }
@@ -1279,9 +1353,15 @@ public:
 
 	bool HasReducedOps(Reducer* c) const override;
 
+	// Looks up single atomic values in tables directly, see
+	// IndexExpr::DoEval().
+	ValPtr DoEval(Frame* f) const override;
+
 protected:
 	ValPtr Fold(Val* v1, Val* v2) const override;
 
+	// True if op2 is a table indexed by a single atomic value.
+	bool atomic_table_index = false;
 };
 
 class CallExpr final : public Expr {
@@ -1294,7 +1374,7 @@ public:
 
 	bool IsPure() const override;
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -1329,7 +1409,7 @@ public:
 	const IDPList& OuterIDs() const	{ return outer_ids; }
 	const function_ingredients& Ingredients() const	{ return *ingredients; }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 	Scope* GetScope() const;
@@ -1370,7 +1450,7 @@ public:
 	// True if the entire list represents pure values.
 	bool IsPure() const override;
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	TypePtr InitType() const override;
 	ValPtr InitVal(const zeek::Type* t, ValPtr aggr) const override;
@@ -1404,7 +1484,7 @@ public:
 	ListExpr* Args() const		{ return args.get(); }
 	EventHandlerPtr Handler()  const	{ return handler; }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -1442,7 +1522,7 @@ public:
 	ExprPtr Duplicate() override;
 
 protected:
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 	void ExprDescribe(ODesc* d) const override;
 };
 
@@ -1474,7 +1554,7 @@ public:
 	ListExprPtr Args() const	{ return args; }
 	StmtPtr Body() const		{ return body; }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	ExprPtr Duplicate() override;
 
@@ -1499,7 +1579,7 @@ protected:
 class AppendToExpr : public BinaryExpr {
 public:
 	AppendToExpr(ExprPtr op1, ExprPtr op2);
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	bool IsReduced(Reducer* c) const override;
 	ExprPtr Reduce(Reducer* c, StmtPtr& red_stmt) override;
@@ -1513,7 +1593,7 @@ public:
 	// "op1[op2] = op3", all reduced.
 	IndexAssignExpr(ExprPtr op1, ExprPtr op2, ExprPtr op3);
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	ExprPtr Duplicate() override;
 
@@ -1544,7 +1624,7 @@ public:
 	const char* FieldName() const	{ return field_name; }
 	int Field() const		{ return field; }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	ExprPtr Duplicate() override;
 
@@ -1606,7 +1686,7 @@ class NopExpr : public Expr {
 public:
 	explicit NopExpr() : Expr(EXPR_NOP) { }
 
-	ValPtr Eval(Frame* f) const override;
+	ValPtr DoEval(Frame* f) const override;
 
 	ExprPtr Duplicate() override;
 
@@ -41,14 +41,19 @@ FragReassembler::FragReassembler(session::Manager* arg_s,
 	if ( ip4 )
 		{
 		proto_hdr_len = ip->HdrLen();
-		proto_hdr = new u_char[64];	// max IP header + slop
+		proto_hdr = inline_hdr;	// max IP header + slop
 		// Don't do a structure copy - need to pick up options, too.
 		memcpy((void*) proto_hdr, (const void*) ip4, proto_hdr_len);
 		}
 	else
 		{
 		proto_hdr_len = ip->HdrLen() - 8; // minus length of fragment header
-		proto_hdr = new u_char[proto_hdr_len];
+
+		if ( proto_hdr_len <= INLINE_HDR_SIZE )
+			proto_hdr = inline_hdr;
+		else
+			proto_hdr = new u_char[proto_hdr_len];
+
 		memcpy(proto_hdr, ip->IP6_Hdr(), proto_hdr_len);
 		}
 
@@ -70,7 +75,9 @@ FragReassembler::FragReassembler(session::Manager* arg_s,
 FragReassembler::~FragReassembler()
 	{
 	DeleteTimer();
-	delete [] proto_hdr;
+
+	if ( proto_hdr != inline_hdr )
+		delete [] proto_hdr;
 	}
 
 void FragReassembler::AddFragment(double t, const std::unique_ptr<IP_Hdr>& ip,
@@ -189,6 +196,26 @@ void FragReassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
 		Weird("fragment_overlap");
 	}
 
+bool FragReassembler::Evict()
+	{
+	if ( ! pending )
+		{
+		// Already reassembled, and the FragReassemblerTracker
+		// removes us once the packet's done.
+		ClearBlocks();
+		return false;
+		}
+
+	// The datagram can't be completed anymore. Drop it right away
+	// rather than waiting for the timer, which with the default
+	// frag_timeout never fires. Later fragments start over.
+	Weird("fragment_memory_eviction");
+	ClearBlocks();
+	DeleteTimer();
+	fragment_mgr->Remove(this);
+	return true;
+	}
+
 void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 	{
 	auto it = block_list.Begin();
@@ -197,6 +224,12 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 		// For sure don't have it all yet.
 		return;
 
+	if ( block_list.DataSize() < frag_size )
+		// Blocks never overlap, so there's a hole somewhere.  This
+		// saves walking the list for each fragment of a datagram
+		// that arrives in many pieces.
+		return;
+
 	auto next = std::next(it);
 
 	// We might have it all - look for contiguous all the way.
@@ -298,6 +331,7 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 		reassembled_pkt = std::make_unique<IP_Hdr>(reassem4, true);
 		reassembled_pkt->reassembled = true;
 		DeleteTimer();
+		fragment_mgr->Completed(this);
 		}
 
 	else if ( version == 6 )
@@ -308,6 +342,7 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 		reassembled_pkt = std::make_unique<IP_Hdr>(reassem6, true, n, chain);
 		reassembled_pkt->reassembled = true;
 		DeleteTimer();
+		fragment_mgr->Completed(this);
 		}
 
 	else
@@ -337,6 +372,24 @@ void FragReassembler::DeleteTimer()
 		}
 	}
 
+size_t FragReassemblerKeyHash::operator()(const FragReassemblerKey& k) const
+	{
+	struct {
+		uint32_t src[4];
+		uint32_t dst[4];
+		uint32_t id;
+		uint32_t proto;
+	} buf;
+
+	std::get<0>(k).CopyIPv6(buf.src);
+	std::get<1>(k).CopyIPv6(buf.dst);
+	buf.id = std::get<2>(k);
+	buf.proto = std::get<3>(k);
+
+	// Keyed, since the fields are all under the sender's control.
+	return KeyedHash::Hash64(&buf, sizeof(buf));
+	}
+
 FragmentManager::~FragmentManager()
 	{
 	Clear();
@@ -346,7 +399,8 @@ FragReassembler* FragmentManager::NextFragment(double t, const std::unique_ptr<I
                                                const u_char* pkt)
 	{
 	uint32_t frag_id = ip->ID();
-	FragReassemblerKey key = std::make_tuple(ip->SrcAddr(), ip->DstAddr(), frag_id);
+	uint8_t proto = ip->IP4_Hdr() ? static_cast<uint8_t>(ip->NextProto()) : 0;
+	FragReassemblerKey key = std::make_tuple(ip->SrcAddr(), ip->DstAddr(), frag_id, proto);
 
 	FragReassembler* f = nullptr;
 	auto it = fragments.find(key);
@@ -355,10 +409,18 @@ FragReassembler* FragmentManager::NextFragment(double t, const std::unique_ptr<I
 
 	if ( ! f )
 		{
+		EvictOldest();
+
 		f = new FragReassembler(session_mgr, ip, pkt, key, t);
 		fragments[key] = f;
 		if ( fragments.size() > max_fragments )
 			max_fragments = fragments.size();
+
+		// A datagram that's complete with its first fragment is
+		// already off the list.
+		if ( ! f->reassembled_pkt )
+			Link(f);
+
 		return f;
 		}
 
@@ -369,7 +431,10 @@ FragReassembler* FragmentManager::NextFragment(double t, const std::unique_ptr<I
 void FragmentManager::Clear()
 	{
 	for ( const auto& entry : fragments )
+		{
+		Unlink(entry.second);
 		Unref(entry.second);
+		}
 
 	fragments.clear();
 	}
@@ -379,15 +444,74 @@ void FragmentManager::Remove(detail::FragReassembler* f)
 	if ( ! f )
 		return;
 
+	Unlink(f);
+
 	if ( fragments.erase(f->Key()) == 0 )
 		reporter->InternalWarning("fragment reassembler not in dict");
 
 	Unref(f);
 	}
 
+void FragmentManager::Completed(detail::FragReassembler* f)
+	{
+	Unlink(f);
+	}
+
+void FragmentManager::EvictOldest()
+	{
+	auto limit = BifConst::frag_max_reassemblers;
+
+	while ( limit && num_pending >= limit && oldest )
+		{
+		auto f = oldest;
+		f->Weird("fragment_reassembler_evicted");
+		f->DeleteTimer();
+		Remove(f);
+		}
+	}
+
+void FragmentManager::Link(detail::FragReassembler* f)
+	{
+	if ( f->pending )
+		return;
+
+	f->pending = true;
+	f->older = newest;
+	f->newer = nullptr;
+
+	if ( newest )
+		newest->newer = f;
+	else
+		oldest = f;
+
+	newest = f;
+	++num_pending;
+	}
+
+void FragmentManager::Unlink(detail::FragReassembler* f)
+	{
+	if ( ! f->pending )
+		return;
+
+	if ( f->older )
+		f->older->newer = f->newer;
+	else
+		oldest = f->newer;
+
+	if ( f->newer )
+		f->newer->older = f->older;
+	else
+		newest = f->older;
+
+	f->older = f->newer = nullptr;
+	f->pending = false;
+	--num_pending;
+	}
+
 uint32_t FragmentManager::MemoryAllocation() const
 	{
-	return fragments.size() * (sizeof(FragmentMap::key_type) + sizeof(FragmentMap::value_type));
+	return fragments.size() * (sizeof(FragmentMap::key_type) + sizeof(FragmentMap::value_type)) +
+	       fragments.bucket_count() * sizeof(void*);
 	}
 
 } // namespace zeek::detail
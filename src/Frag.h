@@ -4,6 +4,7 @@
 
 #include <sys/types.h> // for u_char
 #include <tuple>
+#include <unordered_map>
 
 #include "zeek/util.h" // for bro_uint_t
 #include "zeek/IPAddr.h"
@@ -21,7 +22,15 @@ namespace detail {
 class FragReassembler;
 class FragTimer;
 
-using FragReassemblerKey = std::tuple<IPAddr, IPAddr, bro_uint_t>;
+// Fragments belong to the same datagram if they agree in source,
+// destination, identification and, for IPv4, protocol (RFC 791). IPv6
+// leaves the protocol out (RFC 8200), since the Next Header of the
+// fragments' unfragmentable parts may differ; it's always 0 there.
+using FragReassemblerKey = std::tuple<IPAddr, IPAddr, bro_uint_t, uint8_t>;
+
+struct FragReassemblerKeyHash {
+	size_t operator()(const FragReassemblerKey& k) const;
+};
 
 class FragReassembler : public Reassembler {
 public:
@@ -41,8 +50,16 @@ public:
 protected:
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
+	bool Evict() override;
 	void Weird(const char* name) const;
 
+	friend class FragmentManager;
+
+	// Room for the IPv4 header with options, or a short IPv6 header
+	// chain, without going to the heap.
+	static constexpr uint16_t INLINE_HDR_SIZE = 64;
+	u_char inline_hdr[INLINE_HDR_SIZE];
+
 	u_char* proto_hdr;
 	std::unique_ptr<IP_Hdr> reassembled_pkt;
 	session::Manager* s;
@@ -52,6 +69,12 @@ protected:
 	uint16_t proto_hdr_len;
 
 	FragTimer* expire_timer;
+
+	// Position in the FragmentManager's list of incomplete datagrams,
+	// ordered by when their first fragment arrived.
+	FragReassembler* older = nullptr;
+	FragReassembler* newer = nullptr;
+	bool pending = false;
 };
 
 class FragTimer final : public Timer {
@@ -85,11 +108,30 @@ public:
 	size_t MaxFragments() const 	{ return max_fragments; }
 	uint32_t MemoryAllocation() const;
 
+	/**
+	 * Takes a reassembler off the list of incomplete datagrams once its
+	 * datagram has been reassembled, so that it can't get evicted while
+	 * the packet is being processed.
+	 */
+	void Completed(detail::FragReassembler* f);
+
 private:
 
-	using FragmentMap = std::map<detail::FragReassemblerKey, detail::FragReassembler*>;
+	// Keeps the number of incomplete datagrams within
+	// frag_max_reassemblers by dropping the oldest ones.
+	void EvictOldest();
+
+	void Link(detail::FragReassembler* f);
+	void Unlink(detail::FragReassembler* f);
+
+	using FragmentMap = std::unordered_map<detail::FragReassemblerKey, detail::FragReassembler*,
+	                                       detail::FragReassemblerKeyHash>;
 	FragmentMap fragments;
 	size_t max_fragments = 0;
+
+	detail::FragReassembler* oldest = nullptr;
+	detail::FragReassembler* newest = nullptr;
+	size_t num_pending = 0;
 };
 
 extern FragmentManager* fragment_mgr;
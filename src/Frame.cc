@@ -15,10 +15,77 @@ std::vector<zeek::detail::Frame*> g_frame_stack;
 
 namespace zeek::detail {
 
+// Recycled frames, and recycled element arrays by their size.  Frames
+// are only created by the thread running scripts, and the number kept
+// is bounded, as most of them go back right after the call that needed
+// them.  The lists are never destructed, so that frames released late
+// during termination still find them.
+static constexpr size_t MAX_RECYCLED_FRAMES = 256;
+static constexpr int MAX_RECYCLED_ELEMENTS_SIZE = 64;
+static constexpr size_t MAX_RECYCLED_ELEMENTS = 64;
+
+static auto& recycled_frames = *new std::vector<void*>;
+static auto recycled_elements =
+	new std::vector<void*>[MAX_RECYCLED_ELEMENTS_SIZE + 1];
+
+void* Frame::operator new(size_t n)
+	{
+	if ( n == sizeof(Frame) && ! recycled_frames.empty() )
+		{
+		auto p = recycled_frames.back();
+		recycled_frames.pop_back();
+		return p;
+		}
+
+	return ::operator new(n);
+	}
+
+void Frame::operator delete(void* p, size_t n)
+	{
+	if ( n == sizeof(Frame) && recycled_frames.size() < MAX_RECYCLED_FRAMES )
+		recycled_frames.push_back(p);
+	else
+		::operator delete(p);
+	}
+
+Frame::Element* Frame::NewElements(int n)
+	{
+	if ( n <= 0 )
+		return nullptr;
+
+	if ( n <= MAX_RECYCLED_ELEMENTS_SIZE && ! recycled_elements[n].empty() )
+		{
+		auto e = static_cast<Element*>(recycled_elements[n].back());
+		recycled_elements[n].pop_back();
+		return e;
+		}
+
+	return new Element[n]();
+	}
+
+void Frame::DeleteElements(Element* e, int n)
+	{
+	if ( ! e )
+		return;
+
+	if ( n <= MAX_RECYCLED_ELEMENTS_SIZE &&
+	     recycled_elements[n].size() < MAX_RECYCLED_ELEMENTS )
+		{
+		// The values are gone, but weak references leave their
+		// flag behind.
+		for ( int i = 0; i < n; ++i )
+			e[i].weak_ref = false;
+
+		recycled_elements[n].push_back(e);
+		}
+	else
+		delete [] e;
+	}
+
 Frame::Frame(int arg_size, const ScriptFunc* func, const zeek::Args* fn_args)
 	{
 	size = arg_size;
-	frame = std::make_unique<Element[]>(size);
+	frame = NewElements(size);
 	function = func;
 	func_args = fn_args;
 
@@ -61,6 +128,8 @@ Frame::~Frame()
 
 	for ( int i = 0; i < size; ++i )
 		ClearElement(i);
+
+	DeleteElements(frame, size);
 	}
 
 void Frame::AddFunctionWithClosureRef(ScriptFunc* func)
@@ -56,6 +56,15 @@ public:
 	 */
 	virtual ~Frame() override;
 
+	/**
+	 * Frames are allocated for every script function call, so they
+	 * get recycled rather than returned to the heap. Their elements
+	 * remain boxed Val's; only ZAM bodies keep native locals unboxed,
+	 * in their registers.
+	 */
+	static void* operator new(size_t n);
+	static void operator delete(void* p, size_t n);
+
 	/**
 	 * @param n the index to get.
 	 * @return the value at index *n* of the underlying array.
@@ -289,6 +298,13 @@ private:
 
 	const ValPtr& GetElementByID(const ID* id) const;
 
+	/**
+	 * Returns a cleared array of *n* elements, recycled from an earlier
+	 * frame if possible, and takes it back once the frame is done.
+	 */
+	static Element* NewElements(int n);
+	static void DeleteElements(Element* e, int n);
+
 	/**
 	 * Sets the element at index *n* of the underlying array to *v*, but does
 	 * not take ownership of a reference count to it.  This method is used to
@@ -343,7 +359,7 @@ private:
 	bool delayed;
 
 	/** Associates ID's offsets with values. */
-	std::unique_ptr<Element[]> frame;
+	Element* frame;
 
 	/**
 	 * The offset we're currently using for references into the frame.
@@ -49,6 +49,7 @@
 #include "zeek/RE.h"
 #include "zeek/Event.h"
 #include "zeek/Traverse.h"
+#include "zeek/ScriptProfile.h"
 #include "zeek/Reporter.h"
 #include "zeek/plugin/Manager.h"
 #include "zeek/module_util.h"
@@ -424,6 +425,7 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 
 		try
 			{
+			ScriptBodyProfiler body_prof(this, body.stmts.get());
 			result = body.stmts->Exec(f.get(), flow);
 			}
 
@@ -1035,10 +1037,12 @@ void init_primary_bifs()
 	GapStats = id::find_type<RecordType>("GapStats");
 	EventStats = id::find_type<RecordType>("EventStats");
 	TimerStats = id::find_type<RecordType>("TimerStats");
+	TableExpireStats = id::find_type<RecordType>("TableExpireStats");
 	FileAnalysisStats = id::find_type<RecordType>("FileAnalysisStats");
 	ThreadStats = id::find_type<RecordType>("ThreadStats");
 	BrokerStats = id::find_type<RecordType>("BrokerStats");
 	ReporterStats = id::find_type<RecordType>("ReporterStats");
+	PacketStageStats = id::find_type<RecordType>("PacketStageStats");
 
 	var_sizes = id::find_type("var_sizes")->AsTableType();
 
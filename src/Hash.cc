@@ -7,6 +7,7 @@
 #include <highwayhash/highwayhash_target.h>
 #include <highwayhash/instruction_sets.h>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/digest.h"
 #include "zeek/Reporter.h"
 #include "zeek/ZeekString.h"
@@ -158,15 +159,14 @@ HashKey::HashKey(const String* s)
 HashKey::HashKey(int copy_key, void* arg_key, int arg_size)
 	{
 	size = arg_size;
-	is_our_dynamic = true;
 
 	if ( copy_key )
-		{
-		key = (void*) new char[size];
-		memcpy(key, arg_key, size);
-		}
+		StoreKey(arg_key, size);
 	else
+		{
 		key = arg_key;
+		is_our_dynamic = true;
+		}
 
 	hash = HashBytes(key, size);
 	}
@@ -175,8 +175,7 @@ HashKey::HashKey(const void* arg_key, int arg_size, hash_t arg_hash)
 	{
 	size = arg_size;
 	hash = arg_hash;
-	key = CopyKey(arg_key, size);
-	is_our_dynamic = true;
+	StoreKey(arg_key, size);
 	}
 
 HashKey::HashKey(const void* arg_key, int arg_size, hash_t arg_hash,
@@ -190,9 +189,19 @@ HashKey::HashKey(const void* arg_key, int arg_size, hash_t arg_hash,
 HashKey::HashKey(const void* bytes, int arg_size)
 	{
 	size = arg_size;
-	key = CopyKey(bytes, size);
+	StoreKey(bytes, size);
 	hash = HashBytes(key, size);
-	is_our_dynamic = true;
+	}
+
+HashKey::HashKey(HashKey&& other) noexcept
+	: key_u(other.key_u), key(other.key), hash(other.hash),
+	  size(other.size), is_our_dynamic(other.is_our_dynamic)
+	{
+	// Keys living in the other's union now live in ours.
+	if ( other.key == &other.key_u )
+		key = &key_u;
+
+	other.is_our_dynamic = false;
 	}
 
 void* HashKey::TakeKey()
@@ -213,9 +222,51 @@ void* HashKey::CopyKey(const void* k, int s) const
 	return k_copy;
 	}
 
+void HashKey::StoreKey(const void* k, int s)
+	{
+	if ( s <= INLINE_KEY_SIZE )
+		{
+		memcpy(key_u.bytes, k, s);
+		key = (void*) &key_u;
+		is_our_dynamic = false;
+		}
+	else
+		{
+		key = CopyKey(k, s);
+		is_our_dynamic = true;
+		}
+	}
+
 hash_t HashKey::HashBytes(const void* bytes, int size)
 	{
 	return KeyedHash::Hash64(bytes, size);
 	}
 
+TEST_CASE("hashkey inline storage")
+	{
+	char bytes[HashKey::INLINE_KEY_SIZE + 1];
+	memset(bytes, 'x', sizeof(bytes));
+
+	HashKey small(bytes, HashKey::INLINE_KEY_SIZE);
+	HashKey large(bytes, HashKey::INLINE_KEY_SIZE + 1);
+
+	CHECK(small.MemoryAllocation() < large.MemoryAllocation());
+	CHECK(small.Hash() == HashKey::HashBytes(bytes, HashKey::INLINE_KEY_SIZE));
+
+	HashKey moved_small(std::move(small));
+	HashKey moved_large(std::move(large));
+
+	CHECK(moved_small.Key() != small.Key());
+	CHECK(moved_small.Size() == HashKey::INLINE_KEY_SIZE);
+	CHECK(memcmp(moved_small.Key(), bytes, HashKey::INLINE_KEY_SIZE) == 0);
+	CHECK(moved_large.Key() == large.Key());
+	CHECK(memcmp(moved_large.Key(), bytes, HashKey::INLINE_KEY_SIZE + 1) == 0);
+
+	// Inline keys get copied when taken.
+	char* taken = static_cast<char*>(moved_small.TakeKey());
+	CHECK(taken != moved_small.Key());
+	CHECK(memcmp(taken, bytes, HashKey::INLINE_KEY_SIZE) == 0);
+	delete [] taken;
+	}
+
 } // namespace zeek::detail
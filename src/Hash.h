@@ -215,6 +215,12 @@ constexpr int NUM_HASH_KEYS = HASH_KEY_STRING + 1;
 
 class HashKey {
 public:
+	// Keys of up to this many bytes that the HashKey copies are kept in
+	// the HashKey itself rather than in a separate allocation. This
+	// covers single addresses and subnets as well as composite keys such
+	// as [addr, port] or [addr, addr].
+	static constexpr int INLINE_KEY_SIZE = 32;
+
 	explicit HashKey(bro_int_t i);
 	explicit HashKey(bro_uint_t u);
 	explicit HashKey(uint32_t u);
@@ -229,6 +235,13 @@ public:
 			delete [] (char *) key;
 		}
 
+	// Keys may point into the HashKey itself, so copying is out, but
+	// moving takes care of re-pointing them.
+	HashKey(const HashKey&) = delete;
+	HashKey& operator=(const HashKey&) = delete;
+	HashKey(HashKey&& other) noexcept;
+	HashKey& operator=(HashKey&&) = delete;
+
 	// Create a HashKey given all of its components.  "key" is assumed
 	// to be dynamically allocated and to now belong to this HashKey
 	// (to delete upon destruct'ing).  If "copy_key" is true, it's
@@ -253,25 +266,30 @@ public:
 
 	// Hands over the key to the caller.  This means that if the
 	// key is our dynamic, we give it to the caller and mark it
-	// as not our dynamic.  If initially it's not our dynamic,
-	// we give them a copy of it.
+	// as not our dynamic.  If initially it's not our dynamic
+	// (including when it's stored inline), we give them a copy of it.
 	void* TakeKey();
 
 	const void* Key() const	{ return key; }
 	int Size() const	{ return size; }
 	hash_t Hash() const	{ return hash; }
 
-	unsigned int MemoryAllocation() const	{ return padded_sizeof(*this) + util::pad_size(size); }
+	unsigned int MemoryAllocation() const
+		{ return padded_sizeof(*this) + (is_our_dynamic ? util::pad_size(size) : 0); }
 
 	static hash_t HashBytes(const void* bytes, int size);
 protected:
 	void* CopyKey(const void* key, int size) const;
 
+	// Stores a copy of the given key, inline if it fits.
+	void StoreKey(const void* key, int size);
+
 	union {
 		bro_int_t i;
 		uint32_t u32;
 		double d;
 		const void* p;
+		char bytes[INLINE_KEY_SIZE];
 	} key_u;
 
 	void* key;
@@ -180,6 +180,7 @@ int load_sample_freq;
 int packet_filter_default;
 
 int sig_max_group_size;
+int sig_batch_matching;
 
 int dpd_reassemble_first_packets;
 int dpd_buffer_size;
@@ -240,6 +241,7 @@ void init_general_global_var()
 	table_incremental_step = id::find_val("table_incremental_step")->AsCount();
 	packet_filter_default = id::find_val("packet_filter_default")->AsBool();
 	sig_max_group_size = id::find_val("sig_max_group_size")->AsCount();
+	sig_batch_matching = id::find_val("sig_batch_matching")->AsBool();
 	check_for_unused_event_handlers = id::find_val("check_for_unused_event_handlers")->AsBool();
 	record_all_packets = id::find_val("record_all_packets")->AsBool();
 	bits_per_uid = id::find_val("bits_per_uid")->AsCount();
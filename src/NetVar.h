@@ -81,6 +81,7 @@ extern int load_sample_freq;
 extern int packet_filter_default;
 
 extern int sig_max_group_size;
+extern int sig_batch_matching;
 
 extern int dpd_reassemble_first_packets;
 extern int dpd_buffer_size;
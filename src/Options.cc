@@ -121,6 +121,7 @@ void usage(const char* prog, int code)
 	fprintf(stderr, "    -M|--mem-profile               | record heap [perftools]\n");
 #endif
 	fprintf(stderr, "    --pseudo-realtime[=<speedup>]  | enable pseudo-realtime for performance evaluation (default 1)\n");
+	fprintf(stderr, "    --profile-scripts[=<prefix>]   | profile script execution, writing <prefix>.log and <prefix>.folded (default prefix \"script-prof\")\n");
 	fprintf(stderr, "    -j|--jobs                      | enable supervisor mode\n");
 
 #ifdef USE_IDMEF
@@ -138,6 +139,7 @@ void usage(const char* prog, int code)
 	fprintf(stderr, "    $ZEEK_PROFILER_FILE            | Output file for script execution statistics (not set)\n");
 	fprintf(stderr, "    $ZEEK_DISABLE_ZEEKYGEN         | Disable Zeekygen documentation support (%s)\n", getenv("ZEEK_DISABLE_ZEEKYGEN") ? "set" : "not set");
 	fprintf(stderr, "    $ZEEK_DNS_RESOLVER             | IPv4/IPv6 address of DNS resolver to use (%s)\n", getenv("ZEEK_DNS_RESOLVER") ? getenv("ZEEK_DNS_RESOLVER") : "not set, will use first IPv4 address from /etc/resolv.conf");
+	fprintf(stderr, "    $ZEEK_TIMER_MGR                | timer manager to use, 'heap' or 'wheel' (%s)\n", getenv("ZEEK_TIMER_MGR") ? getenv("ZEEK_TIMER_MGR") : "heap");
 	fprintf(stderr, "    $ZEEK_DEBUG_LOG_STDERR         | Use stderr for debug logs generated via the -B flag");
 
 	fprintf(stderr, "\n");
@@ -158,8 +160,10 @@ static void set_analysis_option(const char* opt, Options& opts)
 	if ( util::streq(opt, "help") )
 		{
 		fprintf(stderr, "--optimize options:\n");
+		fprintf(stderr, "    ZAM	compile scripts to ZAM code; implies optimize-AST\n");
 		fprintf(stderr, "    all	equivalent to \"inline\" and \"activate\"\n");
 		fprintf(stderr, "    add-C++	generate private C++ for any missing script bodies\n");
+		fprintf(stderr, "    dump-ZAM	dump ZAM code to stdout; implies ZAM\n");
 		fprintf(stderr, "    dump-uds	dump use-defs to stdout; implies xform\n");
 		fprintf(stderr, "    dump-xform	dump transformed scripts to stdout; implies xform\n");
 		fprintf(stderr, "    gen-C++	generate C++ script bodies\n");
@@ -177,8 +181,12 @@ static void set_analysis_option(const char* opt, Options& opts)
 
 	auto& a_o = opts.analysis_options;
 
-	if ( util::streq(opt, "add-C++") )
+	if ( util::streq(opt, "ZAM") )
+		a_o.activate = a_o.optimize_AST = a_o.gen_ZAM_code = true;
+	else if ( util::streq(opt, "add-C++") )
 		a_o.add_CPP = true;
+	else if ( util::streq(opt, "dump-ZAM") )
+		a_o.activate = a_o.optimize_AST = a_o.gen_ZAM_code = a_o.dump_ZAM = true;
 	else if ( util::streq(opt, "dump-uds") )
 		a_o.activate = a_o.dump_uds = true;
 	else if ( util::streq(opt, "dump-xform") )
@@ -343,6 +351,7 @@ Options parse_cmdline(int argc, char** argv)
 #endif
 
 		{"pseudo-realtime",	optional_argument, nullptr,	'E'},
+		{"profile-scripts",	optional_argument, nullptr,	'R'},
 		{"jobs",	optional_argument, nullptr,	'j'},
 		{"test",		no_argument,		nullptr,	'#'},
 
@@ -458,6 +467,9 @@ Options parse_cmdline(int argc, char** argv)
 			if ( optarg )
 				rval.pseudo_realtime = atof(optarg);
 			break;
+		case 'R':
+			rval.script_profile_prefix = optarg ? optarg : "script-prof";
+			break;
 		case 'F':
 			if ( rval.dns_mode != detail::DNS_DEFAULT )
 				usage(zargs[0], 1);
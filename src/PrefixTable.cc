@@ -1,9 +1,167 @@
 #include "zeek/PrefixTable.h"
+
+#include <algorithm>
+#include <random>
+
 #include "zeek/Reporter.h"
 #include "zeek/Val.h"
+#include "zeek/util.h"
+#include "zeek/3rdparty/doctest.h"
 
 namespace zeek::detail {
 
+// Returns the n bits starting at bit pos of a host-order key. The trie's
+// strides never straddle two words.
+static inline uint32_t key_bits(const uint32_t* key, int pos, int n)
+	{
+	return (key[pos / 32] >> (32 - pos % 32 - n)) & ((1u << n) - 1);
+	}
+
+void PrefixTrie::Trie::Insert(const uint32_t* key, int len, uint32_t result)
+	{
+	if ( ! enabled )
+		return;
+
+	++num_prefixes;
+
+	if ( slots.empty() )
+		slots.resize(1 << ROOT_BITS, 0);
+
+	uint32_t node = 0;
+	int pos = 0;
+	int bits = ROOT_BITS;
+
+	while ( len > pos + bits )
+		{
+		uint32_t i = node + key_bits(key, pos, bits);
+
+		if ( ! (slots[i] & CHILD) )
+			{
+			// The new level inherits the slot's match, which
+			// belongs to a shorter prefix.
+			uint32_t inherited = slots[i];
+			uint32_t child = slots.size();
+			slots.resize(child + (1 << NODE_BITS), inherited);
+			slots[i] = CHILD | child;
+			}
+
+		node = slots[i] & ~CHILD;
+		pos += bits;
+		bits = NODE_BITS;
+		}
+
+	// Expand the prefix into all slots of this level it covers. Since
+	// prefixes come in order of increasing width, none of these slots
+	// leads to a deeper level yet.
+	int free_bits = pos + bits - len;
+	uint32_t first = key_bits(key, pos, bits) & ~((1u << free_bits) - 1);
+
+	for ( uint32_t i = first; i < first + (1u << free_bits); ++i )
+		slots[node + i] = result;
+	}
+
+void PrefixTrie::Trie::Disable()
+	{
+	std::vector<uint32_t>().swap(slots);
+	enabled = false;
+	}
+
+size_t PrefixTrie::Trie::BytesPerPrefix() const
+	{
+	if ( slots.empty() )
+		return 0;
+
+	return (slots.size() - (1 << ROOT_BITS)) * sizeof(uint32_t) / num_prefixes;
+	}
+
+uint32_t PrefixTrie::Trie::Lookup(const uint32_t* key) const
+	{
+	if ( slots.empty() )
+		return 0;
+
+	uint32_t s = slots[key_bits(key, 0, ROOT_BITS)];
+
+	for ( int pos = ROOT_BITS; s & CHILD; pos += NODE_BITS )
+		s = slots[(s & ~CHILD) + key_bits(key, pos, NODE_BITS)];
+
+	return s;
+	}
+
+void PrefixTrie::Insert(const uint32_t* prefix, int width, void* data)
+	{
+	uint32_t key[4];
+
+	for ( int i = 0; i < 4; ++i )
+		key[i] = ntohl(prefix[i]);
+
+	uint32_t result = results.size();
+	results.push_back(data);
+
+	static constexpr uint32_t v4_mapped[3] = { 0, 0, 0xffff };
+
+	if ( width > 96 && key[0] == v4_mapped[0] && key[1] == v4_mapped[1] &&
+	     key[2] == v4_mapped[2] )
+		{
+		v4.Insert(&key[3], width - 96, result);
+		return;
+		}
+
+	// Prefixes spanning all of the IPv4-mapped range match any IPv4
+	// address.
+	bool covers_v4 = true;
+
+	for ( int i = 0, w = width; i < 3 && w > 0; ++i, w -= 32 )
+		{
+		uint32_t mask = w >= 32 ? 0xffffffff : ~(0xffffffff >> w);
+
+		if ( (key[i] ^ v4_mapped[i]) & mask )
+			covers_v4 = false;
+		}
+
+	if ( covers_v4 )
+		{
+		uint32_t any = 0;
+		v4.Insert(&any, 0, result);
+		}
+
+	if ( width > MAX_V6_WIDTH )
+		v6.Disable();
+	else
+		v6.Insert(key, width, result);
+	}
+
+void PrefixTrie::Limit(size_t bytes_per_prefix)
+	{
+	if ( v4.BytesPerPrefix() > bytes_per_prefix )
+		v4.Disable();
+
+	if ( v6.BytesPerPrefix() > bytes_per_prefix )
+		v6.Disable();
+	}
+
+bool PrefixTrie::Lookup(const IPAddr& addr, void** result) const
+	{
+	const uint32_t* bytes;
+	uint32_t key[4];
+	int n = addr.GetBytes(&bytes);
+	const Trie& t = (n == 1 ? v4 : v6);
+
+	if ( ! t.Enabled() )
+		return false;
+
+	for ( int i = 0; i < n; ++i )
+		key[i] = ntohl(bytes[i]);
+
+	*result = results[t.Lookup(key)];
+	return true;
+	}
+
+size_t PrefixTrie::MemoryAllocation() const
+	{
+	return padded_sizeof(*this) + v4.MemoryAllocation() + v6.MemoryAllocation() +
+		results.capacity() * sizeof(void*);
+	}
+
 prefix_t* PrefixTable::MakePrefix(const IPAddr& addr, int width)
 	{
 	prefix_t* prefix = (prefix_t*) util::safe_malloc(sizeof(prefix_t));
@@ -39,6 +197,7 @@ void* PrefixTable::Insert(const IPAddr& addr, int width, void* data)
 	// If there is no data to be associated with addr, we take the
 	// node itself.
 	node->data = data ? data : node;
+	Modified();
 
 	return old;
 	}
@@ -91,6 +250,18 @@ std::list<std::tuple<IPPrefix,void*>> PrefixTable::FindAll(const SubNetVal* valu
 
 void* PrefixTable::Lookup(const IPAddr& addr, int width, bool exact) const
 	{
+	if ( ! exact && width == 128 )
+		{
+		if ( ! trie && tree->num_active_node >= TRIE_MIN_NODES &&
+		     ++lookups_since_change >= static_cast<uint64_t>(tree->num_active_node) )
+			BuildTrie();
+
+		void* result;
+
+		if ( trie && trie->Lookup(addr, &result) )
+			return result;
+		}
+
 	prefix_t* prefix = MakePrefix(addr, width);
 	patricia_node_t* node =
 		exact ? patricia_search_exact(tree, prefix) :
@@ -138,6 +309,7 @@ void* PrefixTable::Remove(const IPAddr& addr, int width)
 
 	void* old = node->data;
 	patricia_remove(tree, node);
+	Modified();
 
 	return old;
 	}
@@ -165,6 +337,46 @@ void* PrefixTable::Remove(const Val* value)
 	}
 	}
 
+void PrefixTable::BuildTrie() const
+	{
+	struct Prefix {
+		const uint32_t* addr;
+		int width;
+		void* data;
+	};
+
+	std::vector<Prefix> prefixes;
+	prefixes.reserve(tree->num_active_node);
+
+	patricia_node_t* node;
+
+	PATRICIA_WALK(tree->head, node) {
+		prefixes.push_back({reinterpret_cast<const uint32_t*>(&node->prefix->add.sin6),
+		                    node->prefix->bitlen, node->data});
+	} PATRICIA_WALK_END;
+
+	std::stable_sort(prefixes.begin(), prefixes.end(),
+	                 [](const Prefix& a, const Prefix& b) { return a.width < b.width; });
+
+	trie = std::make_unique<PrefixTrie>();
+
+	for ( const auto& p : prefixes )
+		trie->Insert(p.addr, p.width, p.data);
+
+	trie->Limit(TRIE_MAX_GROWTH * (padded_sizeof(patricia_node_t) + padded_sizeof(prefix_t)));
+	}
+
+size_t PrefixTable::MemoryAllocation() const
+	{
+	size_t size = padded_sizeof(*this) + padded_sizeof(*tree) +
+		tree->num_active_node * (padded_sizeof(patricia_node_t) + padded_sizeof(prefix_t));
+
+	if ( trie )
+		size += trie->MemoryAllocation();
+
+	return size;
+	}
+
 PrefixTable::iterator PrefixTable::InitIterator()
 	{
 	iterator i;
@@ -206,4 +418,126 @@ void* PrefixTable::GetNext(iterator* i)
 	// Not reached.
 	}
 
+TEST_SUITE_BEGIN("PrefixTable");
+
+TEST_CASE("prefix table longest match")
+	{
+	PrefixTable pt;
+	std::vector<IPPrefix> prefixes;
+	std::mt19937 rng(1);
+
+	// The trie covers IPv6 only if there are no prefixes longer than /64,
+	// IPv6 lookups go to the tree otherwise.
+	int max_v6_width = 0;
+
+	SUBCASE("long IPv6 prefixes")
+		{
+		max_v6_width = 128;
+		}
+
+	SUBCASE("short IPv6 prefixes")
+		{
+		max_v6_width = PrefixTrie::MAX_V6_WIDTH;
+		}
+
+	prefixes.emplace_back(IPAddr("::"), 0);
+	prefixes.emplace_back(IPAddr("2001:db8::"), 32);
+
+	// Keep the prefixes clustered so that plenty of them nest.
+	for ( int i = 0; i < 400; ++i )
+		{
+		uint32_t a = htonl(rng() & 0x0a0f0fff);
+		prefixes.emplace_back(IPAddr(IPv4, &a, IPAddr::Network), 8 + rng() % 25);
+		}
+
+	for ( int i = 0; i < 100; ++i )
+		{
+		uint32_t a[4] = { htonl(0x20010db8), htonl(rng() & 0x000f0000), 0, htonl(rng()) };
+		prefixes.emplace_back(IPAddr(IPv6, a, IPAddr::Network), 33 + rng() % (max_v6_width - 32));
+		}
+
+	for ( size_t i = 0; i < prefixes.size(); ++i )
+		pt.Insert(prefixes[i].Prefix(), prefixes[i].LengthIPv6(), reinterpret_cast<void*>(i + 1));
+
+	std::vector<IPAddr> addrs;
+
+	for ( int i = 0; i < 1000; ++i )
+		{
+		uint32_t a = htonl(rng() & 0x0b0f0fff);
+		addrs.emplace_back(IPv4, &a, IPAddr::Network);
+		}
+
+	for ( int i = 0; i < 1000; ++i )
+		{
+		uint32_t a[4] = { htonl(0x20010db8 ^ (rng() & 1)), htonl(rng() & 0x000f0000), 0, htonl(rng()) };
+		addrs.emplace_back(IPv6, a, IPAddr::Network);
+		}
+
+	auto check = [&]()
+		{
+		int mismatches = 0;
+
+		for ( const auto& addr : addrs )
+			{
+			// Later insertions of the same prefix replace earlier ones.
+			void* expected = nullptr;
+			int best = -1;
+
+			for ( size_t i = 0; i < prefixes.size(); ++i )
+				if ( prefixes[i].LengthIPv6() >= best && prefixes[i].Contains(addr) &&
+				     pt.Lookup(prefixes[i].Prefix(), prefixes[i].LengthIPv6(), true) )
+					{
+					best = prefixes[i].LengthIPv6();
+					expected = reinterpret_cast<void*>(i + 1);
+					}
+
+			if ( pt.Lookup(addr, 128) != expected )
+				++mismatches;
+			}
+
+		CHECK(mismatches == 0);
+		};
+
+	// The first rounds also switch over from the tree to the trie.
+	check();
+	check();
+
+	for ( size_t i = 0; i < prefixes.size(); i += 3 )
+		pt.Remove(prefixes[i].Prefix(), prefixes[i].LengthIPv6());
+
+	for ( size_t i = 0; i < prefixes.size(); i += 3 )
+		prefixes[i] = IPPrefix(IPAddr("::"), 128);
+
+	check();
+	check();
+	}
+
+TEST_CASE("prefix table trie memory")
+	{
+	PrefixTable pt;
+	std::mt19937 rng(1);
+
+	for ( int i = 0; i < 1000; ++i )
+		{
+		uint32_t a[4] = { htonl(0x20010db8), htonl(rng()), htonl(rng()), htonl(rng()) };
+		pt.Insert(IPAddr(IPv6, a, IPAddr::Network), 128, reinterpret_cast<void*>(i + 1));
+		}
+
+	size_t tree_only = pt.MemoryAllocation();
+	uint32_t a[4] = { htonl(0x20010db8), 0, 0, 0 };
+	IPAddr addr(IPv6, a, IPAddr::Network);
+
+	// Enough lookups to build the trie, which mustn't take up a chain of
+	// levels per /128.
+	for ( int i = 0; i < 5000; ++i )
+		pt.Lookup(addr, 128);
+
+	CHECK(pt.Lookup(addr, 128) == nullptr);
+
+	CHECK(pt.MemoryAllocation() > tree_only);
+	CHECK(pt.MemoryAllocation() < 2 * tree_only);
+	}
+
+TEST_SUITE_END();
+
 } // namespace zeek::detail
@@ -6,6 +6,8 @@ extern "C" {
 
 #include <tuple>
 #include <list>
+#include <memory>
+#include <vector>
 
 #include "zeek/IPAddr.h"
 
@@ -16,6 +18,95 @@ class SubNetVal;
 
 namespace detail {
 
+/**
+ * A read-only copy of a prefix table's prefixes, laid out for fast
+ * longest-prefix matches of single addresses. Each address family gets a
+ * multibit trie that consumes 16 bits at its root and 4 bits on each level
+ * below. Every prefix is expanded into all the slots it covers, so that a
+ * lookup reads a single slot per level rather than following a node per
+ * bit, and a level's slots share a cache line.
+ *
+ * Without path compression, each long prefix can need a chain of levels of
+ * its own. The trie therefore covers IPv6 only if no IPv6 prefix is longer
+ * than MAX_V6_WIDTH, and Limit() can drop an address family that still
+ * takes too much memory. Lookups for a family the trie doesn't cover need
+ * to go elsewhere.
+ */
+class PrefixTrie {
+public:
+	/**
+	 * Adds a prefix. Prefixes must be added in order of increasing
+	 * width, so that longer ones take precedence.
+	 *
+	 * @param prefix The prefix's IPv6 address in network byte order.
+	 *
+	 * @param width The prefix's width in IPv6 terms.
+	 *
+	 * @param data The data to return for matching addresses.
+	 */
+	void Insert(const uint32_t* prefix, int width, void* data);
+
+	/**
+	 * Stops covering the address families whose levels below the root
+	 * take more than the given number of bytes per prefix.
+	 */
+	void Limit(size_t bytes_per_prefix);
+
+	/**
+	 * Looks up the longest prefix containing the address.
+	 *
+	 * @param result Set to the prefix's data, or null if there's none.
+	 *
+	 * @return False if the trie doesn't cover the address's family, in
+	 * which case \a result remains unset.
+	 */
+	bool Lookup(const IPAddr& addr, void** result) const;
+
+	/**
+	 * Returns the number of bytes allocated for the trie.
+	 */
+	size_t MemoryAllocation() const;
+
+	// The longest IPv6 prefix the trie handles.
+	static constexpr int MAX_V6_WIDTH = 64;
+
+private:
+	class Trie {
+	public:
+		// Key and prefix are in host byte order, len may be zero.
+		void Insert(const uint32_t* key, int len, uint32_t result);
+		uint32_t Lookup(const uint32_t* key) const;
+
+		// Frees the slots and ignores all further insertions.
+		void Disable();
+		bool Enabled() const	{ return enabled; }
+
+		// Bytes taken by the levels below the root, per prefix.
+		size_t BytesPerPrefix() const;
+
+		size_t MemoryAllocation() const
+			{ return slots.capacity() * sizeof(uint32_t); }
+
+	private:
+		// A slot either holds an index into the results, with zero
+		// meaning no match, or, with CHILD set, the offset of the
+		// next level's node.
+		static constexpr uint32_t CHILD = 0x80000000;
+		static constexpr int ROOT_BITS = 16;
+		static constexpr int NODE_BITS = 4;
+
+		std::vector<uint32_t> slots;
+		size_t num_prefixes = 0;
+		bool enabled = true;
+	};
+
+	// IPv4 addresses get a trie of their own over the last 32 bits,
+	// rather than walking the IPv4-mapped prefix every time.
+	Trie v4;
+	Trie v6;
+	std::vector<void*> results{nullptr};
+};
+
 class PrefixTable {
 private:
 	struct iterator {
@@ -51,7 +142,11 @@ public:
 	void* Remove(const IPAddr& addr, int width);
 	void* Remove(const Val* value);
 
-	void Clear()	{ Clear_Patricia(tree, delete_function); }
+	void Clear()	{ Clear_Patricia(tree, delete_function); Modified(); }
+
+	// Returns the number of bytes allocated for the tree's nodes and,
+	// if built, the trie.
+	size_t MemoryAllocation() const;
 
 	// Sets a function to call for each node when table is cleared/destroyed.
 	void SetDeleteFunction(data_fn_t del_fn)	{ delete_function = del_fn; }
@@ -63,8 +158,28 @@ private:
 	static prefix_t* MakePrefix(const IPAddr& addr, int width);
 	static IPPrefix PrefixToIPPrefix(prefix_t* p);
 
+	// Drops the trie after the table has changed.
+	void Modified()	{ trie.reset(); lookups_since_change = 0; }
+
+	// Builds the trie from the table's current prefixes.
+	void BuildTrie() const;
+
+	static constexpr int TRIE_MIN_NODES = 256;
+
+	// A trie's levels below the root may take up to this many times the
+	// memory of the tree's nodes for the same prefixes.
+	static constexpr size_t TRIE_MAX_GROWTH = 4;
+
 	patricia_tree_t* tree;
 	data_fn_t delete_function;
+
+	// Address lookups go through a trie once a table is large enough
+	// and has been stable for a while: it gets built after as many
+	// lookups as the table has nodes, with no changes in between, so
+	// that tables filled in bulk get built once rather than on every
+	// insertion.
+	mutable std::unique_ptr<PrefixTrie> trie;
+	mutable uint64_t lookups_since_change = 0;
 };
 
 } // namespace detail
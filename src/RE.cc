@@ -4,6 +4,8 @@
 #include "zeek/RE.h"
 
 #include <stdlib.h>
+#include <algorithm>
+#include <cstring>
 #include <utility>
 
 #include "zeek/DFA.h"
@@ -11,6 +13,7 @@
 #include "zeek/EquivClass.h"
 #include "zeek/Reporter.h"
 #include "zeek/ZeekString.h"
+#include "zeek/3rdparty/doctest.h"
 
 zeek::detail::CCL* zeek::detail::curr_ccl = nullptr;
 zeek::detail::Specific_RE_Matcher* zeek::detail::rem = nullptr;
@@ -310,8 +313,7 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as,
 		accepted_matches.insert(am_idx(*it, position));
 	}
 
-bool RE_Match_State::Match(const u_char* bv, int n,
-				bool bol, bool eol, bool clear)
+bool RE_Match_State::Begin(bool clear)
 	{
 	if ( current_pos == -1 )
 		{
@@ -336,41 +338,168 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 		return false;
 
 	current_pos = 0;
+	return true;
+	}
+
+inline void RE_Match_State::Step(int ec)
+	{
+	DFA_State* next_state = current_state->Xtion(ec,dfa);
+
+	if ( ! next_state )
+		{
+		current_state = nullptr;
+		return;
+		}
+
+	const AcceptingSet* ac = next_state->Accept();
+
+	if ( ac )
+		AddMatches(*ac, current_pos);
+
+	++current_pos;
+
+	current_state = next_state;
+	}
+
+int RE_Match_State::Feed(const u_char* bv, int n, bool stop_when_idle)
+	{
+	for ( int i = 0; i < n && current_state; ++i )
+		{
+		DFA_State* prev_state = current_state;
+
+		Step(ecs[bv[i]]);
+
+		// Every byte consumed in an accepting state records a
+		// match at its position, so those can't be skipped.
+		if ( stop_when_idle && current_state == prev_state &&
+		     ! current_state->Accept() && current_state->LoopingBytes(dfa) )
+			return i + 1;
+		}
+
+	return n;
+	}
+
+void RE_Match_State::End(bool eol)
+	{
+	if ( eol && current_state )
+		Step(ecs[SYM_EOL]);
+	}
+
+bool RE_Match_State::Match(const u_char* bv, int n,
+				bool bol, bool eol, bool clear)
+	{
+	if ( ! Begin(clear) )
+		return false;
 
 	size_t old_matches = accepted_matches.size();
 
-	int ec;
-	int m = bol ? n + 1 : n;
-	int e = eol ? -1 : 0;
+	if ( bol )
+		Step(ecs[SYM_BOL]);
+
+	Feed(bv, n, false);
+	End(eol);
+
+	return accepted_matches.size() != old_matches;
+	}
+
+bool RE_Match_Batch::Match(const u_char* bv, int n,
+				bool bol, bool eol, bool clear)
+	{
+	if ( unbatched_chunks > 0 )
+		{
+		--unbatched_chunks;
+
+		bool new_match = false;
 
-	while ( --m >= e )
+		for ( auto s : states )
+			if ( s->Match(bv, n, bol, eol, clear) )
+				new_match = true;
+
+		return new_match;
+		}
+
+	size_t old_matches = 0;
+	size_t new_matches = 0;
+	resumed = 0;
+
+	for ( auto s : states )
 		{
-		if ( m == n )
-			ec = ecs[SYM_BOL];
-		else if ( m == -1 )
-			ec = ecs[SYM_EOL];
-		else
-			ec = ecs[*(bv++)];
+		bool begun = s->Begin(clear);
+		old_matches += s->accepted_matches.size();
+
+		if ( ! begun )
+			continue;
 
-		DFA_State* next_state = current_state->Xtion(ec,dfa);
+		if ( bol )
+			s->Step(s->ecs[SYM_BOL]);
 
-		if ( ! next_state )
+		Resume(s, bv, n, 0);
+		}
+
+	for ( int i = 0; i < n && ! parked.empty(); ++i )
+		{
+		if ( ! stop_bytes[bv[i]] )
+			continue;
+
+		for ( size_t j = 0; j < parked.size(); )
 			{
-			current_state = nullptr;
-			break;
+			auto p = parked[j];
+
+			if ( p.pos > i || p.looping_bytes[bv[i]] )
+				{
+				++j;
+				continue;
+				}
+
+			// The state looped on everything up to here.
+			p.state->current_pos += i - p.pos;
+			++resumed;
+
+			parked[j] = parked.back();
+			parked.pop_back();
+
+			Resume(p.state, bv, n, i);
 			}
+		}
 
-		const AcceptingSet* ac = next_state->Accept();
+	for ( const auto& p : parked )
+		p.state->current_pos += n - p.pos;
 
-		if ( ac )
-			AddMatches(*ac, current_pos);
+	parked.clear();
 
-		++current_pos;
+	// If the DFAs keep leaving their looping states, stepping each of
+	// them through the input is cheaper. Do that for a while then.
+	if ( resumed * UNBATCHED_RATIO > static_cast<uint64_t>(n) * states.size() )
+		unbatched_chunks = UNBATCHED_CHUNKS;
 
-		current_state = next_state;
+	for ( auto s : states )
+		{
+		s->End(eol);
+		new_matches += s->accepted_matches.size();
 		}
 
-	return accepted_matches.size() != old_matches;
+	return new_matches != old_matches;
+	}
+
+void RE_Match_Batch::Resume(RE_Match_State* s, const u_char* bv, int n, int pos)
+	{
+	pos += s->Feed(bv + pos, n - pos, true);
+
+	if ( pos >= n || ! s->current_state )
+		return;
+
+	auto looping_bytes = s->current_state->LoopingBytes(s->dfa);
+	parked.push_back({s, pos, looping_bytes});
+
+	if ( std::find(seen_looping_bytes.begin(), seen_looping_bytes.end(),
+	               looping_bytes) != seen_looping_bytes.end() )
+		return;
+
+	seen_looping_bytes.push_back(looping_bytes);
+
+	for ( int c = 0; c < 256; ++c )
+		if ( ! looping_bytes[c] )
+			stop_bytes[c] = 1;
 	}
 
 int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
@@ -471,6 +600,66 @@ RE_Matcher* RE_Matcher_disjunction(const RE_Matcher* re1, const RE_Matcher* re2)
 	return matcher_merge(re1, re2, "|");
 	}
 
+TEST_SUITE_BEGIN("RE");
+
+TEST_CASE("batched matching agrees with separate matching")
+	{
+	const char* patterns[] = { ".*foo", ".*bar.*", "GET", ".*x.*y" };
+	Specific_RE_Matcher m1(MATCH_ANYWHERE);
+	Specific_RE_Matcher m2(MATCH_ANYWHERE);
+	string_list p1, p2;
+	int_list i1, i2;
+
+	p1.push_back(util::copy_string(patterns[0]));
+	p1.push_back(util::copy_string(patterns[1]));
+	i1.push_back(1);
+	i1.push_back(2);
+	p2.push_back(util::copy_string(patterns[2]));
+	p2.push_back(util::copy_string(patterns[3]));
+	i2.push_back(3);
+	i2.push_back(4);
+
+	REQUIRE(m1.CompileSet(p1, i1));
+	REQUIRE(m2.CompileSet(p2, i2));
+
+	RE_Match_State s1(&m1), s2(&m2);
+	RE_Match_State b1(&m1), b2(&m2);
+	RE_Match_Batch batch;
+	batch.Add(&b1);
+	batch.Add(&b2);
+
+	// Patterns that complete across chunks, with stretches of input in
+	// between that don't get any of them going.
+	const char* chunks[] = { "GETzzzzzzzzbarzzzzzz fo", "o zzzzzzzzzz x zzzz", "zzzzz y", "" };
+
+	for ( size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i )
+		{
+		auto data = reinterpret_cast<const u_char*>(chunks[i]);
+		int len = strlen(chunks[i]);
+		bool bol = i == 0;
+		bool eol = i == 3;
+		bool separate = s1.Match(data, len, bol, eol, false);
+		separate = s2.Match(data, len, bol, eol, false) || separate;
+
+		CHECK(batch.Match(data, len, bol, eol, false) == separate);
+		CHECK(b1.AcceptedMatches() == s1.AcceptedMatches());
+		CHECK(b2.AcceptedMatches() == s2.AcceptedMatches());
+		CHECK(b1.Length() == s1.Length());
+		CHECK(b2.Length() == s2.Length());
+		}
+
+	// The trailing ".*" keeps matching at every byte after "bar".
+	CHECK(s1.AcceptedMatches().size() > 2);
+	CHECK(s2.AcceptedMatches().size() == 2);
+
+	for ( auto p : p1 )
+		delete [] p;
+	for ( auto p : p2 )
+		delete [] p;
+	}
+
+TEST_SUITE_END();
+
 } // namespace detail
 
 RE_Matcher::RE_Matcher()
@@ -7,6 +7,7 @@
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "zeek/List.h"
 #include "zeek/CCL.h"
@@ -173,6 +174,18 @@ public:
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
 protected:
+	friend class RE_Match_Batch;
+
+	// The steps of Match(). Begin() sets up the state for new input and
+	// returns false if there's no matching to do. Feed() consumes up to
+	// n bytes and returns how many it consumed; if stop_when_idle is
+	// true, it stops after a byte that left the DFA in a non-accepting
+	// state with looping bytes (see DFA_State::LoopingBytes()).
+	bool Begin(bool clear);
+	inline void Step(int ec);
+	int Feed(const u_char* bv, int n, bool stop_when_idle);
+	void End(bool eol);
+
 	DFA_Machine* dfa;
 	int* ecs;
 
@@ -181,6 +194,49 @@ protected:
 	int current_pos;
 };
 
+// Feeds the same input into a number of match states in a single pass
+// over it. Most of the time, a DFA sits in a state that it only leaves on
+// a few input bytes, such as the one waiting for the first byte of any of
+// its unanchored patterns. The batch parks DFAs in such states and scans
+// the input once for the bytes that make any of them move on, instead of
+// stepping each DFA through every byte.
+class RE_Match_Batch {
+public:
+	// The batch doesn't take ownership of the state.
+	void Add(RE_Match_State* state)	{ states.push_back(state); }
+
+	// Same as calling RE_Match_State::Match() on each of the states,
+	// returning true if any of them found a new match.
+	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
+
+private:
+	struct Parked {
+		RE_Match_State* state;
+		int pos;	// next byte the state hasn't consumed yet
+		const u_char* looping_bytes;
+	};
+
+	// Feeds a state the input from pos on, parking it if it ends up
+	// in a state with looping bytes before reaching the end.
+	void Resume(RE_Match_State* s, const u_char* bv, int n, int pos);
+
+	std::vector<RE_Match_State*> states;
+	std::vector<Parked> parked;
+
+	// The looping-byte tables that parked states have had so far, and
+	// the bytes that leave at least one of them.
+	std::vector<const u_char*> seen_looping_bytes;
+	u_char stop_bytes[256] = { 0 };
+
+	// Once more than one in UNBATCHED_RATIO bytes makes a parked state
+	// move on, the next UNBATCHED_CHUNKS chunks go through the states
+	// one by one.
+	static constexpr uint64_t UNBATCHED_RATIO = 32;
+	static constexpr int UNBATCHED_CHUNKS = 16;
+	uint64_t resumed = 0;
+	int unbatched_chunks = 0;
+};
+
 extern RE_Matcher* RE_Matcher_conjunction(const RE_Matcher* re1, const RE_Matcher* re2);
 extern RE_Matcher* RE_Matcher_disjunction(const RE_Matcher* re1, const RE_Matcher* re2);
 
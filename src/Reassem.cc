@@ -6,6 +6,9 @@
 #include <algorithm>
 
 #include "zeek/Desc.h"
+#include "zeek/NetVar.h"
+
+#include "zeek/3rdparty/doctest.h"
 
 using std::min;
 
@@ -13,13 +16,150 @@ namespace zeek {
 
 uint64_t Reassembler::total_size = 0;
 uint64_t Reassembler::sizes[REASSEM_NUM];
+Reassembler* Reassembler::oldest = nullptr;
+Reassembler* Reassembler::newest = nullptr;
+uint64_t Reassembler::num_buffering = 0;
+uint64_t Reassembler::num_evictions = 0;
+
+namespace detail {
+
+ReassemblyBufferPool::FreeChunk* ReassemblyBufferPool::free_lists[NUM_CLASSES];
+uint64_t ReassemblyBufferPool::cached_bytes[NUM_CLASSES];
+
+int ReassemblyBufferPool::SizeClass(uint64_t size)
+	{
+	int c = 0;
+
+	for ( uint64_t n = MIN_CHUNK_SIZE; n < size; n <<= 1 )
+		++c;
+
+	return c;
+	}
+
+u_char* ReassemblyBufferPool::Allocate(uint64_t size, uint64_t* capacity)
+	{
+	if ( size > MAX_CHUNK_SIZE )
+		{
+		*capacity = size;
+		return new u_char[size];
+		}
+
+	int c = SizeClass(size);
+	*capacity = MIN_CHUNK_SIZE << c;
+
+	if ( auto chunk = free_lists[c] )
+		{
+		free_lists[c] = chunk->next;
+		cached_bytes[c] -= *capacity;
+		return reinterpret_cast<u_char*>(chunk);
+		}
+
+	return new u_char[*capacity];
+	}
+
+void ReassemblyBufferPool::Free(u_char* chunk, uint64_t capacity)
+	{
+	if ( ! chunk )
+		return;
+
+	if ( capacity > MAX_CHUNK_SIZE )
+		{
+		delete [] chunk;
+		return;
+		}
+
+	int c = SizeClass(capacity);
+
+	if ( cached_bytes[c] + capacity > MAX_CACHED_BYTES )
+		{
+		delete [] chunk;
+		return;
+		}
+
+	auto fc = reinterpret_cast<FreeChunk*>(chunk);
+	fc->next = free_lists[c];
+	free_lists[c] = fc;
+	cached_bytes[c] += capacity;
+	}
+
+uint64_t ReassemblyBufferPool::CachedBytes()
+	{
+	uint64_t total = 0;
+
+	for ( auto n : cached_bytes )
+		total += n;
+
+	return total;
+	}
+
+void ReassemblyBufferPool::Clear()
+	{
+	for ( int c = 0; c < NUM_CLASSES; ++c )
+		{
+		while ( auto fc = free_lists[c] )
+			{
+			free_lists[c] = fc->next;
+			delete [] reinterpret_cast<u_char*>(fc);
+			}
+
+		cached_bytes[c] = 0;
+		}
+	}
+
+void DataBlockClaim::Revoked()
+	{
+	owner->BufferRevoked();
+	}
+
+} // namespace detail
 
 DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq)
 	{
 	seq = arg_seq;
 	upper = seq + size;
-	block = new u_char[size];
+
+	if ( auto buffer = iosource::PacketBuffer::Covering(data, size) )
+		{
+		claim = new detail::DataBlockClaim(buffer.get(), this);
+		block = const_cast<u_char*>(data);
+		return;
+		}
+
+	block = detail::ReassemblyBufferPool::Allocate(size, &capacity);
+	memcpy(block, data, size);
+	}
+
+void DataBlock::Extend(const u_char* data, uint64_t size)
+	{
+	assert(! claim);
+
+	auto old_size = Size();
+	auto new_size = old_size + size;
+
+	if ( new_size > capacity )
+		{
+		uint64_t new_capacity;
+		auto new_block = detail::ReassemblyBufferPool::Allocate(new_size, &new_capacity);
+		memcpy(new_block, block, old_size);
+		detail::ReassemblyBufferPool::Free(block, capacity);
+		block = new_block;
+		capacity = new_capacity;
+		}
+
+	memcpy(block + old_size, data, size);
+	upper += size;
+	}
+
+void DataBlock::BufferRevoked()
+	{
+	auto size = Size();
+	auto data = block;
+
+	block = detail::ReassemblyBufferPool::Allocate(size, &capacity);
 	memcpy(block, data, size);
+
+	delete claim;
+	claim = nullptr;
 	}
 
 void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* above) const
@@ -53,6 +193,9 @@ void DataBlockList::Delete(DataBlockMap::const_iterator it)
 
 	Reassembler::total_size -= size + sizeof(DataBlock);
 	Reassembler::sizes[reassembler->rtype] -= size + sizeof(DataBlock);
+
+	if ( block_map.empty() )
+		reassembler->UpdateBuffering();
 	}
 
 DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it)
@@ -63,6 +206,9 @@ DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it)
 	block_map.erase(it);
 	total_data_size -= size;
 
+	if ( block_map.empty() )
+		reassembler->UpdateBuffering();
+
 	return b;
 	}
 
@@ -73,7 +219,12 @@ void DataBlockList::Clear()
 	Reassembler::total_size -= total;
 	Reassembler::sizes[reassembler->rtype] -= total;
 	total_data_size = 0;
+
+	if ( block_map.empty() )
+		return;
+
 	block_map.clear();
+	reassembler->UpdateBuffering();
 	}
 
 void DataBlockList::Append(DataBlock block, uint64_t limit)
@@ -82,6 +233,9 @@ void DataBlockList::Append(DataBlock block, uint64_t limit)
 
 	block_map.emplace_hint(block_map.end(), block.seq, std::move(block));
 
+	if ( block_map.size() == 1 )
+		reassembler->UpdateBuffering();
+
 	while ( block_map.size() > limit )
 		Delete(block_map.begin());
 	}
@@ -111,6 +265,9 @@ DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
 	Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
 	Reassembler::total_size += size + sizeof(DataBlock);
 
+	if ( block_map.size() == 1 )
+		reassembler->UpdateBuffering();
+
 	return rval;
 	}
 
@@ -126,7 +283,21 @@ DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
 
 	// Special check for the common case of appending to the end.
 	if ( seq == last.upper )
-		return Insert(seq, upper, data, block_map.end());
+		{
+		auto size = upper - seq;
+
+		if ( ! CanMerge(last, data, size) )
+			return Insert(seq, upper, data, block_map.end());
+
+		auto it = std::prev(block_map.end());
+		block_map.rbegin()->second.Extend(data, size);
+
+		total_data_size += size;
+		Reassembler::sizes[reassembler->rtype] += size;
+		Reassembler::total_size += size;
+
+		return it;
+		}
 
 	// Find the first block that doesn't come completely before the new data.
 	DataBlockMap::const_iterator it;
@@ -191,6 +362,20 @@ DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
 	return rval;
 	}
 
+bool DataBlockList::CanMerge(const DataBlock& last, const u_char* data, uint64_t size) const
+	{
+	if ( last.IsReference() || last.Size() + size > MAX_MERGED_BLOCK_SIZE )
+		return false;
+
+	// Subclasses deliver blocks starting at the reassembly point as a
+	// whole, so extending one that's already up for delivery would
+	// hide the new data from them.
+	if ( last.seq <= reassembler->LastReassemSeq() )
+		return false;
+
+	return ! iosource::PacketBuffer::Covers(data, size);
+	}
+
 uint64_t DataBlockList::Trim(uint64_t seq, uint64_t max_old,
                              DataBlockList* old_list)
 	{
@@ -273,6 +458,96 @@ Reassembler::Reassembler(uint64_t init_seq, ReassemblerType reassem_type)
 	{
 	}
 
+Reassembler::~Reassembler()
+	{
+	// Empty the lists while we're still intact, so that they don't
+	// call back into us from their destructors.
+	ClearBlocks();
+	ClearOldBlocks();
+	}
+
+void Reassembler::UpdateBuffering()
+	{
+	bool now_buffering = ! block_list.Empty() || ! old_block_list.Empty();
+
+	if ( now_buffering == buffering )
+		return;
+
+	buffering = now_buffering;
+
+	if ( buffering )
+		{
+		older = newest;
+		newer = nullptr;
+
+		if ( newest )
+			newest->newer = this;
+		else
+			oldest = this;
+
+		newest = this;
+		++num_buffering;
+		}
+	else
+		{
+		if ( older )
+			older->newer = newer;
+		else
+			oldest = newer;
+
+		if ( newer )
+			newer->older = older;
+		else
+			newest = older;
+
+		older = newer = nullptr;
+		--num_buffering;
+		}
+	}
+
+bool Reassembler::Evict()
+	{
+	ClearOldBlocks();
+
+	if ( block_list.Empty() )
+		return false;
+
+	bool hole = HasHole();
+
+	// Trim without keeping old blocks around, since the point is to
+	// free the memory. For data that's been delivered already, this
+	// is the same as having it acknowledged.
+	block_list.Trim(block_list.LastBlock().upper, 0, nullptr);
+
+	return hole;
+	}
+
+void Reassembler::EnforceMemoryLimit()
+	{
+	uint64_t limit = BifConst::reassembly_memory_limit;
+
+	if ( ! limit || total_size <= limit )
+		return;
+
+	// Go somewhat below the limit so that we don't end up evicting on
+	// every packet while under pressure.
+	uint64_t target = limit - limit / 8;
+
+	// Evicting delivers data, which may make other reassemblers start
+	// buffering. They queue up behind the current ones, so bounding the
+	// loop by the current number ensures it terminates.
+	//
+	// Evict() leaves the reassembler without buffered data, which takes
+	// it off the list. A fragment reassembler also removes itself from
+	// the fragment manager, which destroys it, so we don't touch the
+	// reassembler afterwards.
+	for ( auto n = num_buffering; n > 0 && oldest && total_size > target; --n )
+		{
+		if ( oldest->Evict() )
+			++num_evictions;
+		}
+	}
+
 void Reassembler::CheckOverlap(const DataBlockList& list,
                                uint64_t seq, uint64_t len,
                                const u_char* data)
@@ -387,4 +662,192 @@ uint64_t Reassembler::MemoryAllocation(ReassemblerType rtype)
 	return Reassembler::sizes[rtype];
 	}
 
+TEST_SUITE_BEGIN("Reassem");
+
+namespace {
+
+class TestReassembler final : public Reassembler {
+public:
+	TestReassembler() : Reassembler(0, REASSEM_UNKNOWN)
+		{}
+
+	const DataBlockList& Blocks() const	{ return block_list; }
+
+	// Pretends that everything up to seq got delivered.
+	void Deliver(uint64_t seq)	{ last_reassem_seq = seq; }
+
+	std::vector<uint64_t> inserted;
+
+protected:
+	void BlockInserted(DataBlockMap::const_iterator it) override
+		{ inserted.push_back(it->second.seq); }
+
+	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override
+		{}
+};
+
+}
+
+TEST_CASE("reassembly buffer pool")
+	{
+	detail::ReassemblyBufferPool::Clear();
+
+	uint64_t cap;
+	auto p = detail::ReassemblyBufferPool::Allocate(1, &cap);
+	CHECK(cap == detail::ReassemblyBufferPool::MIN_CHUNK_SIZE);
+	detail::ReassemblyBufferPool::Free(p, cap);
+	CHECK(detail::ReassemblyBufferPool::CachedBytes() == cap);
+
+	p = detail::ReassemblyBufferPool::Allocate(1460, &cap);
+	CHECK(cap == 2048);
+	detail::ReassemblyBufferPool::Free(p, cap);
+
+	// Released chunks of the same class get reused.
+	auto q = detail::ReassemblyBufferPool::Allocate(1500, &cap);
+	CHECK(q == p);
+	detail::ReassemblyBufferPool::Free(q, cap);
+
+	// Oversized requests bypass the pool.
+	auto cached = detail::ReassemblyBufferPool::CachedBytes();
+	p = detail::ReassemblyBufferPool::Allocate(100000, &cap);
+	CHECK(cap == 100000);
+	detail::ReassemblyBufferPool::Free(p, cap);
+	CHECK(detail::ReassemblyBufferPool::CachedBytes() == cached);
+
+	detail::ReassemblyBufferPool::Clear();
+	CHECK(detail::ReassemblyBufferPool::CachedBytes() == 0);
+	}
+
+TEST_CASE("reassembler merges data queued behind a hole")
+	{
+	TestReassembler r;
+	u_char data[3000];
+
+	for ( size_t i = 0; i < sizeof(data); ++i )
+		data[i] = static_cast<u_char>(i);
+
+	// Leave a hole at the start, then add contiguous segments after it.
+	r.NewBlock(0, 100, 1000, data + 100);
+	r.NewBlock(0, 1100, 1000, data + 1100);
+	r.NewBlock(0, 2100, 900, data + 2100);
+
+	CHECK(r.Blocks().NumBlocks() == 1);
+	CHECK(r.Blocks().DataSize() == 2900);
+	CHECK(r.Blocks().FirstBlock().seq == 100);
+	CHECK(r.Blocks().FirstBlock().upper == 3000);
+	CHECK(memcmp(r.Blocks().FirstBlock().block, data + 100, 2900) == 0);
+
+	// Filling the hole gets its own block since it comes first.
+	r.NewBlock(0, 0, 100, data);
+	CHECK(r.Blocks().NumBlocks() == 2);
+	CHECK(r.Blocks().DataSize() == 3000);
+	CHECK((r.inserted == std::vector<uint64_t>{100, 100, 100, 0}));
+
+	// Anything at or before the reassembly point doesn't get merged.
+	TestReassembler r2;
+	r2.NewBlock(0, 0, 100, data);
+	r2.NewBlock(0, 100, 100, data + 100);
+	CHECK(r2.Blocks().NumBlocks() == 2);
+	}
+
+TEST_CASE("reassembler memory limit evicts oldest first")
+	{
+	auto saved_limit = BifConst::reassembly_memory_limit;
+	auto evictions = Reassembler::NumEvictions();
+	u_char data[1000] = { 0 };
+
+	TestReassembler r1;
+	TestReassembler r2;
+
+	// Both wait on a hole at the start.
+	r1.NewBlock(0, 100, sizeof(data), data);
+	r2.NewBlock(0, 100, sizeof(data), data);
+
+	BifConst::reassembly_memory_limit = 0;
+	Reassembler::EnforceMemoryLimit();
+	CHECK(r1.HasBlocks());
+	CHECK(r2.HasBlocks());
+
+	BifConst::reassembly_memory_limit = Reassembler::TotalMemoryAllocation() - 1;
+	Reassembler::EnforceMemoryLimit();
+	CHECK(! r1.HasBlocks());
+	CHECK(r1.LastReassemSeq() == 100 + sizeof(data));
+	CHECK(r2.HasBlocks());
+	CHECK(Reassembler::NumEvictions() == evictions + 1);
+
+	// Buffering again puts r1 behind r2.
+	r1.NewBlock(0, 2000, sizeof(data), data);
+	Reassembler::EnforceMemoryLimit();
+	CHECK(r1.HasBlocks());
+	CHECK(! r2.HasBlocks());
+	CHECK(Reassembler::NumEvictions() == evictions + 2);
+
+	BifConst::reassembly_memory_limit = saved_limit;
+	}
+
+TEST_CASE("reassembler memory limit doesn't count delivered data as eviction")
+	{
+	auto saved_limit = BifConst::reassembly_memory_limit;
+	auto evictions = Reassembler::NumEvictions();
+	u_char data[1000] = { 0 };
+
+	// Delivered but still buffered, like unacknowledged TCP data.
+	TestReassembler r;
+	r.NewBlock(0, 0, sizeof(data), data);
+	r.Deliver(sizeof(data));
+
+	BifConst::reassembly_memory_limit = 1;
+	Reassembler::EnforceMemoryLimit();
+	CHECK(! r.HasBlocks());
+	CHECK(r.LastReassemSeq() == sizeof(data));
+	CHECK(Reassembler::NumEvictions() == evictions);
+
+	BifConst::reassembly_memory_limit = saved_limit;
+	}
+
+TEST_CASE("data blocks copy out revoked packet buffers")
+	{
+	class TestBuffer final : public iosource::PacketBuffer {
+	public:
+		TestBuffer(const u_char* data, uint64_t size)
+			: PacketBuffer(data, size, 1)
+			{}
+
+		bool released = false;
+
+	protected:
+		void Released() override	{ released = true; }
+	};
+
+	u_char data[200];
+	memset(data, 'a', sizeof(data));
+
+	TestBuffer buf(data, sizeof(data));
+	TestReassembler r;
+
+	// Data behind a hole refers to the packet's buffer.
+	iosource::PacketBuffer::SetCurrent(&buf);
+	r.NewBlock(0, 100, 100, data + 100);
+	iosource::PacketBuffer::SetCurrent(nullptr);
+
+	REQUIRE(r.Blocks().NumBlocks() == 1);
+	CHECK(r.Blocks().FirstBlock().IsReference());
+	CHECK(buf.RefCount() == 2);
+
+	buf.RevokeClaims();
+	CHECK(buf.RefCount() == 1);
+	CHECK(! r.Blocks().FirstBlock().IsReference());
+
+	// The source may now reuse the memory.
+	memset(data, 'b', sizeof(data));
+	CHECK(r.Blocks().FirstBlock().block != data + 100);
+	CHECK(r.Blocks().FirstBlock().block[0] == 'a');
+	CHECK(r.Blocks().FirstBlock().block[99] == 'a');
+
+	Unref(&buf);
+	CHECK(buf.released);
+	}
+
+TEST_SUITE_END();
+
 } // namespace zeek
@@ -9,6 +9,7 @@
 #include <map>
 
 #include "zeek/Obj.h"
+#include "zeek/iosource/PacketBuffer.h"
 
 namespace zeek {
 
@@ -24,8 +25,84 @@ enum ReassemblerType {
 	REASSEM_NUM,
 };
 
+class DataBlock;
 class Reassembler;
 
+namespace detail {
+
+/**
+ * A data block's claim on the packet buffer its data lives in. Should the
+ * packet source need the buffer back, the block switches over to a copy.
+ */
+class DataBlockClaim final : public iosource::PacketBufferClaim {
+public:
+	DataBlockClaim(iosource::PacketBuffer* buf, DataBlock* arg_owner)
+		: PacketBufferClaim(buf), owner(arg_owner)
+		{}
+
+	// Kept up to date as the block moves.
+	DataBlock* owner;
+
+protected:
+	void Revoked() override;
+};
+
+/**
+ * A pool for the memory of data blocks that own a copy of their data.
+ * Chunks come in power-of-two size classes. Released chunks go onto a
+ * free list for their class and get handed out again by later
+ * allocations, so that buffering segments doesn't go through malloc for
+ * each of them. Each class keeps at most MAX_CACHED_BYTES on its free
+ * list; beyond that, released chunks are returned to the system.
+ */
+class ReassemblyBufferPool {
+public:
+	static constexpr uint64_t MIN_CHUNK_SIZE = 64;
+	static constexpr uint64_t MAX_CHUNK_SIZE = 64 * 1024;
+	static constexpr uint64_t MAX_CACHED_BYTES = 1024 * 1024;
+
+	/**
+	 * Returns a chunk of memory for at least the given number of bytes.
+	 * Requests larger than MAX_CHUNK_SIZE are served directly from the
+	 * heap.
+	 *
+	 * @param size The number of bytes needed.
+	 *
+	 * @param capacity Returns the actual size of the chunk, which needs
+	 * to be passed to Free() later.
+	 */
+	static u_char* Allocate(uint64_t size, uint64_t* capacity);
+
+	/**
+	 * Releases a chunk obtained from Allocate(). Null is ignored.
+	 */
+	static void Free(u_char* chunk, uint64_t capacity);
+
+	/**
+	 * @return the number of bytes currently held on the free lists.
+	 */
+	static uint64_t CachedBytes();
+
+	/**
+	 * Returns all memory held on the free lists to the system.
+	 */
+	static void Clear();
+
+private:
+	struct FreeChunk {
+		FreeChunk* next;
+	};
+
+	static constexpr int NUM_CLASSES = 11; // 64 bytes to 64 KB
+
+	static int SizeClass(uint64_t size);
+
+	static FreeChunk* free_lists[NUM_CLASSES];
+	static uint64_t cached_bytes[NUM_CLASSES];
+};
+
+} // namespace detail
+
 /**
  * A block/segment of data for use in the reassembly process.
  */
@@ -34,6 +111,10 @@ public:
 
 	/**
 	 * Create a data block/segment with associated sequence numbering.
+	 * If the data lies within the buffer of the packet currently being
+	 * processed and that buffer supports references, the block refers
+	 * to the packet's data instead of copying it. Copies go into memory
+	 * from the ReassemblyBufferPool.
 	 */
 	DataBlock(const u_char* data, uint64_t size, uint64_t seq);
 
@@ -41,9 +122,7 @@ public:
 		{
 		seq = other.seq;
 		upper = other.upper;
-		auto size = other.Size();
-		block = new u_char[size];
-		memcpy(block, other.block, size);
+		CopyFrom(other);
 		}
 
 	DataBlock(DataBlock&& other)
@@ -51,7 +130,10 @@ public:
 		seq = other.seq;
 		upper = other.upper;
 		block = other.block;
+		capacity = other.capacity;
+		TakeClaim(other);
 		other.block = nullptr;
+		other.capacity = 0;
 		}
 
 	DataBlock& operator=(const DataBlock& other)
@@ -61,10 +143,8 @@ public:
 
 		seq = other.seq;
 		upper = other.upper;
-		auto size = other.Size();
-		delete [] block;
-		block = new u_char[size];
-		memcpy(block, other.block, size);
+		ReleaseBlock();
+		CopyFrom(other);
 		return *this;
 		}
 
@@ -75,14 +155,17 @@ public:
 
 		seq = other.seq;
 		upper = other.upper;
-		delete [] block;
+		ReleaseBlock();
 		block = other.block;
+		capacity = other.capacity;
+		TakeClaim(other);
 		other.block = nullptr;
+		other.capacity = 0;
 		return *this;
 		}
 
 	~DataBlock()
-		{ delete [] block; }
+		{ ReleaseBlock(); }
 
 	/**
 	 * @return length of the data block
@@ -90,9 +173,76 @@ public:
 	uint64_t Size() const
 		{ return upper - seq; }
 
+	/**
+	 * @return whether the block refers to packet data rather than owning
+	 * a copy of it
+	 */
+	bool IsReference() const
+		{ return claim != nullptr; }
+
+	/**
+	 * Appends data that directly follows the end of the block, growing
+	 * its memory if needed. Must not be called for references.
+	 * @param data  points to the data to append
+	 * @param size  the number of bytes to append
+	 */
+	void Extend(const u_char* data, uint64_t size);
+
 	uint64_t seq;
 	uint64_t upper;
 	u_char* block;
+
+private:
+	friend class detail::DataBlockClaim;
+
+	void CopyFrom(const DataBlock& other)
+		{
+		if ( other.claim )
+			{
+			// Sharing the buffer is as good as a copy.
+			claim = new detail::DataBlockClaim(other.claim->Buffer(), this);
+			block = other.block;
+			return;
+			}
+
+		auto size = other.Size();
+		block = detail::ReassemblyBufferPool::Allocate(size, &capacity);
+		memcpy(block, other.block, size);
+		}
+
+	void TakeClaim(DataBlock& other)
+		{
+		claim = other.claim;
+		other.claim = nullptr;
+
+		if ( claim )
+			claim->owner = this;
+		}
+
+	// Switches the block over to a copy of its data, called when the
+	// packet buffer it refers to gets revoked.
+	void BufferRevoked();
+
+	void ReleaseBlock()
+		{
+		if ( claim )
+			{
+			delete claim;
+			claim = nullptr;
+			}
+		else
+			detail::ReassemblyBufferPool::Free(block, capacity);
+
+		block = nullptr;
+		capacity = 0;
+		}
+
+	// Size of the memory "block" points to if the block owns it.
+	uint64_t capacity = 0;
+
+	// The claim on the packet buffer that "block" points into, or null
+	// if "block" is owned by this instance.
+	detail::DataBlockClaim* claim = nullptr;
 };
 
 using DataBlockMap = std::map<uint64_t, DataBlock>;
@@ -100,11 +250,20 @@ using DataBlockMap = std::map<uint64_t, DataBlock>;
 
 /**
  * The data structure used for reassembling arbitrary sequences of data
- * blocks/segments.  It internally uses an ordered map (std::map).
+ * blocks/segments.  It internally uses an ordered map (std::map).  Data
+ * that directly follows the last block, while that block is still waiting
+ * on a hole before it, is merged into it rather than getting a block of
+ * its own, which avoids the map operations for the common case of
+ * in-order data queueing up behind a missing segment.
  */
 class DataBlockList {
 public:
 
+	/**
+	 * Blocks don't grow beyond this size through merging.
+	 */
+	static constexpr uint64_t MAX_MERGED_BLOCK_SIZE = 16 * 1024;
+
 	DataBlockList()
 		{ }
 
@@ -246,6 +405,17 @@ private:
 	 */
 	DataBlock Remove(DataBlockMap::const_iterator it);
 
+	/**
+	 * Returns whether data directly following the last block can be
+	 * merged into it.  That's the case if the block owns its memory, stays
+	 * within MAX_MERGED_BLOCK_SIZE, and hasn't been (partially) delivered
+	 * yet, and if the data can't be kept as a reference to its packet.
+	 * @param last  the last block of the list
+	 * @param data  points to the data to append
+	 * @param size  the number of bytes to append
+	 */
+	bool CanMerge(const DataBlock& last, const u_char* data, uint64_t size) const;
+
 	Reassembler* reassembler = nullptr;
 	size_t total_data_size = 0;
 	DataBlockMap block_map;
@@ -254,7 +424,7 @@ private:
 class Reassembler : public Obj {
 public:
 	Reassembler(uint64_t init_seq, ReassemblerType reassem_type = REASSEM_UNKNOWN);
-	~Reassembler() override	{}
+	~Reassembler() override;
 
 	void NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data);
 
@@ -289,10 +459,48 @@ public:
 
 	void SetMaxOldBlocks(uint32_t count)	{ max_old_blocks = count; }
 
+	/**
+	 * Evicts buffered data if all reassemblers together exceed the
+	 * limit set by \a reassembly_memory_limit.  Reassemblers are evicted
+	 * in the order in which they started buffering, oldest first, until
+	 * usage drops to 7/8 of the limit.
+	 */
+	static void EnforceMemoryLimit();
+
+	/**
+	 * @return the number of times EnforceMemoryLimit() had to give up on
+	 * data still waiting for a hole to get filled.
+	 */
+	static uint64_t NumEvictions()	{ return num_evictions; }
+
 protected:
 
 	friend class DataBlockList;
 
+	/**
+	 * Gives up on all buffered data because the global memory limit
+	 * has been reached.  The default implementation drops the old
+	 * blocks and trims up to the end of the last block, which treats
+	 * the holes as undelivered.  Subclasses extend this to report the
+	 * eviction, which they should only do if HasHole() is true.  They
+	 * must not keep any data buffered.  They may destroy the reassembler
+	 * as long as they don't touch it afterwards, but delivering the data
+	 * must not make its owner delete it: events only get queued, and TCP
+	 * endpoints and files let go of their reassemblers only when they are
+	 * destroyed themselves or scripts ask for it.
+	 *
+	 * @return true if undelivered data had to be given up, false if
+	 * only already delivered data got dropped.
+	 */
+	virtual bool Evict();
+
+	/**
+	 * @return true if some of the buffered data is waiting for a hole
+	 * before it to get filled.
+	 */
+	bool HasHole() const
+		{ return ! block_list.Empty() && block_list.LastBlock().upper > last_reassem_seq; }
+
 	virtual void Undelivered(uint64_t up_to_seq);
 
 	virtual void BlockInserted(DataBlockMap::const_iterator it) = 0;
@@ -312,6 +520,21 @@ protected:
 
 	static uint64_t total_size;
 	static uint64_t sizes[REASSEM_NUM];
+
+private:
+	// Called by the block lists when they become empty or non-empty.
+	void UpdateBuffering();
+
+	// Reassemblers currently holding data form a list ordered by when
+	// they started buffering, which EnforceMemoryLimit() evicts from.
+	bool buffering = false;
+	Reassembler* older = nullptr;
+	Reassembler* newer = nullptr;
+
+	static Reassembler* oldest;
+	static Reassembler* newest;
+	static uint64_t num_buffering;
+	static uint64_t num_evictions;
 };
 
 } // namespace zeek
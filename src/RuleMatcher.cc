@@ -783,6 +783,13 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer,
 					m->state = new RE_Match_State(set->re);
 					m->type = (Rule::PatternType) i;
 					state->matchers.push_back(m);
+
+					auto& batch = state->match_batches[i];
+
+					if ( ! batch )
+						batch = std::make_unique<RE_Match_Batch>();
+
+					batch->Add(m->state);
 					}
 				}
 			}
@@ -892,13 +899,23 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 		}
 
 	// Feed data into all relevant matchers.
-	for ( const auto& m : state->matchers )
+	if ( sig_batch_matching )
 		{
-		if ( m->type == type &&
-		     m->state->Match((const u_char*) data, data_len,
-					bol, eol, clear) )
+		const auto& batch = state->match_batches[type];
+
+		if ( batch && batch->Match((const u_char*) data, data_len, bol, eol, clear) )
 			newmatch = true;
 		}
+	else
+		{
+		for ( const auto& m : state->matchers )
+			{
+			if ( m->type == type &&
+			     m->state->Match((const u_char*) data, data_len,
+						bol, eol, clear) )
+				newmatch = true;
+			}
+		}
 
 	// If no new match found, we're already done.
 	if ( ! newmatch )
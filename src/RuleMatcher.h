@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <functional>
 #include <set>
 #include <string>
@@ -178,6 +179,11 @@ private:
 	matcher_list matchers;
 	rule_hdr_test_list hdr_tests;
 
+	// The matchers' states, grouped by pattern type, to feed each
+	// chunk of data to all of a type's matchers in one pass. Only
+	// types that have matchers get a batch.
+	std::unique_ptr<RE_Match_Batch> match_batches[Rule::TYPES];
+
 	// The follow tracks which rules for which all patterns have matched,
 	// and in a parallel list the (first instance of the) corresponding
 	// matched text.
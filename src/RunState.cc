@@ -27,6 +27,8 @@ extern "C" {
 #include "zeek/session/Manager.h"
 #include "zeek/Event.h"
 #include "zeek/Timer.h"
+#include "zeek/Stats.h"
+#include "zeek/Reassem.h"
 #include "zeek/ID.h"
 #include "zeek/Reporter.h"
 #include "zeek/Scope.h"
@@ -238,7 +240,10 @@ void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
 	// network_time never goes back.
 	update_network_time(zeek::detail::timer_mgr->Time() < t ? t : zeek::detail::timer_mgr->Time());
 	processing_start_time = t;
+
+	uint64_t stage_start = zeek::detail::StageLatencies::Now();
 	expire_timers();
+	zeek::detail::StageLatencies::Record(zeek::detail::STAGE_TIMERS, stage_start);
 
 	zeek::detail::SegmentProfiler* sp = nullptr;
 
@@ -260,8 +265,21 @@ void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
 			}
 		}
 
+	iosource::PacketBuffer::SetCurrent(pkt->buffer.get());
+	stage_start = zeek::detail::StageLatencies::Now();
 	packet_mgr->ProcessPacket(pkt);
+	zeek::detail::StageLatencies::Record(zeek::detail::STAGE_ANALYSIS, stage_start);
+
+	// Connections enforce the reassembly limit as they deliver (see
+	// IPBasedAnalyzer); this catches what got buffered by packets that
+	// didn't make it that far, like fragments of incomplete datagrams.
+	Reassembler::EnforceMemoryLimit();
+
+	iosource::PacketBuffer::SetCurrent(nullptr);
+
+	stage_start = zeek::detail::StageLatencies::Now();
 	event_mgr.Drain();
+	zeek::detail::StageLatencies::Record(zeek::detail::STAGE_EVENTS, stage_start);
 
 	if ( sp )
 		{
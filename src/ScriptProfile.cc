@@ -0,0 +1,295 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ScriptProfile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "zeek/Desc.h"
+#include "zeek/File.h"
+#include "zeek/Func.h"
+#include "zeek/Reporter.h"
+#include "zeek/RunState.h"
+#include "zeek/Stmt.h"
+#include "zeek/Val.h"
+#include "zeek/util.h"
+
+namespace zeek::detail {
+
+static double secs(uint64_t ns)
+	{
+	return ns / 1e9;
+	}
+
+static std::string location_of(const Stmt* s)
+	{
+	auto loc = s->GetLocationInfo();
+
+	if ( ! loc || ! loc->filename )
+		return "<unknown>";
+
+	return std::string(loc->filename) + ":" + std::to_string(loc->first_line);
+	}
+
+// The first line of a statement's description, fit for a single
+// tab-separated column.
+static std::string description_of(const Stmt* s)
+	{
+	ODesc d;
+	s->Describe(&d);
+
+	std::string desc = d.Description();
+	desc = desc.substr(0, desc.find('\n'));
+	std::replace(desc.begin(), desc.end(), '\t', ' ');
+
+	return desc;
+	}
+
+ScriptProfileMgr::ScriptProfileMgr(std::string arg_prefix)
+	: prefix(std::move(arg_prefix))
+	{
+	}
+
+ScriptProfileMgr::~ScriptProfileMgr()
+	{
+	for ( auto& [body, bp] : bodies )
+		Unref(const_cast<Stmt*>(body));
+
+	for ( auto& [s, sp] : stmts )
+		Unref(const_cast<Stmt*>(s));
+	}
+
+uint64_t ScriptProfileMgr::Now()
+	{
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+	}
+
+void ScriptProfileMgr::StartBody(const ScriptFunc* f, const Stmt* body)
+	{
+	auto& bp = bodies[body];
+
+	if ( ! bp )
+		{
+		// Keep the body around so its address stays unique.
+		Ref(const_cast<Stmt*>(body));
+
+		bp = std::make_unique<BodyProfile>();
+		bp->name = f->Name();
+		bp->loc = location_of(body);
+		}
+
+	auto parent = activations.empty() ? &root : activations.back().node;
+	auto& node = parent->children[bp.get()];
+
+	if ( ! node )
+		{
+		node = std::make_unique<CallNode>();
+		node->body = bp.get();
+		node->parent = parent;
+		}
+
+	++bp->calls;
+	++bp->active;
+	++node->calls;
+
+	activations.push_back({node.get(), Now(), Val::NumCreated()});
+	}
+
+void ScriptProfileMgr::EndBody()
+	{
+	auto a = activations.back();
+	activations.pop_back();
+
+	uint64_t dt = Now() - a.start;
+	uint64_t dvals = Val::NumCreated() - a.start_vals;
+
+	auto node = a.node;
+	auto bp = node->body;
+
+	node->time += dt - a.callee_time;
+	node->incl_time += dt;
+	node->vals += dvals - a.callee_vals;
+
+	bp->time += dt - a.callee_time;
+	bp->vals += dvals - a.callee_vals;
+
+	if ( --bp->active == 0 )
+		{
+		bp->incl_time += dt;
+		bp->incl_vals += dvals;
+		}
+
+	if ( ! activations.empty() )
+		{
+		activations.back().callee_time += dt;
+		activations.back().callee_vals += dvals;
+		}
+	}
+
+void ScriptProfileMgr::StmtDone(const Stmt* s, uint64_t dt, uint64_t dvals)
+	{
+	auto& sp = stmts[s];
+
+	if ( sp.execs++ == 0 )
+		{
+		Ref(const_cast<Stmt*>(s));
+		sp.stmt = s;
+		sp.body = activations.empty() ? nullptr : activations.back().node->body;
+		}
+
+	sp.time += dt;
+	sp.vals += dvals;
+	}
+
+void ScriptProfileMgr::Report() const
+	{
+	auto log_name = prefix + ".log";
+	FILE* f = fopen(log_name.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("can't open script profile %s: %s",
+		                log_name.c_str(), strerror(errno));
+		return;
+		}
+
+	// Function bodies, those taking the most time themselves first.
+	std::vector<const BodyProfile*> bps;
+	for ( const auto& [body, bp] : bodies )
+		bps.push_back(bp.get());
+
+	std::sort(bps.begin(), bps.end(),
+	          [](const BodyProfile* a, const BodyProfile* b)
+			{ return a->time > b->time; });
+
+	fprintf(f, "#fields\tfunction\tlocation\tcalls\ttime\tself_time\tvals\tself_vals\n");
+
+	for ( auto bp : bps )
+		fprintf(f, "function\t%s\t%s\t%" PRIu64 "\t%.6f\t%.6f\t%" PRIu64 "\t%" PRIu64 "\n",
+		        bp->name.c_str(), bp->loc.c_str(), bp->calls,
+		        secs(bp->incl_time), secs(bp->time), bp->incl_vals, bp->vals);
+
+	// Call graph edges, summed up over the call paths they appear on.
+	std::map<std::pair<const BodyProfile*, const BodyProfile*>,
+	         std::pair<uint64_t, uint64_t>> edges;
+	std::vector<const CallNode*> to_visit = {&root};
+
+	while ( ! to_visit.empty() )
+		{
+		auto n = to_visit.back();
+		to_visit.pop_back();
+
+		for ( const auto& [callee, c] : n->children )
+			{
+			if ( n->body )
+				{
+				auto& e = edges[{n->body, callee}];
+				e.first += c->calls;
+				e.second += c->incl_time;
+				}
+
+			to_visit.push_back(c.get());
+			}
+		}
+
+	fprintf(f, "#fields\tcall\tcaller\tcaller_location\tcallee\tcallee_location\tcalls\ttime\n");
+
+	for ( const auto& [e, m] : edges )
+		fprintf(f, "call\t%s\t%s\t%s\t%s\t%" PRIu64 "\t%.6f\n",
+		        e.first->name.c_str(), e.first->loc.c_str(),
+		        e.second->name.c_str(), e.second->loc.c_str(),
+		        m.first, secs(m.second));
+
+	// Statements, by the time they took.
+	std::vector<const StmtProfile*> sps;
+	for ( const auto& [s, sp] : stmts )
+		sps.push_back(&sp);
+
+	std::sort(sps.begin(), sps.end(),
+	          [](const StmtProfile* a, const StmtProfile* b)
+			{ return a->time > b->time; });
+
+	fprintf(f, "#fields\tstmt\tlocation\tfunction\texecs\ttime\tvals\tdescription\n");
+
+	for ( auto sp : sps )
+		fprintf(f, "stmt\t%s\t%s\t%" PRIu64 "\t%.6f\t%" PRIu64 "\t%s\n",
+		        location_of(sp->stmt).c_str(),
+		        sp->body ? sp->body->name.c_str() : "-",
+		        sp->execs, secs(sp->time), sp->vals,
+		        description_of(sp->stmt).c_str());
+
+	fclose(f);
+
+	auto folded_name = prefix + ".folded";
+	f = fopen(folded_name.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("can't open script profile %s: %s",
+		                folded_name.c_str(), strerror(errno));
+		return;
+		}
+
+	for ( const auto& [callee, c] : root.children )
+		WriteFolded(f, c.get(), "");
+
+	fclose(f);
+	}
+
+void ScriptProfileMgr::WriteFolded(FILE* f, const CallNode* n, const std::string& path) const
+	{
+	// Frames name the body's location, too, to tell apart the
+	// handlers of an event.
+	auto frame = n->body->name + "@" + n->body->loc;
+	auto n_path = path.empty() ? frame : path + ";" + frame;
+
+	// flamegraph.pl wants sample counts; use microseconds.
+	fprintf(f, "%s %" PRIu64 "\n", n_path.c_str(), n->time / 1000);
+
+	for ( const auto& [callee, c] : n->children )
+		WriteFolded(f, c.get(), n_path);
+	}
+
+void ScriptProfileMgr::LogTopBodies(File* f, int n) const
+	{
+	std::vector<const BodyProfile*> bps;
+	for ( const auto& [body, bp] : bodies )
+		bps.push_back(bp.get());
+
+	auto top = bps.begin() + std::min<size_t>(n, bps.size());
+
+	std::partial_sort(bps.begin(), top, bps.end(),
+	                  [](const BodyProfile* a, const BodyProfile* b)
+				{ return a->time > b->time; });
+
+	f->Write(util::fmt("%.06f Scripts: bodies=%zu\n", run_state::network_time, bodies.size()));
+
+	for ( auto i = bps.begin(); i != top; ++i )
+		{
+		auto bp = *i;
+		f->Write(util::fmt("%.06f         %s (%s) calls=%" PRIu64 " time=%.6f self=%.6f vals=%" PRIu64 " self_vals=%" PRIu64 "\n",
+		                   run_state::network_time, bp->name.c_str(), bp->loc.c_str(),
+		                   bp->calls, secs(bp->incl_time), secs(bp->time),
+		                   bp->incl_vals, bp->vals));
+		}
+	}
+
+void ScriptStmtProfiler::Init()
+	{
+	start = ScriptProfileMgr::Now();
+	start_vals = Val::NumCreated();
+	}
+
+void ScriptStmtProfiler::Report()
+	{
+	script_profile_mgr->StmtDone(stmt, ScriptProfileMgr::Now() - start,
+	                             Val::NumCreated() - start_vals);
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,175 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Profiling of script execution.  For each function body (and so for each
+// event handler and hook handler separately) this tracks the time spent
+// in it and the Val's it creates, both with and without the bodies it
+// calls, along with the call graph between bodies.  Statements get their
+// executions, time and Val's tracked as well.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace zeek {
+
+class File;
+
+namespace detail {
+
+class ScriptFunc;
+class Stmt;
+
+class ScriptProfileMgr {
+public:
+	/**
+	 * @param prefix  the reports get written to *prefix*.log, and the
+	 * call stacks, in the "folded" format that flamegraph.pl reads, to
+	 * *prefix*.folded.
+	 */
+	explicit ScriptProfileMgr(std::string prefix);
+	~ScriptProfileMgr();
+
+	/**
+	 * Marks the start and the end of executing a function body.  Calls
+	 * nest, so every start needs a matching end.
+	 */
+	void StartBody(const ScriptFunc* f, const Stmt* body);
+	void EndBody();
+
+	/**
+	 * Accounts for one execution of a statement, which took *dt*
+	 * nanoseconds and created *dvals* Val's, including those of the
+	 * statements and calls it contains.
+	 */
+	void StmtDone(const Stmt* s, uint64_t dt, uint64_t dvals);
+
+	/**
+	 * Writes the reports.
+	 */
+	void Report() const;
+
+	/**
+	 * Writes the bodies that have taken the most time so far, not
+	 * counting their callees, to the given file (prof.log).
+	 */
+	void LogTopBodies(File* f, int n) const;
+
+	/**
+	 * Returns the current time in nanoseconds, from a clock suited for
+	 * measuring intervals.
+	 */
+	static uint64_t Now();
+
+private:
+	struct BodyProfile {
+		std::string name;
+		std::string loc;
+		uint64_t calls = 0;
+		uint64_t time = 0;
+		uint64_t incl_time = 0;
+		uint64_t vals = 0;
+		uint64_t incl_vals = 0;
+
+		// Number of calls of the body in progress, so that
+		// recursion doesn't count the inclusive measures twice.
+		int active = 0;
+	};
+
+	// A node in the tree of the call paths seen.  Its measures
+	// don't include the calls it makes.
+	struct CallNode {
+		BodyProfile* body = nullptr;
+		CallNode* parent = nullptr;
+		std::unordered_map<const BodyProfile*, std::unique_ptr<CallNode>> children;
+		uint64_t calls = 0;
+		uint64_t time = 0;
+		uint64_t incl_time = 0;
+		uint64_t vals = 0;
+	};
+
+	struct Activation {
+		CallNode* node;
+		uint64_t start;
+		uint64_t start_vals;
+		uint64_t callee_time = 0;
+		uint64_t callee_vals = 0;
+	};
+
+	struct StmtProfile {
+		const Stmt* stmt = nullptr;
+		const BodyProfile* body = nullptr;
+		uint64_t execs = 0;
+		uint64_t time = 0;
+		uint64_t vals = 0;
+	};
+
+	void WriteFolded(FILE* f, const CallNode* n, const std::string& path) const;
+
+	std::string prefix;
+
+	std::unordered_map<const Stmt*, std::unique_ptr<BodyProfile>> bodies;
+	std::unordered_map<const Stmt*, StmtProfile> stmts;
+
+	CallNode root;
+	std::vector<Activation> activations;
+};
+
+extern ScriptProfileMgr* script_profile_mgr;
+
+/**
+ * Profiles the execution of a function body for the lifetime of the
+ * object, including when it ends by exception.
+ */
+class ScriptBodyProfiler {
+public:
+	ScriptBodyProfiler(const ScriptFunc* f, const Stmt* body)
+		: active(script_profile_mgr != nullptr)
+		{
+		if ( active )
+			script_profile_mgr->StartBody(f, body);
+		}
+
+	~ScriptBodyProfiler()
+		{
+		if ( active )
+			script_profile_mgr->EndBody();
+		}
+
+private:
+	bool active;
+};
+
+/**
+ * Same for the execution of a statement.
+ */
+class ScriptStmtProfiler {
+public:
+	explicit ScriptStmtProfiler(const Stmt* s)
+		: stmt(script_profile_mgr ? s : nullptr)
+		{
+		if ( stmt )
+			Init();
+		}
+
+	~ScriptStmtProfiler()
+		{
+		if ( stmt && script_profile_mgr )
+			Report();
+		}
+
+private:
+	void Init();
+	void Report();
+
+	const Stmt* stmt;
+	uint64_t start = 0;
+	uint64_t start_vals = 0;
+};
+
+} // namespace detail
+} // namespace zeek
@@ -15,6 +15,8 @@
 #include "zeek/broker/Manager.h"
 #include "zeek/input.h"
 #include "zeek/Func.h"
+#include "zeek/Expr.h"
+#include "zeek/ScriptProfile.h"
 
 uint64_t zeek::detail::killed_by_inactivity = 0;
 uint64_t& killed_by_inactivity = zeek::detail::killed_by_inactivity;
@@ -63,6 +65,8 @@ ProfileLogger::ProfileLogger(zeek::File* arg_file, double interval)
 	file = arg_file;
 	log_count = 0;
 	timer_mgr->Add(new ProfileTimer(1, this, interval));
+
+	track_expr_allocs = true;
 	}
 
 ProfileLogger::~ProfileLogger()
@@ -251,6 +255,21 @@ void ProfileLogger::Log()
 			cs.num_ids_incoming, cs.num_ids_outgoing
 		       ));
 
+	// Val's created by evaluating expressions, per type of expression.
+	file->Write(util::fmt("%.06f Vals: created=%" PRIu64 "\n",
+	                      run_state::network_time, Val::NumCreated()));
+
+	for ( int i = 0; i < NUM_EXPRS; ++i )
+		{
+		if ( expr_val_allocs[i] )
+			file->Write(util::fmt("%.06f         %s = %" PRIu64 "\n", run_state::network_time,
+			                      expr_name(static_cast<BroExprTag>(i)),
+			                      expr_val_allocs[i]));
+		}
+
+	if ( script_profile_mgr )
+		script_profile_mgr->LogTopBodies(file, 10);
+
 	// Script-level state.
 	unsigned int size, mem = 0;
 	const auto& globals = global_scope()->Vars();
@@ -496,4 +515,28 @@ void PacketProfiler::ProfilePkt(double t, unsigned int bytes)
 	time = t;
 	}
 
+// Names of stages in the same order as in PacketStage.
+static const char* PacketStageNames[] = {
+	"analysis",
+	"session_lookup",
+	"session_delivery",
+	"events",
+	"timers",
+};
+
+const char* packet_stage_to_string(PacketStage stage)
+	{
+	return PacketStageNames[stage];
+	}
+
+void StageLatencies::Calibrate()
+	{
+	uint64_t ticks = Now() - start_ticks;
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start_time).count();
+
+	if ( ticks > 0 && ns > 0 )
+		ns_per_tick = double(ns) / double(ticks);
+	}
+
 } // namespace zeek::detail
@@ -8,6 +8,12 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <stdint.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 namespace zeek {
 
@@ -144,5 +150,95 @@ protected:
 	uint64_t byte_cnt;
 };
 
+// The main stages of processing a packet, for which StageLatencies keeps
+// latency histograms. If you add a stage here, adjust PacketStageNames in
+// Stats.cc.
+enum PacketStage : uint8_t {
+	STAGE_ANALYSIS,	// the packet analyzers, including all of the below
+	STAGE_SESSION_LOOKUP,	// finding the packet's session
+	STAGE_SESSION_DELIVERY,	// passing the packet to the session's analyzers
+	STAGE_EVENTS,	// draining the event queue after a packet
+	STAGE_TIMERS,	// expiring timers before a packet
+};
+constexpr int NUM_PACKET_STAGES = int(STAGE_TIMERS) + 1;
+
+extern const char* packet_stage_to_string(PacketStage stage);
+
+// Latency histogram of a packet processing stage.
+struct StageHistogram {
+	// Bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds, with the
+	// last bucket also taking everything larger.
+	static constexpr int NUM_BUCKETS = 40;
+
+	uint64_t num = 0;
+	uint64_t total_ns = 0;
+	uint64_t max_ns = 0;
+	uint64_t buckets[NUM_BUCKETS] = {};
+};
+
+/**
+ * Always-on latency histograms for the stages of packet processing. Time
+ * is taken from the CPU's cycle counter where available, which costs a
+ * few nanoseconds per measurement, and converted to nanoseconds using a
+ * rate calibrated against the system clock.
+ */
+class StageLatencies {
+public:
+	static constexpr int NUM_BUCKETS = StageHistogram::NUM_BUCKETS;
+
+	/**
+	 * Returns the current value of the counter used for measurements.
+	 */
+	static uint64_t Now()
+		{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+	/**
+	 * Records a latency sample for a stage.
+	 *
+	 * @param stage The stage that ran.
+	 * @param start The value of Now() when the stage began.
+	 */
+	static void Record(PacketStage stage, uint64_t start)
+		{
+		uint64_t ns = static_cast<uint64_t>((Now() - start) * ns_per_tick);
+		auto& h = histograms[stage];
+
+		++h.num;
+		h.total_ns += ns;
+		h.max_ns = std::max(h.max_ns, ns);
+
+		int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+		++h.buckets[std::min(bucket, NUM_BUCKETS - 1)];
+		}
+
+	/**
+	 * Returns the histogram of a stage.
+	 */
+	static const StageHistogram& Get(PacketStage stage)	{ return histograms[stage]; }
+
+	/**
+	 * Determines the rate of the cycle counter by comparing its progress
+	 * since startup with that of the system clock. Called once the
+	 * scripts have been loaded, which takes long enough for a precise
+	 * measurement.
+	 */
+	static void Calibrate();
+
+private:
+	static inline double ns_per_tick = 1.0;
+	static inline StageHistogram histograms[NUM_PACKET_STAGES];
+
+	static inline const uint64_t start_ticks = Now();
+	static inline const std::chrono::steady_clock::time_point start_time =
+		std::chrono::steady_clock::now();
+};
+
 } // namespace detail
 } // namespace zeek
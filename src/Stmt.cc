@@ -15,6 +15,7 @@
 #include "zeek/Var.h"
 #include "zeek/Desc.h"
 #include "zeek/Debug.h"
+#include "zeek/ScriptProfile.h"
 #include "zeek/Traverse.h"
 #include "zeek/Trigger.h"
 #include "zeek/IntrusivePtr.h"
@@ -35,6 +36,7 @@ const char* stmt_name(StmtTag t)
 		"catch-return",
 		"check-any-length",
 		"compiled-C++",
+		"ZAM",
 		"null",
 	};
 
@@ -886,7 +888,7 @@ std::pair<int, ID*> SwitchStmt::FindCaseLabelMatch(const Val* v) const
 	// Find matching expression cases.
 	if ( case_label_value_map.Length() )
 		{
-		auto hk = comp_hash->MakeHashKey(*v, true);
+		auto hk = comp_hash->MakeHashKeyValue(*v, true);
 
 		if ( ! hk )
 			{
@@ -897,7 +899,7 @@ std::pair<int, ID*> SwitchStmt::FindCaseLabelMatch(const Val* v) const
 			return std::make_pair(-1, nullptr);
 			}
 
-		if ( auto i = case_label_value_map.Lookup(hk.get()) )
+		if ( auto i = case_label_value_map.Lookup(&*hk) )
 			label_idx = *i;
 		}
 
@@ -1610,6 +1612,7 @@ ValPtr StmtList::Exec(Frame* f, StmtFlowType& flow)
 			{ // ### Abort or something
 			}
 
+		ScriptStmtProfiler stmt_prof(stmt);
 		auto result = stmt->Exec(f, flow);
 
 		if ( ! post_execute_stmt(stmt, f, result.get(), &flow) )
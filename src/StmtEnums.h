@@ -21,6 +21,7 @@ enum StmtTag {
 	STMT_CATCH_RETURN,	// for reduced InlineExpr's
 	STMT_CHECK_ANY_LEN,	// internal reduced statement
 	STMT_CPP,	// compiled C++
+	STMT_ZAM,	// compiled ZAM
 	STMT_NULL
 #define NUM_STMTS (int(STMT_NULL) + 1)
 };
@@ -3,6 +3,10 @@
 #include "zeek/zeek-config.h"
 #include "zeek/Timer.h"
 
+#include <algorithm>
+
+#include "zeek/3rdparty/doctest.h"
+
 #include "zeek/util.h"
 #include "zeek/Desc.h"
 #include "zeek/RunState.h"
@@ -192,4 +196,372 @@ double PQ_TimerMgr::GetNextTimeout()
 	return -1;
 	}
 
+Wheel_TimerMgr::Wheel_TimerMgr() : TimerMgr(), slots(OVERFLOW_SLOT + 1)
+	{
+	ready = new PriorityQueue;
+	}
+
+Wheel_TimerMgr::~Wheel_TimerMgr()
+	{
+	for ( auto& slot : slots )
+		for ( auto* timer : slot )
+			delete timer;
+
+	delete ready;
+	}
+
+uint64_t Wheel_TimerMgr::TickOf(double t)
+	{
+	if ( t <= 0 )
+		return 0;
+
+	double ticks = t / TICK_DURATION;
+
+	if ( ticks >= 0x1p64 )
+		return UINT64_MAX;
+
+	return static_cast<uint64_t>(ticks);
+	}
+
+void Wheel_TimerMgr::Add(Timer* timer)
+	{
+	DBG_LOG(DBG_TM, "Adding timer %s (%p) at %.6f",
+	        timer_type_to_string(timer->Type()), timer, timer->Time());
+
+	Schedule(timer);
+
+	++current_timers[timer->Type()];
+	++cumulative_num;
+
+	if ( ++num_timers > peak_num_timers )
+		peak_num_timers = num_timers;
+	}
+
+void Wheel_TimerMgr::Schedule(Timer* timer)
+	{
+	uint64_t tick = TickOf(timer->Time());
+
+	if ( tick <= current_tick )
+		{
+		// Due already, or due during the current tick.
+		if ( ! ready->Add(timer) )
+			reporter->InternalError("out of memory");
+
+		return;
+		}
+
+	int level = (63 - __builtin_clzll(tick ^ current_tick)) / WHEEL_BITS;
+	int slot = OVERFLOW_SLOT;
+
+	if ( level < WHEEL_LEVELS )
+		{
+		int digit = (tick >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1);
+		occupied[level][digit / 64] |= uint64_t(1) << (digit % 64);
+		slot = level * WHEEL_SLOTS + digit;
+		}
+
+	auto& timers = slots[slot];
+	timer->wheel_slot = slot;
+	timer->SetOffset(timers.size());
+	timers.push_back(timer);
+	++num_on_wheel;
+	}
+
+void Wheel_TimerMgr::Unlink(Timer* timer)
+	{
+	int slot = timer->wheel_slot;
+	auto& timers = slots[slot];
+
+	// Order within a slot doesn't matter, so fill the gap with the
+	// slot's last timer.
+	Timer* last = timers.back();
+	timers[timer->Offset()] = last;
+	last->SetOffset(timer->Offset());
+	timers.pop_back();
+
+	if ( timers.empty() && slot != OVERFLOW_SLOT )
+		{
+		int digit = slot % WHEEL_SLOTS;
+		occupied[slot / WHEEL_SLOTS][digit / 64] &= ~(uint64_t(1) << (digit % 64));
+		}
+
+	timer->wheel_slot = -1;
+	timer->SetOffset(-1);
+	--num_on_wheel;
+	}
+
+void Wheel_TimerMgr::Collect(int slot, std::vector<Timer*>& into)
+	{
+	auto& timers = slots[slot];
+
+	if ( timers.empty() )
+		return;
+
+	for ( auto* timer : timers )
+		{
+		timer->wheel_slot = -1;
+		timer->SetOffset(-1);
+		into.push_back(timer);
+		}
+
+	num_on_wheel -= timers.size();
+	timers.clear();
+
+	if ( slot != OVERFLOW_SLOT )
+		{
+		int digit = slot % WHEEL_SLOTS;
+		occupied[slot / WHEEL_SLOTS][digit / 64] &= ~(uint64_t(1) << (digit % 64));
+		}
+	}
+
+void Wheel_TimerMgr::Turn(uint64_t tick)
+	{
+	if ( tick <= current_tick )
+		return;
+
+	if ( num_on_wheel == 0 )
+		{
+		current_tick = tick;
+		return;
+		}
+
+	// A timer on level l has a tick whose digits above l match those of
+	// the current tick, and whose digit l is larger. It thus needs to be
+	// rescheduled once the tick's value at level l, i.e. the tick shifted
+	// right by l digits, reaches the timer's.
+	for ( int level = 0; level < WHEEL_LEVELS; ++level )
+		{
+		int shift = level * WHEEL_BITS;
+		uint64_t from = current_tick >> shift;
+		uint64_t to = tick >> shift;
+
+		if ( from == to )
+			// Nothing changes on this or any higher level.
+			break;
+
+		if ( to - from >= WHEEL_SLOTS )
+			to = from + WHEEL_SLOTS;
+
+		for ( uint64_t v = from + 1; v <= to; ++v )
+			Collect(level * WHEEL_SLOTS + (v & (WHEEL_SLOTS - 1)), pending);
+		}
+
+	constexpr int wheel_range_bits = WHEEL_LEVELS * WHEEL_BITS;
+
+	if ( (tick >> wheel_range_bits) != (current_tick >> wheel_range_bits) )
+		Collect(OVERFLOW_SLOT, pending);
+
+	current_tick = tick;
+
+	for ( auto* timer : pending )
+		Schedule(timer);
+
+	pending.clear();
+	}
+
+void Wheel_TimerMgr::Flush()
+	{
+	for ( int slot = 0; slot <= OVERFLOW_SLOT && num_on_wheel > 0; ++slot )
+		Collect(slot, pending);
+
+	for ( auto* timer : pending )
+		if ( ! ready->Add(timer) )
+			reporter->InternalError("out of memory");
+
+	pending.clear();
+	}
+
+void Wheel_TimerMgr::Expire()
+	{
+	Flush();
+
+	Timer* timer;
+	while ( (timer = static_cast<Timer*>(ready->Remove())) )
+		{
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(t, true);
+		--current_timers[timer->Type()];
+		--num_timers;
+		delete timer;
+
+		// Dispatching may have added further timers.
+		if ( num_on_wheel > 0 )
+			Flush();
+		}
+	}
+
+int Wheel_TimerMgr::DoAdvance(double new_t, int max_expire)
+	{
+	Turn(TickOf(new_t));
+
+	Timer* timer = static_cast<Timer*>(ready->Top());
+	for ( num_expired = 0; (num_expired < max_expire || max_expire == 0) &&
+		     timer && timer->Time() <= new_t; ++num_expired )
+		{
+		last_timestamp = timer->Time();
+		--current_timers[timer->Type()];
+		--num_timers;
+
+		// Remove it before dispatching, since the dispatch
+		// can otherwise delete it, and then we won't know
+		// whether we should delete it too.
+		(void) ready->Remove();
+
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(new_t, false);
+		delete timer;
+
+		timer = static_cast<Timer*>(ready->Top());
+		}
+
+	return num_expired;
+	}
+
+void Wheel_TimerMgr::Remove(Timer* timer)
+	{
+	if ( timer->wheel_slot >= 0 )
+		Unlink(timer);
+
+	else if ( ! ready->Remove(timer) )
+		reporter->InternalError("asked to remove a missing timer");
+
+	--current_timers[timer->Type()];
+	--num_timers;
+	delete timer;
+	}
+
+int Wheel_TimerMgr::NextOccupied(int level, int digit) const
+	{
+	for ( int d = digit + 1; d < WHEEL_SLOTS; d = (d / 64 + 1) * 64 )
+		{
+		uint64_t bits = occupied[level][d / 64] >> (d % 64);
+
+		if ( bits )
+			return d + __builtin_ctzll(bits);
+		}
+
+	return -1;
+	}
+
+double Wheel_TimerMgr::GetNextTimeout()
+	{
+	if ( Timer* top = static_cast<Timer*>(ready->Top()) )
+		return std::max(0.0, top->Time() - run_state::network_time);
+
+	if ( num_on_wheel == 0 )
+		return -1;
+
+	// The wheel only knows the earliest tick each of its slots may hold
+	// timers for. That's a lower bound, and at worst we wake up early and
+	// move some timers down a level.
+	constexpr int wheel_range_bits = WHEEL_LEVELS * WHEEL_BITS;
+	uint64_t next_tick = ((current_tick >> wheel_range_bits) + 1) << wheel_range_bits;
+
+	for ( int level = 0; level < WHEEL_LEVELS; ++level )
+		{
+		int shift = level * WHEEL_BITS;
+		uint64_t value = current_tick >> shift;
+		int digit = value & (WHEEL_SLOTS - 1);
+		int next = NextOccupied(level, digit);
+
+		if ( next >= 0 )
+			{
+			next_tick = std::min(next_tick, (value - digit + next) << shift);
+			break;
+			}
+		}
+
+	return std::max(0.0, next_tick * TICK_DURATION - run_state::network_time);
+	}
+
+TEST_SUITE_BEGIN("Timer");
+
+namespace {
+
+class TestTimer final : public Timer {
+public:
+	TestTimer(double t, std::vector<double>* arg_fired)
+		: Timer(t, TIMER_SCHEDULE), fired(arg_fired)
+		{}
+
+	void Dispatch(double t, bool is_expire) override
+		{ fired->push_back(Time()); }
+
+private:
+	std::vector<double>* fired;
+};
+
+class TestWheel_TimerMgr final : public Wheel_TimerMgr {
+public:
+	using Wheel_TimerMgr::DoAdvance;
+};
+
+}
+
+TEST_CASE("wheel timer mgr dispatch order")
+	{
+	TestWheel_TimerMgr mgr;
+	std::vector<double> fired;
+	double base = 1600000000.0;
+
+	// Spread timers across all levels of the wheel, and beyond.
+	double offsets[] = { 0.0001, 0.0005, 0.2, 0.3, 5.0, 70.0, 3600.0,
+	                     86400.0, 86400.0 * 30, 86400.0 * 400 };
+
+	for ( int i = sizeof(offsets) / sizeof(offsets[0]) - 1; i >= 0; --i )
+		mgr.Add(new TestTimer(base + offsets[i], &fired));
+
+	CHECK(mgr.Size() == 10);
+
+	mgr.DoAdvance(base, 0);
+	CHECK(fired.empty());
+
+	mgr.DoAdvance(base + 0.0003, 0);
+	REQUIRE(fired.size() == 1);
+
+	mgr.DoAdvance(base + 100.0, 0);
+	REQUIRE(fired.size() == 6);
+
+	mgr.DoAdvance(base + 86400.0 * 1000, 0);
+	REQUIRE(fired.size() == 10);
+
+	for ( size_t i = 0; i < fired.size(); ++i )
+		CHECK(fired[i] == base + offsets[i]);
+
+	CHECK(mgr.Size() == 0);
+	}
+
+TEST_CASE("wheel timer mgr cancel")
+	{
+	TestWheel_TimerMgr mgr;
+	std::vector<double> fired;
+	std::vector<Timer*> timers;
+
+	for ( int i = 0; i < 1000; ++i )
+		{
+		timers.push_back(new TestTimer(1.0 + i * 0.37, &fired));
+		mgr.Add(timers.back());
+		}
+
+	// Cancel every other timer, some of which have moved into the
+	// ready queue by then.
+	mgr.DoAdvance(10.0, 0);
+	size_t fired_early = fired.size();
+
+	size_t canceled = 0;
+
+	for ( size_t i = fired_early + 1; i < timers.size(); i += 2, ++canceled )
+		mgr.Cancel(timers[i]);
+
+	mgr.Expire();
+
+	CHECK(fired.size() == timers.size() - canceled);
+	CHECK(std::is_sorted(fired.begin(), fired.end()));
+	CHECK(mgr.Size() == 0);
+	}
+
+TEST_SUITE_END();
+
 } // namespace zeek::detail
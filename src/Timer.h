@@ -3,6 +3,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
 
 #include "zeek/PriorityQueue.h"
 #include "zeek/iosource/IOSource.h"
@@ -68,6 +69,13 @@ public:
 protected:
 
 	TimerType type{};
+
+private:
+	friend class Wheel_TimerMgr;
+
+	// The slot holding the timer while it's scheduled on a
+	// Wheel_TimerMgr's wheel, or -1 if it isn't on a wheel.
+	int wheel_slot = -1;
 };
 
 class TimerMgr : public iosource::IOSource {
@@ -171,6 +179,88 @@ protected:
 	PriorityQueue* q;
 };
 
+/**
+ * A timer manager based on a hierarchical timing wheel. Adding and
+ * canceling a timer take constant time, independent of the number of
+ * pending timers, which makes this manager a better fit than PQ_TimerMgr
+ * for large numbers of timers that mostly get canceled or rescheduled
+ * before they expire, such as connection inactivity timers.
+ *
+ * Time is divided into ticks of TICK_DURATION seconds. Each level of the
+ * wheel has WHEEL_SLOTS slots, with a slot on one level spanning all of
+ * the slots of the level below it. A timer sits on the level of the most
+ * significant digit in which its tick differs from the current one, and
+ * moves down the levels as time advances. Once its tick has been reached,
+ * it moves into a small priority queue from which it gets dispatched.
+ * Thus, timers still fire in the exact order of their times, just as with
+ * PQ_TimerMgr.
+ */
+class Wheel_TimerMgr : public TimerMgr {
+public:
+	Wheel_TimerMgr();
+	~Wheel_TimerMgr() override;
+
+	void Add(Timer* timer) override;
+	void Expire() override;
+
+	int Size() const override { return num_timers; }
+	int PeakSize() const override { return peak_num_timers; }
+	uint64_t CumulativeNum() const override { return cumulative_num; }
+	double GetNextTimeout() override;
+
+	static constexpr double TICK_DURATION = 0.001;
+	static constexpr int WHEEL_BITS = 8;
+	static constexpr int WHEEL_SLOTS = 1 << WHEEL_BITS;
+	static constexpr int WHEEL_LEVELS = 4;
+
+protected:
+	int DoAdvance(double t, int max_expire) override;
+	void Remove(Timer* timer) override;
+
+	// Returns the tick covering the given time.
+	static uint64_t TickOf(double t);
+
+	// Places a timer either onto the wheel or, if its tick has already
+	// been reached, into the ready queue.
+	void Schedule(Timer* timer);
+
+	// Takes a timer off the slot it's in.
+	void Unlink(Timer* timer);
+
+	// Moves all timers of the given slot into the given vector.
+	void Collect(int slot, std::vector<Timer*>& into);
+
+	// Moves the wheel forward to the given tick, rescheduling the timers
+	// of all slots that it passes.
+	void Turn(uint64_t tick);
+
+	// Moves all timers from the wheel into the ready queue.
+	void Flush();
+
+	// Returns the index of the first occupied slot of the given level
+	// after the slot of the given digit, or -1 if there's none.
+	int NextOccupied(int level, int digit) const;
+
+	// Overflow slot for timers beyond the range of the highest level.
+	static constexpr int OVERFLOW_SLOT = WHEEL_LEVELS * WHEEL_SLOTS;
+
+	std::vector<std::vector<Timer*>> slots;
+	uint64_t occupied[WHEEL_LEVELS][WHEEL_SLOTS / 64] = {};
+	int num_on_wheel = 0;
+
+	// The tick the wheel currently stands at. Timers with a tick up to
+	// and including this one are in the ready queue.
+	uint64_t current_tick = 0;
+	PriorityQueue* ready;
+
+	int num_timers = 0;
+	int peak_num_timers = 0;
+	uint64_t cumulative_num = 0;
+
+	// Reused across calls to Turn() to avoid allocations.
+	std::vector<Timer*> pending;
+};
+
 extern TimerMgr* timer_mgr;
 
 } // namespace zeek::detail
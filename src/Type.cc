@@ -440,6 +440,26 @@ bool IndexType::IsSubNetIndex() const
 	return false;
 	}
 
+bool IndexType::IsAtomicIndex() const
+	{
+	const auto& types = indices->GetTypes();
+	if ( types.size() != 1 )
+		return false;
+
+	switch ( types[0]->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+	case TYPE_INTERNAL_UNSIGNED:
+	case TYPE_INTERNAL_DOUBLE:
+	case TYPE_INTERNAL_STRING:
+	case TYPE_INTERNAL_ADDR:
+	case TYPE_INTERNAL_SUBNET:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
 static bool is_supported_index_type(const TypePtr& t, const char** tname)
 	{
 	if ( t->InternalType() != TYPE_INTERNAL_OTHER )
@@ -373,6 +373,12 @@ public:
 	// Returns true if this table is solely indexed by subnet.
 	bool IsSubNetIndex() const;
 
+	// Returns true if this table is indexed by a single value of an
+	// atomic type (such as addr, count, or string). CompositeHash keys
+	// such values directly, so lookups can hand over the value itself
+	// instead of wrapping it into a ListVal first.
+	bool IsAtomicIndex() const;
+
 protected:
 	IndexType(TypeTag t, TypeListPtr arg_indices,
 	          TypePtr arg_yield_type)
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cmath>
 #include <set>
 
@@ -20,6 +21,7 @@
 #include "zeek/ZeekString.h"
 #include "zeek/CompHash.h"
 #include "zeek/Dict.h"
+#include "zeek/ExpireBuckets.h"
 #include "zeek/RunState.h"
 #include "zeek/File.h"
 #include "zeek/Func.h"
@@ -46,6 +48,8 @@ using namespace std;
 
 namespace zeek {
 
+uint64_t Val::num_created = 0;
+
 Val::~Val()
 	{
 #ifdef DEBUG
@@ -1432,6 +1436,8 @@ void TableVal::Init(TableTypePtr t)
 	table_type = std::move(t);
 	expire_func = nullptr;
 	expire_time = nullptr;
+	expire_buckets = nullptr;
+	expire_rebuild = nullptr;
 	expire_iterator = nullptr;
 	timer = nullptr;
 	def_val = nullptr;
@@ -1451,16 +1457,23 @@ TableVal::~TableVal()
 	if ( timer )
 		detail::timer_mgr->Cancel(timer);
 
+	// The iterator has to go before its dictionary.
+	delete expire_iterator;
 	delete table_hash;
 	delete table_val;
 	delete subnets;
-	delete expire_iterator;
+	delete expire_buckets;
+	delete expire_rebuild;
 	}
 
 void TableVal::RemoveAll()
 	{
 	delete expire_iterator;
 	expire_iterator = nullptr;
+	delete expire_buckets;
+	expire_buckets = nullptr;
+	delete expire_rebuild;
+	expire_rebuild = nullptr;
 	// Here we take the brute force approach.
 	delete table_val;
 	table_val = new PDict<TableEntryVal>;
@@ -1599,6 +1612,20 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k,
 	if ( old_entry_val && attrs && attrs->Find(detail::ATTR_EXPIRE_CREATE) )
 		new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
+	if ( expire_buckets )
+		{
+		// A replaced entry's filing carries over, its bucket will
+		// refile the new entry once it comes due. A filing left behind
+		// by a deleted entry can't be reused, but deleting and re-adding
+		// an entry in a row doesn't file it twice (see
+		// ExpireBuckets::Add()), and DoExpire() rebuilds the buckets,
+		// incrementally, if stale filings pile up otherwise.
+		if ( old_entry_val )
+			new_entry_val->expire_bucket = old_entry_val->expire_bucket;
+		else
+			FileForExpiration(k_copy, new_entry_val, new_entry_val->expire_access_time);
+		}
+
 	Modified();
 
 	if ( change_func || ( broker_forward && ! broker_store.empty() ) )
@@ -1933,11 +1960,11 @@ const ValPtr& TableVal::Find(const ValPtr& index)
 
 	if ( table_val->Length() > 0 )
 		{
-		auto k = MakeHashKey(*index);
+		auto k = table_hash->MakeHashKeyValue(*index, true);
 
 		if ( k )
 			{
-			TableEntryVal* v = table_val->Lookup(k.get());
+			TableEntryVal* v = table_val->Lookup(&*k);
 
 			if ( v )
 				{
@@ -2024,12 +2051,12 @@ bool TableVal::UpdateTimestamp(Val* index)
 		v = (TableEntryVal*) subnets->Lookup(index);
 	else
 		{
-		auto k = MakeHashKey(*index);
+		auto k = table_hash->MakeHashKeyValue(*index, true);
 
 		if ( ! k )
 			return false;
 
-		v = table_val->Lookup(k.get());
+		v = table_val->Lookup(&*k);
 		}
 
 	if ( ! v )
@@ -2221,9 +2248,9 @@ void TableVal::SendToStore(const Val* index, const TableEntryVal* new_entry_val,
 
 ValPtr TableVal::Remove(const Val& index, bool broker_forward, bool* iterators_invalidated)
 	{
-	auto k = MakeHashKey(index);
+	auto k = table_hash->MakeHashKeyValue(index, true);
 
-	TableEntryVal* v = k ? table_val->RemoveEntry(k.get(), iterators_invalidated) : nullptr;
+	TableEntryVal* v = k ? table_val->RemoveEntry(&*k, iterators_invalidated) : nullptr;
 	ValPtr va;
 
 	if ( v )
@@ -2242,7 +2269,7 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward, bool* iterators_i
 	if ( change_func )
 		{
 		// this is totally cheating around the fact that we need a Intrusive pointer.
-		ValPtr changefunc_val = RecreateIndex(*(k.get()));
+		ValPtr changefunc_val = RecreateIndex(*k);
 		CallChangeFunc(changefunc_val, va, ELEMENT_REMOVED);
 		}
 
@@ -2538,97 +2565,258 @@ void TableVal::DoExpire(double t)
 		// error, it has been reported already.
 		return;
 
-	if ( ! expire_iterator )
-		{
-		auto it = table_val->begin_robust();
-		expire_iterator = new RobustDictIterator(std::move(it));
-		}
+	int budget = zeek::detail::table_incremental_step;
+
+	// Filings of removed or replaced entries only get dropped once their
+	// bucket comes due, so tables with a lot of churn can pile them up.
+	// Start over once they clearly outnumber the entries. Like the
+	// initial filing, this walks the table as the budget permits, so
+	// it doesn't stall on large tables.
+	if ( ! expire_buckets ||
+	     ( ! expire_iterator &&
+	       expire_buckets->NumKeys() > 2 * static_cast<size_t>(table_val->Length()) +
+	                                   zeek::detail::table_incremental_step ) )
+		StartExpireRebuild();
+
+	if ( expire_iterator )
+		ContinueExpireRebuild(&budget);
+
+	// Entries are filed under the second of their last expiration-relevant
+	// access at the time of filing. Since accesses don't refile entries,
+	// a bucket coming due only means that its entries may have expired;
+	// the ones accessed since get filed anew under their current time.
+	// The ones that did expire get collected first and then expired in the
+	// order of the table, as a sweep through it would.
+	bool first_bucket = true;
+	int last_second = 0;
+	int second;
+	detail::ExpireKeyList keys;
+
+	struct Due {
+		size_t offset;	// of the key in due_keys
+		int second;	// of the consumed filing
+		int position;	// in the table
+	};
 
-	bool modified = false;
+	detail::ExpireKeyList due_keys;
+	std::vector<Due> due;
 
-	for ( int i = 0; i < zeek::detail::table_incremental_step &&
-		      *expire_iterator != table_val->end_robust(); ++i, ++(*expire_iterator) )
+	while ( budget > 0 && expire_buckets->Earliest(&second) )
 		{
-		auto v = (*expire_iterator)->GetValue<TableEntryVal*>();
+		if ( run_state::zeek_start_network_time + second + timeout >= t )
+			break;
 
-		if ( v->ExpireAccessTime() == 0 )
-			{
-			// This happens when we insert val while network_time
-			// hasn't been initialized yet (e.g. in zeek_init()), and
-			// also when bro_start_network_time hasn't been initialized
-			// (e.g. before first packet).  The expire_access_time is
-			// correct, so we just need to wait.
-			}
+		if ( ! first_bucket && second <= last_second )
+			// Filed again during this round, leave it for the next.
+			break;
+
+		expire_buckets->TakeEarliest(&second, &keys);
+		first_bucket = false;
+		last_second = second;
 
-		else if ( v->ExpireAccessTime() + timeout < t )
+		size_t offset = 0;
+
+		while ( budget > 0 && offset < keys.End() )
 			{
-			auto k = (*expire_iterator)->GetHashKey();
-			ListValPtr idx = nullptr;
+			--budget;
+
+			// The key points into the bucket, which we own until
+			// we put back what's left of it.
+			auto k = keys.Next(&offset);
+			auto v = table_val->Lookup(&k);
 
-			if ( expire_func )
+			if ( ! v || v->expire_bucket != second )
+				// Entry got removed or refiled since.
+				continue;
+
+			if ( v->ExpireAccessTime() == 0 )
 				{
-				idx = RecreateIndex(*k);
-				double secs = CallExpireFunc(idx);
+				// This happens when we insert val while network_time
+				// hasn't been initialized yet (e.g. in zeek_init()), and
+				// also when bro_start_network_time hasn't been initialized
+				// (e.g. before first packet).  The expire_access_time is
+				// correct, so we just need to wait.
+				FileForExpiration(k, v, second);
+				continue;
+				}
 
-				// It's possible that the user-provided
-				// function modified or deleted the table
-				// value, so look it up again.
-				v = table_val->Lookup(k.get());
+			if ( v->ExpireAccessTime() + timeout >= t )
+				{
+				FileForExpiration(k, v, std::max(second, v->expire_access_time));
+				continue;
+				}
 
-				if ( ! v )
-					{ // user-provided function deleted it
-					if ( ! expire_iterator )
-						// Entire table got dropped (e.g. clear_table() / RemoveAll())
-						break;
+			size_t due_offset = due_keys.End();
+			if ( due_keys.Append(k) )
+				due.push_back({due_offset, second, 0});
+			}
 
-					continue;
-					}
+		keys.Consume(offset);
+		expire_buckets->PutBack(second, keys);
+		}
 
-				if ( secs > 0 )
-					{
-					// User doesn't want us to expire
-					// this now.
-					v->SetExpireAccess(run_state::network_time - timeout + secs);
-					continue;
-					}
+	for ( auto& d : due )
+		{
+		size_t offset = d.offset;
+		auto k = due_keys.Next(&offset);
+		d.position = table_val->Position(&k);
+		}
 
-				}
+	std::sort(due.begin(), due.end(),
+	          [](const Due& a, const Due& b) { return a.position < b.position; });
 
-			if ( subnets )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
-				if ( ! subnets->Remove(idx.get()) )
-					reporter->InternalWarning("index not in prefix table");
+	bool modified = false;
+
+	for ( const auto& d : due )
+		{
+		// An &expire_func or &on_change handler may clear the table,
+		// dropping the buckets along with it.
+		if ( ! expire_buckets )
+			break;
+
+		size_t offset = d.offset;
+		auto k = due_keys.Next(&offset);
+		auto v = table_val->Lookup(&k);
+
+		if ( ! v )
+			// Removed by a handler called for an earlier entry.
+			continue;
+
+		if ( v->ExpireAccessTime() + timeout >= t )
+			{
+			// Accessed by a handler called for an earlier entry. A
+			// replaced entry inherits the filing consumed above, so
+			// it needs a new one.
+			if ( v->expire_bucket == d.second )
+				FileForExpiration(k, v, std::max(d.second, v->expire_access_time));
+
+			continue;
+			}
+
+		ListValPtr idx = nullptr;
+
+		if ( expire_func )
+			{
+			idx = RecreateIndex(k);
+			double secs = CallExpireFunc(idx);
+
+			// It's possible that the user-provided
+			// function modified or deleted the table
+			// value, so look it up again.
+			v = table_val->Lookup(&k);
+
+			if ( ! v )
+				{ // user-provided function deleted it
+				if ( ! expire_buckets )
+					// Entire table got dropped (e.g. clear_table() / RemoveAll())
+					break;
+
+				continue;
 				}
 
-			table_val->RemoveEntry(k.get());
-			if ( change_func )
+			if ( secs > 0 )
 				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
+				// User doesn't want us to expire
+				// this now.
+				v->SetExpireAccess(run_state::network_time - timeout + secs);
 
-				CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+				if ( expire_buckets )
+					FileForExpiration(k, v, std::max(d.second, v->expire_access_time));
+
+				continue;
 				}
 
-			delete v;
-			modified = true;
 			}
+
+		if ( subnets )
+			{
+			if ( ! idx )
+				idx = RecreateIndex(k);
+			if ( ! subnets->Remove(idx.get()) )
+				reporter->InternalWarning("index not in prefix table");
+			}
+
+		table_val->RemoveEntry(&k);
+		if ( change_func )
+			{
+			if ( ! idx )
+				idx = RecreateIndex(k);
+
+			CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+			}
+
+		delete v;
+		modified = true;
 		}
 
 	if ( modified )
 		Modified();
 
-	if ( ! expire_iterator || (*expire_iterator) == table_val->end_robust() )
-		{
-		delete expire_iterator;
-		expire_iterator = nullptr;
+	if ( budget > 0 )
 		InitTimer(zeek::detail::table_expire_interval);
-		}
 	else
 		InitTimer(zeek::detail::table_expire_delay);
 	}
 
+void TableVal::StartExpireRebuild()
+	{
+	// Without buckets yet, entries get filed straight away. Otherwise
+	// the old buckets keep working until the new ones are complete,
+	// and FileForExpiration() files into both meanwhile.
+	if ( expire_buckets )
+		expire_rebuild = new detail::ExpireBuckets;
+	else
+		expire_buckets = new detail::ExpireBuckets;
+
+	expire_iterator = new RobustDictIterator(table_val->begin_robust());
+	++num_expire_rebuilds;
+	}
+
+void TableVal::ContinueExpireRebuild(int* budget)
+	{
+	uint64_t steps = 0;
+
+	for ( ; *budget > 0 && *expire_iterator != table_val->end_robust(); ++*expire_iterator )
+		{
+		--*budget;
+		++steps;
+
+		auto v = (*expire_iterator)->GetValue<TableEntryVal*>();
+		auto k = (*expire_iterator)->GetHashKey();
+
+		if ( expire_rebuild )
+			// Carry the current filing over, which the old buckets
+			// still rely on.
+			expire_rebuild->Add(v->expire_bucket, *k);
+		else
+			FileForExpiration(*k, v, v->expire_access_time);
+		}
+
+	max_expire_rebuild_step = std::max(max_expire_rebuild_step, steps);
+
+	if ( *expire_iterator != table_val->end_robust() )
+		return;
+
+	delete expire_iterator;
+	expire_iterator = nullptr;
+
+	if ( expire_rebuild )
+		{
+		delete expire_buckets;
+		expire_buckets = expire_rebuild;
+		expire_rebuild = nullptr;
+		}
+	}
+
+void TableVal::FileForExpiration(const detail::HashKey& k, TableEntryVal* v, int second)
+	{
+	v->expire_bucket = second;
+	expire_buckets->Add(second, k);
+
+	if ( expire_rebuild )
+		expire_rebuild->Add(second, k);
+	}
+
 double TableVal::GetExpireTime()
 	{
 	if ( ! expire_time )
@@ -2773,6 +2961,15 @@ unsigned int TableVal::MemoryAllocation() const
 		size += padded_sizeof(TableEntryVal);
 		}
 
+	if ( expire_buckets )
+		size += padded_sizeof(*expire_buckets) + expire_buckets->MemoryAllocation();
+
+	if ( expire_rebuild )
+		size += padded_sizeof(*expire_rebuild) + expire_rebuild->MemoryAllocation();
+
+	if ( subnets )
+		size += subnets->MemoryAllocation();
+
 	return size + padded_sizeof(*this) + table_val->MemoryAllocation()
 		+ table_hash->MemoryAllocation();
 	}
@@ -2836,6 +3033,9 @@ TableVal::ParseTimeTableStates TableVal::parse_time_table_states;
 
 TableVal::TableRecordDependencies TableVal::parse_time_table_record_dependencies;
 
+uint64_t TableVal::num_expire_rebuilds = 0;
+uint64_t TableVal::max_expire_rebuild_step = 0;
+
 RecordVal::RecordTypeValMap RecordVal::parse_time_records;
 
 RecordVal::RecordVal(RecordTypePtr t, bool init_fields)
@@ -2846,8 +3046,7 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields)
 
 	int n = rt->NumFields();
 
-	record_val = new std::vector<std::optional<ZVal>>;
-	record_val->reserve(n);
+	Grow(n);
 
 	if ( run_state::is_parsing )
 		parse_time_records[rt.get()].emplace_back(NewRef{}, this);
@@ -2873,7 +3072,10 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields)
 				if ( run_state::is_parsing )
 					parse_time_records[rt.get()].pop_back();
 
-				delete record_val;
+				for ( unsigned int j = 0; j < num_fields; ++j )
+					DeleteFieldIfManaged(j);
+
+				delete [] record_val;
 				throw;
 				}
 
@@ -2905,21 +3107,45 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields)
 			}
 
 		if ( def )
-			record_val->emplace_back(ZVal(def, def->GetType()));
-		else
-			record_val->emplace_back(std::nullopt);
+			{
+			record_val[i] = ZVal(def, def->GetType());
+			PresenceWord(i) |= PresenceBit(i);
+			}
+
+		num_fields = i + 1;
 		}
 	}
 
 RecordVal::~RecordVal()
 	{
-	auto n = record_val->size();
+	for ( unsigned int i = 0; i < num_fields; ++i )
+		DeleteFieldIfManaged(i);
+
+	delete [] record_val;
+	}
+
+void RecordVal::Grow(unsigned int new_capacity)
+	{
+	auto n_words = PresenceWords(new_capacity);
+	auto new_vals = new ZVal[new_capacity + n_words];
 
-	for ( unsigned int i = 0; i < n; ++i )
-		if ( HasField(i) && IsManaged(i) )
-			ZVal::DeleteManagedType(*(*record_val)[i]);
+	for ( unsigned int i = 0; i < n_words; ++i )
+		new_vals[new_capacity + i].uint_val = 0;
 
-	delete record_val;
+	if ( record_val )
+		{
+		for ( unsigned int i = 0; i < num_fields; ++i )
+			new_vals[i] = record_val[i];
+
+		auto old_words = PresenceWords(capacity);
+		for ( unsigned int i = 0; i < old_words; ++i )
+			new_vals[new_capacity + i].uint_val = record_val[capacity + i].uint_val;
+
+		delete [] record_val;
+		}
+
+	record_val = new_vals;
+	capacity = new_capacity;
 	}
 
 ValPtr RecordVal::SizeVal() const
@@ -2934,8 +3160,8 @@ void RecordVal::Assign(int field, ValPtr new_val)
 		DeleteFieldIfManaged(field);
 
 		auto t = rt->GetFieldType(field);
-		(*record_val)[field] = ZVal(new_val, t);
-		Modified();
+		record_val[field] = ZVal(new_val, t);
+		AddedField(field);
 		}
 	else
 		Remove(field);
@@ -2946,9 +3172,9 @@ void RecordVal::Remove(int field)
 	if ( HasField(field) )
 		{
 		if ( IsManaged(field) )
-			ZVal::DeleteManagedType(*(*record_val)[field]);
+			ZVal::DeleteManagedType(record_val[field]);
 
-		(*record_val)[field] = std::nullopt;
+		PresenceWord(field) &= ~PresenceBit(field);
 
 		Modified();
 		}
@@ -2980,6 +3206,8 @@ void RecordVal::ResizeParseTimeRecords(RecordType* revised_rt)
 
 		if ( required_length > current_length )
 			{
+			rv->Grow(required_length);
+
 			for ( auto i = current_length; i < required_length; ++i )
 				rv->AppendField(revised_rt->FieldDefault(i));
 			}
@@ -3090,7 +3318,7 @@ TableValPtr RecordVal::GetRecordFieldsVal() const
 
 void RecordVal::Describe(ODesc* d) const
 	{
-	auto n = record_val->size();
+	auto n = NumFields();
 
 	if ( d->IsBinary() || d->IsPortable() )
 		{
@@ -3126,7 +3354,7 @@ void RecordVal::Describe(ODesc* d) const
 
 void RecordVal::DescribeReST(ODesc* d) const
 	{
-	auto n = record_val->size();
+	auto n = NumFields();
 	auto rt = GetType()->AsRecordType();
 
 	d->Add("{");
@@ -3186,8 +3414,7 @@ unsigned int RecordVal::MemoryAllocation() const
 			size += f_i->MemoryAllocation();
 		}
 
-	size += util::pad_size(record_val->capacity() * sizeof(ZVal));
-	size += padded_sizeof(*record_val);
+	size += util::pad_size((capacity + PresenceWords(capacity)) * sizeof(ZVal));
 
 	return size + padded_sizeof(*this);
 	}
@@ -44,6 +44,7 @@ class Frame;
 class PrefixTable;
 class CompositeHash;
 class HashKey;
+class ExpireBuckets;
 
 } // namespace detail
 
@@ -112,6 +113,9 @@ public:
 	// Bytes in total value object.
 	virtual unsigned int MemoryAllocation() const;
 
+	// The number of Val's created so far.
+	static uint64_t NumCreated()	{ return num_created; }
+
 	// Add this value to the given value (if appropriate).
 	// Returns true if succcessful.  is_first_init is true only if
 	// this is the *first* initialization of the value, not
@@ -234,7 +238,7 @@ protected:
 
 	explicit Val(TypePtr t) noexcept
 		: type(std::move(t))
-		{}
+		{ ++num_created; }
 
 	// For internal use by the Val::Clone() methods.
 	struct CloneState {
@@ -251,6 +255,8 @@ protected:
 
 	TypePtr type;
 
+	static uint64_t num_created;
+
 #ifdef DEBUG
 	// For debugging, we keep the name of the ID to which a Val is bound.
 	const char* bound_id = nullptr;
@@ -692,6 +698,10 @@ protected:
 	// to save a few bytes, as we do not need a high resolution for these
 	// anyway.
 	int expire_access_time;
+
+	// The second under which the entry is currently filed in its table's
+	// expiration buckets, see TableVal::DoExpire().
+	int expire_bucket = 0;
 };
 
 class TableValTimer final : public detail::Timer {
@@ -973,6 +983,18 @@ public:
 	 */
 	void EnableChangeNotifications() { in_change_func = false; }
 
+	/**
+	 * @return the number of times some table's entries got filed for
+	 * expiration anew, initially or to shed stale filings.
+	 */
+	static uint64_t NumExpireRebuilds()	{ return num_expire_rebuilds; }
+
+	/**
+	 * @return the largest number of entries a rebuild of some table's
+	 * expiration buckets visited in a single expiration round.
+	 */
+	static uint64_t MaxExpireRebuildStep()	{ return max_expire_rebuild_step; }
+
 protected:
 	void Init(TableTypePtr t);
 
@@ -1002,6 +1024,18 @@ protected:
 	// Calls &expire_func and returns its return interval;
 	double CallExpireFunc(ListValPtr idx);
 
+	// Starts filing all current entries anew, walking the table
+	// incrementally. Until the walk is done, the current buckets stay
+	// in use.
+	void StartExpireRebuild();
+
+	// Continues the walk, visiting at most as many entries as the
+	// budget allows and deducting them from it.
+	void ContinueExpireRebuild(int* budget);
+
+	// Files an entry in the expiration buckets under the given second.
+	void FileForExpiration(const detail::HashKey& k, TableEntryVal* v, int second);
+
 	// Enum for the different kinds of changes an &on_change handler can see
 	enum OnChangeType { ELEMENT_NEW, ELEMENT_CHANGED, ELEMENT_REMOVED, ELEMENT_EXPIRED };
 
@@ -1020,7 +1054,9 @@ protected:
 	detail::ExprPtr expire_time;
 	detail::ExprPtr expire_func;
 	TableValTimer* timer;
-	RobustDictIterator* expire_iterator;
+	detail::ExpireBuckets* expire_buckets;
+	detail::ExpireBuckets* expire_rebuild;	// buckets being rebuilt
+	RobustDictIterator* expire_iterator;	// position of the rebuild
 	detail::PrefixTable* subnets;
 	ValPtr def_val;
 	detail::ExprPtr change_func;
@@ -1031,6 +1067,9 @@ protected:
 	static TableRecordDependencies parse_time_table_record_dependencies;
 	static ParseTimeTableStates parse_time_table_states;
 
+	static uint64_t num_expire_rebuilds;
+	static uint64_t max_expire_rebuild_step;
+
 private:
 	PDict<TableEntryVal>* table_val;
 };
@@ -1104,13 +1143,13 @@ public:
 	// The following provide efficient record field assignments.
 	void Assign(int field, bool new_val)
 		{
-		(*record_val)[field] = ZVal(bro_int_t(new_val));
+		record_val[field] = ZVal(bro_int_t(new_val));
 		AddedField(field);
 		}
 
 	void Assign(int field, int new_val)
 		{
-		(*record_val)[field] = ZVal(bro_int_t(new_val));
+		record_val[field] = ZVal(bro_int_t(new_val));
 		AddedField(field);
 		}
 
@@ -1119,18 +1158,18 @@ public:
 	// than the other.
 	void Assign(int field, uint32_t new_val)
 		{
-		(*record_val)[field] = ZVal(bro_uint_t(new_val));
+		record_val[field] = ZVal(bro_uint_t(new_val));
 		AddedField(field);
 		}
 	void Assign(int field, uint64_t new_val)
 		{
-		(*record_val)[field] = ZVal(bro_uint_t(new_val));
+		record_val[field] = ZVal(bro_uint_t(new_val));
 		AddedField(field);
 		}
 
 	void Assign(int field, double new_val)
 		{
-		(*record_val)[field] = ZVal(new_val);
+		record_val[field] = ZVal(new_val);
 		AddedField(field);
 		}
 
@@ -1146,8 +1185,8 @@ public:
 	void Assign(int field, StringVal* new_val)
 		{
 		if ( HasField(field) )
-			ZVal::DeleteManagedType(*(*record_val)[field]);
-		(*record_val)[field] = ZVal(new_val);
+			ZVal::DeleteManagedType(record_val[field]);
+		record_val[field] = ZVal(new_val);
 		AddedField(field);
 		}
 	void Assign(int field, const char* new_val)
@@ -1178,10 +1217,16 @@ public:
 	 */
 	void AppendField(ValPtr v)
 		{
+		if ( num_fields == capacity )
+			Grow(capacity == 0 ? 1 : 2 * capacity);
+
+		auto field = num_fields++;
+
 		if ( v )
-			record_val->emplace_back(ZVal(v, v->GetType()));
-		else
-			record_val->emplace_back(std::nullopt);
+			{
+			record_val[field] = ZVal(v, v->GetType());
+			PresenceWord(field) |= PresenceBit(field);
+			}
 		}
 
 	/**
@@ -1189,7 +1234,7 @@ public:
 	 * @return  The number of fields in the record.
 	 */
 	unsigned int NumFields() const
-		{ return record_val->size(); }
+		{ return num_fields; }
 
 	/**
 	 * Returns true if the given field is in the record, false if
@@ -1199,9 +1244,20 @@ public:
 	 */
 	bool HasField(int field) const
 		{
-		return (*record_val)[field] ? true : false;
+		return (PresenceWord(field) & PresenceBit(field)) != 0;
 		}
 
+	/**
+	 * Returns the low-level value of a given field index, which must be
+	 * present.  For fields of native type (bool, int, count, double,
+	 * time, interval and the like) this yields the value directly,
+	 * without creating a Val for it.
+	 * @param field  The field index to retrieve.
+	 * @return  The ZVal holding the field's value.
+	 */
+	const ZVal& RawField(int field) const
+		{ return record_val[field]; }
+
 	/**
 	 * Returns the value of a given field index.
 	 * @param field  The field index to retrieve.
@@ -1212,7 +1268,7 @@ public:
 		if ( ! HasField(field) )
 			return nullptr;
 
-		return (*record_val)[field]->ToVal(rt->GetFieldType(field));
+		return record_val[field].ToVal(rt->GetFieldType(field));
 		}
 
 	/**
@@ -1286,33 +1342,33 @@ public:
 		if constexpr ( std::is_same_v<T, BoolVal> ||
 		               std::is_same_v<T, IntVal> ||
 		               std::is_same_v<T, EnumVal> )
-			return record_val->operator[](field)->int_val;
+			return record_val[field].int_val;
 		else if constexpr ( std::is_same_v<T, CountVal> )
-			return record_val->operator[](field)->uint_val;
+			return record_val[field].uint_val;
 		else if constexpr ( std::is_same_v<T, DoubleVal> ||
 		                    std::is_same_v<T, TimeVal> ||
 		                    std::is_same_v<T, IntervalVal> )
-			return record_val->operator[](field)->double_val;
+			return record_val[field].double_val;
 		else if constexpr ( std::is_same_v<T, PortVal> )
-			return val_mgr->Port(record_val->at(field)->uint_val);
+			return val_mgr->Port(record_val[field].uint_val);
 		else if constexpr ( std::is_same_v<T, StringVal> )
-			return record_val->operator[](field)->string_val->Get();
+			return record_val[field].string_val->Get();
 		else if constexpr ( std::is_same_v<T, AddrVal> )
-			return record_val->operator[](field)->addr_val->Get();
+			return record_val[field].addr_val->Get();
 		else if constexpr ( std::is_same_v<T, SubNetVal> )
-			return record_val->operator[](field)->subnet_val->Get();
+			return record_val[field].subnet_val->Get();
 		else if constexpr ( std::is_same_v<T, File> )
-			return *(record_val->operator[](field)->file_val);
+			return *(record_val[field].file_val);
 		else if constexpr ( std::is_same_v<T, Func> )
-			return *(record_val->operator[](field)->func_val);
+			return *(record_val[field].func_val);
 		else if constexpr ( std::is_same_v<T, PatternVal> )
-			return record_val->operator[](field)->re_val->Get();
+			return record_val[field].re_val->Get();
 		else if constexpr ( std::is_same_v<T, RecordVal> )
-			return record_val->operator[](field)->record_val;
+			return record_val[field].record_val;
 		else if constexpr ( std::is_same_v<T, VectorVal> )
-			return record_val->operator[](field)->vector_val;
+			return record_val[field].vector_val;
 		else if constexpr ( std::is_same_v<T, TableVal> )
-			return record_val->operator[](field)->table_val->Get();
+			return record_val[field].table_val->Get();
 		else
 			{
 			// It's an error to reach here, although because of
@@ -1327,12 +1383,12 @@ public:
 	T GetFieldAs(int field) const
 		{
 		if constexpr ( std::is_integral_v<T> && std::is_signed_v<T> )
-			return record_val->operator[](field)->int_val;
+			return record_val[field].int_val;
 		else if constexpr ( std::is_integral_v<T> &&
 					std::is_unsigned_v<T> )
-			return record_val->operator[](field)->uint_val;
+			return record_val[field].uint_val;
 		else if constexpr ( std::is_floating_point_v<T> )
-			return record_val->operator[](field)->double_val;
+			return record_val[field].double_val;
 
 		// Note: we could add other types here using type traits,
 		// such as is_same_v<T, std::string>, etc.
@@ -1397,6 +1453,7 @@ protected:
 
 	void AddedField(int field)
 		{
+		PresenceWord(field) |= PresenceBit(field);
 		Modified();
 		}
 
@@ -1409,7 +1466,7 @@ private:
 	void DeleteFieldIfManaged(unsigned int field)
 		{
 		if ( HasField(field) && IsManaged(field) )
-			ZVal::DeleteManagedType(*(*record_val)[field]);
+			ZVal::DeleteManagedType(record_val[field]);
 		}
 
 	bool IsManaged(unsigned int offset) const
@@ -1421,8 +1478,29 @@ private:
 	// Keep this handy for quick access during low-level operations.
 	RecordTypePtr rt;
 
-	// Low-level values of each of the fields.
-	std::vector<std::optional<ZVal>>* record_val;
+	// The words of the bitmap of which fields are present.  Fields
+	// declared &optional (or that otherwise haven't been assigned)
+	// have their bit cleared.
+	static unsigned int PresenceWords(unsigned int n)
+		{ return (n + 63) / 64; }
+
+	bro_uint_t& PresenceWord(unsigned int field) const
+		{ return record_val[capacity + field / 64].uint_val; }
+
+	static bro_uint_t PresenceBit(unsigned int field)
+		{ return bro_uint_t(1) << (field % 64); }
+
+	// Allocates room for the given number of fields, keeping those
+	// present so far.
+	void Grow(unsigned int new_capacity);
+
+	// Low-level values of each of the fields, at the offsets the record
+	// type assigns them, followed by the presence bitmap.  Both live in
+	// a single allocation with room for "capacity" fields, which is
+	// sized for the record type up front so that the fields stay put.
+	ZVal* record_val = nullptr;
+	unsigned int num_fields = 0;
+	unsigned int capacity = 0;
 
 	// Whether a given field requires explicit memory management.
 	const std::vector<bool>& is_managed;
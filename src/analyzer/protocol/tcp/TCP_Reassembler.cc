@@ -35,6 +35,7 @@ TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 	skip_deliveries = false;
 	did_EOF = false;
 	seq_to_skip = 0;
+	bypass_seq = 0;
 	in_delivery = false;
 
 	if ( zeek::detail::tcp_max_old_segments )
@@ -281,6 +282,15 @@ void TCP_Reassembler::Undelivered(uint64_t up_to_seq)
 		last_reassem_seq = up_to_seq;	// we've done our best ...
 	}
 
+bool TCP_Reassembler::Evict()
+	{
+	// Data that's only waiting for its ACK goes away quietly.
+	if ( HasHole() )
+		tcp_analyzer->Weird("reassembly_memory_eviction");
+
+	return Reassembler::Evict();
+	}
+
 void TCP_Reassembler::MatchUndelivered(uint64_t up_to_seq, bool use_last_upper)
 	{
 	if ( block_list.Empty() || ! zeek::detail::rule_matcher )
@@ -415,6 +425,16 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 		++it;
 		}
 
+	ReleaseDelivered();
+
+	// Note: don't make an EOF check here, because then we'd miss it
+	// for FIN packets that don't carry any payload (and thus
+	// endpoint->DataSent is not called).  Instead, do the check in
+	// TCP_Connection::NextPacket.
+	}
+
+void TCP_Reassembler::ReleaseDelivered()
+	{
 	TCP_Endpoint* e = endp;
 
 	if ( ! e->peer->HasContents() )
@@ -431,11 +451,32 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 		// don't hang onto the data further, as we may wind up
 		// carrying it all the way until this connection ends.
 		TrimToSeq(last_reassem_seq);
+	}
 
-	// Note: don't make an EOF check here, because then we'd miss it
-	// for FIN packets that don't carry any payload (and thus
-	// endpoint->DataSent is not called).  Instead, do the check in
-	// TCP_Connection::NextPacket.
+bool TCP_Reassembler::CanBypass(uint64_t seq, int len) const
+	{
+	if ( len <= 0 || seq != last_reassem_seq || seq < trim_seq )
+		return false;
+
+	// Anything buffered means there's a hole to fill first.
+	if ( ! block_list.Empty() )
+		return false;
+
+	// Delivered data only needs to stick around until it's acked if
+	// something will look at it again: retransmissions get checked
+	// against it only if there's a handler for the inconsistency event
+	// or we keep old segments, and a contents file may need to catch
+	// up on it.
+	return ! rexmit_inconsistency && max_old_blocks == 0 && ! record_contents_file;
+	}
+
+void TCP_Reassembler::DeliverBypass(uint64_t seq, int len, const u_char* data)
+	{
+	last_reassem_seq += len;
+	bypass_seq = last_reassem_seq;
+
+	DeliverBlock(seq, len, data);
+	ReleaseDelivered();
 	}
 
 void TCP_Reassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
@@ -501,9 +542,28 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len,
 		len -= amount_acked;
 		}
 
-	flags = arg_flags;
-	NewBlock(t, seq, len, data);
-	flags = TCP_Flags();
+	if ( seq < bypass_seq )
+		{
+		// A retransmission of data that we delivered directly without
+		// buffering it, so there's nothing to check it against.  Keep
+		// only what's new.
+		if ( upper_seq <= bypass_seq )
+			return true;
+
+		uint64_t amount_delivered = bypass_seq - seq;
+		seq += amount_delivered;
+		data += amount_delivered;
+		len -= amount_delivered;
+		}
+
+	if ( CanBypass(seq, len) )
+		DeliverBypass(seq, len, data);
+	else
+		{
+		flags = arg_flags;
+		NewBlock(t, seq, len, data);
+		flags = TCP_Flags();
+		}
 
 	if ( Endpoint()->NoDataAcked() && zeek::detail::tcp_max_above_hole_without_any_acks &&
 	     NumUndeliveredBytes() > static_cast<uint64_t>(zeek::detail::tcp_max_above_hole_without_any_acks) )
@@ -514,7 +574,7 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len,
 		}
 
 	if ( zeek::detail::tcp_excessive_data_without_further_acks &&
-	     block_list.DataSize() > static_cast<uint64_t>(zeek::detail::tcp_excessive_data_without_further_acks) )
+	     block_list.DataSize() + BypassedBytes() > static_cast<uint64_t>(zeek::detail::tcp_excessive_data_without_further_acks) )
 		{
 		tcp_analyzer->Weird("excessive_data_without_further_acks");
 		ClearBlocks();
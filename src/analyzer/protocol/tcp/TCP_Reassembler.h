@@ -89,6 +89,7 @@ public:
 private:
 
 	void Undelivered(uint64_t up_to_seq) override;
+	bool Evict() override;
 	void Gap(uint64_t seq, uint64_t len);
 
 	void RecordToSeq(uint64_t start_seq, uint64_t stop_seq, const FilePtr& f);
@@ -98,6 +99,22 @@ private:
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
 
+	// Throws away the data delivered so far if we don't expect to see
+	// it acked.
+	void ReleaseDelivered();
+
+	// Returns true if the given segment can be delivered right away
+	// without going through the reassembly buffer: it starts exactly
+	// where delivery stands, nothing is waiting on a hole, and no one
+	// needs the data around for checking retransmissions against it.
+	bool CanBypass(uint64_t seq, int len) const;
+	void DeliverBypass(uint64_t seq, int len, const u_char* data);
+
+	// The amount of data delivered through DeliverBypass() that hasn't
+	// been acked yet, and would otherwise be sitting in the buffer.
+	uint64_t BypassedBytes() const
+		{ return bypass_seq > trim_seq ? bypass_seq - trim_seq : 0; }
+
 	TCP_Endpoint* endp;
 
 	bool deliver_tcp_contents;
@@ -106,6 +123,7 @@ private:
 	bool skip_deliveries;
 
 	uint64_t seq_to_skip;
+	uint64_t bypass_seq;	// upper end of data delivered via DeliverBypass()
 
 	bool in_delivery;
 	analyzer::tcp::TCP_Flags flags;
@@ -436,6 +436,22 @@ void File::DeliverStream(const u_char* data, uint64_t len)
 	IncrementByteCount(len, seen_bytes_idx);
 	}
 
+void File::FlushReassembler()
+	{
+	uint64_t current_offset = stream_offset;
+	uint64_t gap_bytes = file_reassembler->Flush();
+	IncrementByteCount(gap_bytes, overflow_bytes_idx);
+
+	if ( FileEventAvailable(file_reassembly_overflow) )
+		{
+		FileEvent(file_reassembly_overflow, {
+			val,
+			val_mgr->Count(current_offset),
+			val_mgr->Count(gap_bytes)
+		});
+		}
+	}
+
 void File::DeliverChunk(const u_char* data, uint64_t len, uint64_t offset)
 	{
 	// Potentially handle reassembly and deliver to the stream analyzers.
@@ -443,20 +459,7 @@ void File::DeliverChunk(const u_char* data, uint64_t len, uint64_t offset)
 		{
 		if ( reassembly_max_buffer > 0 &&
 		     reassembly_max_buffer < file_reassembler->TotalSize() )
-			{
-			uint64_t current_offset = stream_offset;
-			uint64_t gap_bytes = file_reassembler->Flush();
-			IncrementByteCount(gap_bytes, overflow_bytes_idx);
-
-			if ( FileEventAvailable(file_reassembly_overflow) )
-				{
-				FileEvent(file_reassembly_overflow, {
-					val,
-					val_mgr->Count(current_offset),
-					val_mgr->Count(gap_bytes)
-				});
-				}
-			}
+			FlushReassembler();
 
 		// Forward data to the reassembler.
 		file_reassembler->NewBlock(run_state::network_time, offset, len, data);
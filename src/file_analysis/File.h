@@ -295,6 +295,12 @@ protected:
 	 */
 	void SetReassemblyBuffer(uint64_t max);
 
+	/**
+	 * Flushes the reassembly buffer, accounting for the skipped data in
+	 * the file's overflow bytes and raising file_reassembly_overflow.
+	 */
+	void FlushReassembler();
+
 	/**
 	 * Perform stream-wise delivery for analyzers that need it.
 	 */
@@ -2,6 +2,7 @@
 
 #include "zeek/file_analysis/FileReassembler.h"
 #include "zeek/file_analysis/File.h"
+#include "zeek/Reporter.h"
 
 namespace zeek::file_analysis {
 
@@ -107,6 +108,16 @@ void FileReassembler::Undelivered(uint64_t up_to_seq)
 		}
 	}
 
+bool FileReassembler::Evict()
+	{
+	if ( ! HasHole() )
+		return Reassembler::Evict();
+
+	reporter->Weird(the_file, "file_reassembly_memory_eviction");
+	the_file->FlushReassembler();
+	return true;
+	}
+
 void FileReassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
 	{
 	// Not doing anything here yet.
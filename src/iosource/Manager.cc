@@ -3,10 +3,16 @@
 #include "zeek/iosource/Manager.h"
 
 #include <sys/types.h>
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#else
 #include <sys/event.h>
+#endif
 #include <sys/time.h>
 #include <unistd.h>
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
 
 #include "zeek/iosource/Component.h"
 #include "zeek/iosource/IOSource.h"
@@ -46,9 +52,15 @@ void Manager::WakeupHandler::Ping(const std::string& where)
 
 Manager::Manager()
 	{
+#ifdef USE_EPOLL
+	event_queue = epoll_create1(EPOLL_CLOEXEC);
+	if ( event_queue == -1 )
+		reporter->FatalError("Failed to initialize epoll: %s", strerror(errno));
+#else
 	event_queue = kqueue();
 	if ( event_queue == -1 )
 		reporter->FatalError("Failed to initialize kqueue: %s", strerror(errno));
+#endif
 	}
 
 Manager::~Manager()
@@ -122,12 +134,14 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 	IOSource* timeout_src = nullptr;
 	bool time_to_poll = false;
 
+#ifndef USE_EPOLL
 	++poll_counter;
 	if ( poll_counter % poll_interval == 0 )
 		{
 		poll_counter = 0;
 		time_to_poll = true;
 		}
+#endif
 
 	// Find the source with the next timeout value.
 	for ( auto src : sources )
@@ -142,18 +156,21 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 				{
 				timeout = next;
 				timeout_src = iosource;
+				}
 
-				// If a source has a zero timeout then it's ready. Just add it to the
-				// list already. Only do this if it's not time to poll though, since
-				// we don't want things in the vector passed into Poll() or it'll end
-				// up inserting duplicates.
-				if ( timeout == 0 && ! time_to_poll )
-					{
-					added = true;
-					ready->push_back(timeout_src);
-					}
+			// If a source has a zero timeout then it's ready. Just add it to the
+			// list already, even if an earlier source had a zero timeout, too: packet
+			// sources don't get another edge from epoll for the packets they still
+			// have waiting. Only do this if it's not time to poll though, since we
+			// don't want things in the vector passed into Poll() or it'll end up
+			// inserting duplicates.
+			if ( next == 0 && ! time_to_poll )
+				{
+				added = true;
+				ready->push_back(iosource);
 				}
 
+#ifndef USE_EPOLL
 			if ( iosource == pkt_src && ! added )
 				{
 				if ( pkt_src->IsLive() )
@@ -171,19 +188,118 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 						ready->push_back(pkt_src);
 					}
 				}
+#endif
 			}
 		}
 
 	DBG_LOG(DBG_MAINLOOP, "timeout: %f   ready size: %zu   time_to_poll: %d\n",
 		timeout, ready->size(), time_to_poll);
 
+#ifdef USE_EPOLL
+	// Checking the file descriptors is cheap with epoll, so we always do
+	// it, just without blocking if some source is ready already. Packet
+	// sources have their descriptors registered edge-triggered and signal
+	// pending packets through a zero timeout instead, so they don't get
+	// reported over and over while they're busy.
+	Poll(ready, ready->empty() ? timeout : 0, timeout_src);
+#else
 	// If we didn't find any IOSources with zero timeouts or it's time to
 	// force a poll, do that and return. Otherwise return the set of ready
 	// sources that we have.
 	if ( ready->empty() || time_to_poll )
 		Poll(ready, timeout, timeout_src);
+#endif
+	}
+
+#ifdef USE_EPOLL
+
+void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* timeout_src)
+	{
+	// epoll_wait() only supports millisecond resolution. Round up, since
+	// rounding sub-millisecond timeouts down to a non-blocking check would
+	// have the loop spin until they expire.
+	int epoll_timeout = timeout < 0 ? 100 : static_cast<int>(std::ceil(timeout * 1e3));
+
+	auto add_ready = [ready](IOSource* src)
+		{
+		if ( std::find(ready->begin(), ready->end(), src) == ready->end() )
+			ready->push_back(src);
+		};
+
+	int ret = epoll_wait(event_queue, events.data(), events.size(), epoll_timeout);
+	if ( ret == -1 )
+		{
+		// Ignore interrupts since we may catch one during shutdown and we don't want the
+		// error to get printed.
+		if ( errno != EINTR )
+			reporter->InternalWarning("Error calling epoll_wait: %s", strerror(errno));
+		}
+	else if ( ret == 0 )
+		{
+		if ( timeout_src )
+			add_ready(timeout_src);
+		}
+	else
+		{
+		for ( int i = 0; i < ret; i++ )
+			{
+			std::map<int, IOSource*>::const_iterator it = fd_map.find(events[i].data.fd);
+			if ( it != fd_map.end() )
+				add_ready(it->second);
+			}
+		}
+	}
+
+bool Manager::RegisterFd(int fd, IOSource* src)
+	{
+	struct epoll_event event = {};
+	event.data.fd = fd;
+	event.events = EPOLLIN;
+
+	// Packet sources keep reading until they come up empty (see
+	// PktSrc::GetNextTimeout()), so they only need to hear about new data.
+	if ( src->IsPacketSource() )
+		event.events |= EPOLLET;
+
+	int ret = epoll_ctl(event_queue, EPOLL_CTL_ADD, fd, &event);
+	if ( ret != -1 )
+		{
+		events.push_back({});
+		DBG_LOG(DBG_MAINLOOP, "Registered fd %d from %s", fd, src->Tag());
+		fd_map[fd] = src;
+
+		Wakeup("RegisterFd");
+		return true;
+		}
+	else
+		{
+		reporter->Error("Failed to register fd %d from %s: %s", fd, src->Tag(), strerror(errno));
+		return false;
+		}
 	}
 
+bool Manager::UnregisterFd(int fd, IOSource* src)
+	{
+	if ( fd_map.find(fd) != fd_map.end() )
+		{
+		int ret = epoll_ctl(event_queue, EPOLL_CTL_DEL, fd, nullptr);
+		if ( ret != -1 )
+			DBG_LOG(DBG_MAINLOOP, "Unregistered fd %d from %s", fd, src->Tag());
+
+		fd_map.erase(fd);
+
+		Wakeup("UnregisterFd");
+		return true;
+		}
+	else
+		{
+		reporter->Error("Attempted to unregister an unknown file descriptor %d from %s", fd, src->Tag());
+		return false;
+		}
+	}
+
+#else
+
 void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* timeout_src)
 	{
 	struct timespec kqueue_timeout;
@@ -278,6 +394,8 @@ bool Manager::UnregisterFd(int fd, IOSource* src)
 		}
 	}
 
+#endif
+
 void Manager::Register(IOSource* src, bool dont_count, bool manage_lifetime)
 	{
 	// First see if we already have registered that source. If so, just
@@ -309,6 +427,7 @@ void Manager::Register(PktSrc* src)
 	{
 	pkt_src = src;
 
+#ifndef USE_EPOLL
 	// The poll interval gets defaulted to 100 which is good for cases like reading
 	// from pcap files and when there isn't a packet source, but is a little too
 	// infrequent for live sources (especially fast live sources). Set it down a
@@ -317,6 +436,7 @@ void Manager::Register(PktSrc* src)
 		poll_interval = 10;
 	else if ( run_state::pseudo_realtime )
 		poll_interval = 1;
+#endif
 
 	Register(src, false);
 	}
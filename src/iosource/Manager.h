@@ -12,7 +12,11 @@
 #include "zeek/Flare.h"
 
 struct timespec;
+#ifdef USE_EPOLL
+struct epoll_event;
+#else
 struct kevent;
+#endif
 
 namespace zeek {
 namespace iosource {
@@ -147,11 +151,13 @@ private:
 	 */
 	void Poll(std::vector<IOSource*>* ready, double timeout, IOSource* timeout_src);
 
+#ifndef USE_EPOLL
 	/**
 	 * Converts a double timeout value into a timespec struct used for calls
 	 * to kevent().
 	 */
 	void ConvertTimeout(double timeout, struct timespec& spec);
+#endif
 
 	/**
 	 * Specialized registration method for packet sources.
@@ -199,15 +205,24 @@ private:
 	int dont_counts = 0;
 	int zero_timeout_count = 0;
 	WakeupHandler* wakeup = nullptr;
+
+#ifndef USE_EPOLL
 	int poll_counter = 0;
 	int poll_interval = 100;
+#endif
 
 	int event_queue = -1;
 	std::map<int, IOSource*> fd_map;
 
+#ifdef USE_EPOLL
+	// This is only used for the output of the call to epoll_wait() in
+	// FindReadySources(). The actual events are stored as part of the queue.
+	std::vector<struct epoll_event> events;
+#else
 	// This is only used for the output of the call to kqueue in FindReadySources().
 	// The actual events are stored as part of the queue.
 	std::vector<struct kevent> events;
+#endif
 };
 
 } // namespace iosource
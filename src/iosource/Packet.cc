@@ -62,6 +62,7 @@ void Packet::Init(int arg_link_type, pkt_timeval *arg_ts, uint32_t arg_caplen,
 
 	encap.reset();
 	ip_hdr.reset();
+	buffer = nullptr;
 
 	proto = -1;
 	tunnel_type = BifEnum::Tunnel::IP;
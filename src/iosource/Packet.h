@@ -18,6 +18,7 @@ typedef struct timeval pkt_timeval;
 #include "zeek/NetVar.h" // For BifEnum::Tunnel
 #include "zeek/TunnelEncapsulation.h"
 #include "zeek/IP.h"
+#include "zeek/iosource/PacketBuffer.h"
 
 namespace zeek {
 
@@ -240,6 +241,15 @@ public:
 	 */
 	int gre_link_type = DLT_RAW;
 
+	/**
+	 * The reference-counted buffer holding the packet's data, if the
+	 * packet source supports handing out references. If set, components
+	 * can keep the data alive beyond the packet's processing by holding
+	 * on to a reference instead of copying it. Packet sources set this
+	 * after calling \a Init(), which resets it.
+	 */
+	iosource::PacketBufferPtr buffer;
+
 private:
 	// Renders an MAC address into its ASCII representation.
 	ValPtr FmtEUI48(const u_char* mac) const;
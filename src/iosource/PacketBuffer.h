@@ -0,0 +1,225 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+
+#include "zeek/IntrusivePtr.h"
+
+namespace zeek::iosource {
+
+class PacketBuffer;
+
+/**
+ * A reference to a packet buffer that its source can revoke. Long-lived
+ * holders of packet data, such as reassembly buffers waiting on a hole,
+ * use claims rather than plain references so that they don't keep the
+ * source from getting the memory back: once the source needs it, the
+ * holder gets notified to copy out whatever data it still uses.
+ */
+class PacketBufferClaim {
+public:
+	/**
+	 * Constructor. Takes a reference to the buffer.
+	 */
+	explicit PacketBufferClaim(PacketBuffer* buf);
+
+	/**
+	 * Destructor. Releases the reference, if it hasn't been revoked.
+	 */
+	virtual ~PacketBufferClaim()	{ Unlink(); }
+
+	PacketBufferClaim(const PacketBufferClaim&) = delete;
+	PacketBufferClaim& operator=(const PacketBufferClaim&) = delete;
+
+	/**
+	 * Returns the claimed buffer, or null if the claim has been revoked.
+	 */
+	PacketBuffer* Buffer() const	{ return buffer; }
+
+protected:
+	/**
+	 * Called when the buffer revokes the claim. By then the claim no
+	 * longer holds a reference, but the buffer's memory remains valid
+	 * until this returns. Implementations copy out the data they need;
+	 * they may delete the claim.
+	 */
+	virtual void Revoked() = 0;
+
+private:
+	friend class PacketBuffer;
+
+	void Unlink();
+
+	PacketBuffer* buffer;
+	PacketBufferClaim* prev = nullptr;
+	PacketBufferClaim* next = nullptr;
+};
+
+/**
+ * A reference-counted region of memory holding the data of one or more
+ * packets. Packet sources that support it attach a buffer to each packet
+ * they hand out (see \a Packet::buffer). Components that would otherwise
+ * copy packet payload to keep it around beyond the packet's processing,
+ * such as the reassemblers, can instead take a reference to the buffer.
+ * The memory goes back to the packet source only once the last reference
+ * has been released.
+ */
+class PacketBuffer {
+public:
+	virtual ~PacketBuffer() = default;
+
+	PacketBuffer(const PacketBuffer&) = delete;
+	PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+	/**
+	 * Returns the start of the buffer's memory.
+	 */
+	const u_char* Data() const	{ return data; }
+
+	/**
+	 * Returns the size of the buffer's memory in bytes.
+	 */
+	uint64_t Size() const	{ return size; }
+
+	/**
+	 * Returns true if the given range lies completely within the buffer.
+	 */
+	bool Contains(const u_char* p, uint64_t len) const
+		{ return p >= data && len <= size && p - data <= static_cast<int64_t>(size - len); }
+
+	/**
+	 * Returns the number of references currently held on the buffer.
+	 */
+	int RefCount() const	{ return ref_cnt; }
+
+	/**
+	 * Returns the buffer of the packet currently being processed, if its
+	 * source attached one and it still holds the data of the given
+	 * range. Returns null otherwise, in which case the caller has to copy
+	 * the data if it needs to keep it.
+	 */
+	static IntrusivePtr<PacketBuffer> Covering(const u_char* p, uint64_t len)
+		{
+		if ( Covers(p, len) )
+			return {NewRef{}, current};
+
+		return nullptr;
+		}
+
+	/**
+	 * Returns true if Covering() would return a buffer for the given
+	 * range, without taking a reference.
+	 */
+	static bool Covers(const u_char* p, uint64_t len)
+		{ return current && current->Contains(p, len); }
+
+	/**
+	 * Sets the buffer of the packet currently being processed. This is
+	 * called by the main loop around the dispatch of each packet.
+	 */
+	static void SetCurrent(PacketBuffer* buf)	{ current = buf; }
+
+	/**
+	 * Revokes all claims on the buffer, having their holders copy out
+	 * the data they use. Sources call this when they need the memory
+	 * back. References taken other than through claims remain.
+	 */
+	void RevokeClaims()
+		{
+		// The last claim may hold the last reference.
+		++ref_cnt;
+
+		while ( auto c = claims )
+			{
+			c->Unlink();
+			c->Revoked();
+			}
+
+		Unref(this);
+		}
+
+protected:
+	/**
+	 * Constructor.
+	 *
+	 * @param data The start of the buffer's memory.
+	 *
+	 * @param size The size of the buffer's memory.
+	 *
+	 * @param ref_cnt The initial reference count. Buffers that are
+	 * recycled by their source may start out with zero references.
+	 */
+	PacketBuffer(const u_char* arg_data, uint64_t arg_size, int arg_ref_cnt = 1)
+		: data(arg_data), size(arg_size), ref_cnt(arg_ref_cnt)
+		{}
+
+	/**
+	 * Called once the last reference has been released. Implementations
+	 * return the memory to the packet source here. The default deletes
+	 * the buffer.
+	 */
+	virtual void Released()	{ delete this; }
+
+private:
+	friend class PacketBufferClaim;
+	friend void Ref(PacketBuffer* b);
+	friend void Unref(PacketBuffer* b);
+
+	const u_char* data;
+	uint64_t size;
+	int ref_cnt;
+
+	// The claims currently held on the buffer, each of which also
+	// holds a reference.
+	PacketBufferClaim* claims = nullptr;
+
+	static inline PacketBuffer* current = nullptr;
+};
+
+inline void Ref(PacketBuffer* b)
+	{
+	++b->ref_cnt;
+	}
+
+inline void Unref(PacketBuffer* b)
+	{
+	if ( b && --b->ref_cnt == 0 )
+		b->Released();
+	}
+
+using PacketBufferPtr = IntrusivePtr<PacketBuffer>;
+
+inline PacketBufferClaim::PacketBufferClaim(PacketBuffer* buf)
+	: buffer(buf)
+	{
+	Ref(buffer);
+
+	next = buffer->claims;
+	if ( next )
+		next->prev = this;
+
+	buffer->claims = this;
+	}
+
+inline void PacketBufferClaim::Unlink()
+	{
+	if ( ! buffer )
+		return;
+
+	if ( prev )
+		prev->next = next;
+	else
+		buffer->claims = next;
+
+	if ( next )
+		next->prev = prev;
+
+	auto b = buffer;
+	buffer = nullptr;
+	prev = next = nullptr;
+	Unref(b);
+	}
+
+} // namespace zeek::iosource
@@ -149,12 +149,21 @@ void PktSrc::Process()
 	if ( ! IsOpen() )
 		return;
 
+	// Batching doesn't combine with pseudo-realtime, which needs to pace
+	// each packet individually against the wallclock.
+	if ( BifConst::Pcap::batch_size > 1 && ! have_packet && ! run_state::pseudo_realtime )
+		{
+		ProcessBatch(BifConst::Pcap::batch_size);
+		return;
+		}
+
 	if ( ! ExtractNextPacketInternal() )
 		return;
 
 	run_state::detail::dispatch_packet(&current_packet, this);
 
 	have_packet = false;
+	current_packet.buffer = nullptr;
 	DoneWithPacket();
 	}
 
@@ -171,15 +180,23 @@ bool PktSrc::ExtractNextPacketInternal()
 	have_packet = false;
 
 	// Don't return any packets if processing is suspended (except for the
-	// very first packet which we need to set up times).
+	// very first packet which we need to set up times). We don't know
+	// whether packets are waiting, so check once processing continues.
 	if ( run_state::is_processing_suspended() && run_state::detail::first_timestamp )
+		{
+		drained = false;
 		return false;
+		}
 
 	if ( run_state::pseudo_realtime )
 		run_state::detail::current_wallclock = util::current_time(true);
 
+	drained = true;
+
 	if ( ExtractNextPacket(&current_packet) )
 		{
+		drained = false;
+
 		if ( current_packet.time < 0 )
 			{
 			Weird("negative_packet_timestamp", &current_packet);
@@ -202,6 +219,97 @@ bool PktSrc::ExtractNextPacketInternal()
 	return false;
 	}
 
+void PktSrc::ProcessBatch(size_t max)
+	{
+	// Same as in ExtractNextPacketInternal(), the first packet always gets
+	// through so that we can set up times.
+	if ( run_state::is_processing_suspended() && run_state::detail::first_timestamp )
+		{
+		drained = false;
+		return;
+		}
+
+	drained = (DispatchPacketBatch(max) == 0);
+	}
+
+size_t PktSrc::DispatchPacketBatch(size_t max)
+	{
+	// A batch cut short by suspended processing gets finished first.
+	if ( batch_next >= batch_len )
+		{
+		// Packets aren't movable, so the array can't be grown in place.
+		if ( batch_capacity < max )
+			{
+			batch = std::make_unique<Packet[]>(max);
+			batch_capacity = max;
+			}
+
+		batch_len = ExtractPacketBatch(batch.get(), max);
+		batch_next = 0;
+
+		if ( batch_len == 0 )
+			return 0;
+		}
+
+	size_t n = 0;
+
+	while ( batch_next < batch_len )
+		{
+		size_t i = batch_next++;
+
+		// Get the next packet's headers on their way into the cache
+		// while this one is being analyzed.
+		if ( batch_next < batch_len )
+			__builtin_prefetch(batch[batch_next].data);
+
+		// Each packet still expires timers and drains events on its
+		// own: handlers would otherwise see a later packet's network
+		// time, and their effects on analysis would come too late for
+		// the rest of the batch.
+		DispatchBatchPacket(&batch[i]);
+		++n;
+
+		// An event may have suspended processing. Leave the rest of
+		// the batch for when it continues, as with single packets.
+		if ( run_state::is_processing_suspended() && batch_next < batch_len )
+			return n;
+		}
+
+	DoneWithPackets();
+	return n;
+	}
+
+void PktSrc::DispatchBatchPacket(Packet* pkt)
+	{
+	if ( pkt->time < 0 )
+		{
+		Weird("negative_packet_timestamp", pkt);
+		pkt->buffer = nullptr;
+		return;
+		}
+
+	if ( ! run_state::detail::first_timestamp )
+		run_state::detail::first_timestamp = pkt->time;
+
+	current_batch_packet = pkt;
+	run_state::detail::dispatch_packet(pkt, this);
+	current_batch_packet = nullptr;
+	pkt->buffer = nullptr;
+	}
+
+size_t PktSrc::ExtractPacketBatch(Packet* pkts, size_t max)
+	{
+	if ( max == 0 )
+		return 0;
+
+	return ExtractNextPacket(&pkts[0]) ? 1 : 0;
+	}
+
+void PktSrc::DoneWithPackets()
+	{
+	DoneWithPacket();
+	}
+
 bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 	{
 	if ( index < 0 )
@@ -225,7 +333,12 @@ bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 		return false;
 		}
 
-	// Store it in vector.
+	StoreBPFFilter(index, code);
+	return true;
+	}
+
+void PktSrc::StoreBPFFilter(int index, detail::BPF_Program* code)
+	{
 	if ( index >= static_cast<int>(filters.size()) )
 		filters.resize(index + 1);
 
@@ -233,8 +346,6 @@ bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 		delete old;
 
 	filters[index] = code;
-
-	return true;
 	}
 
 detail::BPF_Program* PktSrc::GetBPFFilter(int index)
@@ -264,6 +375,12 @@ bool PktSrc::ApplyBPFFilter(int index, const struct pcap_pkthdr *hdr, const u_ch
 
 bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	{
+	if ( current_batch_packet )
+		{
+		*pkt = current_batch_packet;
+		return true;
+		}
+
 	if ( ! have_packet )
 		return false;
 
@@ -285,8 +402,16 @@ double PktSrc::GetNextTimeout()
 	// but we're not in pseudo-realtime mode, let the loop just spin as fast as it can. If we're
 	// in pseudo-realtime mode, find the next time that a packet is ready and have poll block until
 	// then.
-	if ( IsLive() || run_state::is_processing_suspended() )
+	if ( run_state::is_processing_suspended() )
+		return -1;
+	else if ( IsLive() )
+#ifdef USE_EPOLL
+		// With edge-triggered polling we'd only hear about packets arriving in the future, so
+		// report the ones still waiting ourselves.
+		return drained ? -1 : 0;
+#else
 		return -1;
+#endif
 	else if ( ! run_state::pseudo_realtime )
 		return 0;
 
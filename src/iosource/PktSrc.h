@@ -3,6 +3,7 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <memory>
 #include <vector>
 
 #include "zeek/iosource/IOSource.h"
@@ -70,6 +71,11 @@ public:
 	 */
 	bool IsLive() const;
 
+	/**
+	 * Returns true, as this is a packet source.
+	 */
+	bool IsPacketSource() const override	{ return true; }
+
 	/**
 	 * Returns the link type of the source.
 	 */
@@ -329,11 +335,80 @@ protected:
 	 */
 	virtual void DoneWithPacket() = 0;
 
+	/**
+	 * Provides a batch of packets from the source. This is used instead
+	 * of \a ExtractNextPacket() when \c Pcap::batch_size is larger than
+	 * one and Zeek isn't running in pseudo-realtime mode.
+	 *
+	 * The default implementation returns at most a single packet
+	 * obtained through \a ExtractNextPacket(). Derived classes can
+	 * override this to amortize the per-call overhead of their capture
+	 * mechanism across multiple packets.
+	 *
+	 * @param pkts An array of at least *max* packet structures to fill
+	 * in. The callee keeps ownership of the data but must guarantee that
+	 * it stays available for all returned packets at least until \a
+	 * DoneWithPackets() is called. It is guaranteed that no two calls to
+	 * this method will happen without \a DoneWithPackets() in between,
+	 * unless the former returned zero.
+	 *
+	 * @param max The maximum number of packets to return.
+	 *
+	 * @return The number of packets filled in, starting at *pkts[0]*.
+	 * Zero if no packet is available or an error occured (which must be
+	 * flagged via Error()).
+	 */
+	virtual size_t ExtractPacketBatch(Packet* pkts, size_t max);
+
+	/**
+	 * Signals that the data of all packets returned by the previous
+	 * call to \a ExtractPacketBatch() will no longer be needed.
+	 *
+	 * The default implementation calls \a DoneWithPacket().
+	 */
+	virtual void DoneWithPackets();
+
+	/**
+	 * Reads a batch of packets and hands each of them to \a
+	 * DispatchBatchPacket(). The default implementation obtains the
+	 * batch from \a ExtractPacketBatch(). Derived classes whose capture
+	 * mechanism only guarantees packet data to remain valid within a
+	 * callback can override this to dispatch packets from there rather
+	 * than copying them.
+	 *
+	 * @param max The maximum number of packets to read.
+	 *
+	 * @return The number of packets dispatched.
+	 */
+	virtual size_t DispatchPacketBatch(size_t max);
+
+	/**
+	 * Runs a packet of a batch through analysis. For use by \a
+	 * DispatchPacketBatch().
+	 */
+	void DispatchBatchPacket(Packet* pkt);
+
+	/**
+	 * Associates a BPF filter that the derived class has compiled itself
+	 * with the given index, replacing any previous one. For sources that
+	 * need to compile filters differently than \a PrecompileBPFFilter()
+	 * does. The filter will be then available via \a GetBPFFilter().
+	 *
+	 * @param index The index to associate with the filter.
+	 *
+	 * @param code The compiled filter. Ownership passes to the source.
+	 */
+	void StoreBPFFilter(int index, detail::BPF_Program* code);
+
 private:
 
 	// Internal helper for ExtractNextPacket().
 	bool ExtractNextPacketInternal();
 
+	// Internal helper for Process() that extracts and dispatches a
+	// whole batch of packets.
+	void ProcessBatch(size_t max);
+
 	// IOSource interface implementation.
 	void InitSource() override;
 	void Done() override;
@@ -345,6 +420,21 @@ private:
 	bool have_packet;
 	Packet current_packet;
 
+	// False if the last attempt to extract packets returned some, meaning
+	// that more are likely waiting.
+	bool drained = true;
+
+	// Storage for batched extraction, and the packet of the current batch
+	// that's being dispatched (null if none).
+	std::unique_ptr<Packet[]> batch;
+	size_t batch_capacity = 0;
+	Packet* current_batch_packet = nullptr;
+
+	// Number of packets in the batch, and the next one to dispatch.
+	// They differ while processing is suspended partway through.
+	size_t batch_len = 0;
+	size_t batch_next = 0;
+
 	// For BPF filtering support.
 	std::vector<detail::BPF_Program *> filters;
 
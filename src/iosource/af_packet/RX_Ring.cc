@@ -0,0 +1,307 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/af_packet/RX_Ring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::iosource::af_packet::detail {
+
+void BlockBuffer::Released()
+	{
+	ring->BlockReleased(index);
+	}
+
+RX_Ring::~RX_Ring()
+	{
+	if ( ring )
+		munmap(ring, ring_size);
+	}
+
+bool RX_Ring::Init(int sock, size_t arg_buffer_size, size_t arg_block_size,
+                   int block_timeout_msec, std::string* err)
+	{
+	int version = TPACKET_V3;
+
+	if ( setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 )
+		{
+		*err = util::fmt("failed to set TPACKET_V3 (%s)", strerror(errno));
+		return false;
+		}
+
+	if ( arg_block_size == 0 || arg_buffer_size < arg_block_size )
+		{
+		*err = util::fmt("invalid ring geometry (buffer size %zu, block size %zu)",
+		                 arg_buffer_size, arg_block_size);
+		return false;
+		}
+
+	// Frames are only relevant for the kernel's bookkeeping with V3, as
+	// packets get packed into blocks back to back. They still need to
+	// add up to the block size though.
+	const unsigned int frame_size = TPACKET_ALIGNMENT << 7;
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = arg_block_size;
+	req.tp_block_nr = arg_buffer_size / arg_block_size;
+	req.tp_frame_size = frame_size;
+	req.tp_frame_nr = (arg_block_size / frame_size) * req.tp_block_nr;
+	req.tp_retire_blk_tov = block_timeout_msec;
+	req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+	if ( setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+		{
+		*err = util::fmt("failed to set up RX ring (%s)", strerror(errno));
+		return false;
+		}
+
+	size_t size = static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+
+	void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+	                    MAP_SHARED | MAP_POPULATE, sock, 0);
+
+	if ( mapped == MAP_FAILED )
+		{
+		*err = util::fmt("failed to map RX ring (%s)", strerror(errno));
+		return false;
+		}
+
+	SetupBlocks(static_cast<u_char*>(mapped), size, req.tp_block_size);
+	return true;
+	}
+
+void RX_Ring::SetupBlocks(u_char* mapped, size_t arg_ring_size, size_t arg_block_size)
+	{
+	ring = mapped;
+	ring_size = arg_ring_size;
+	block_size = arg_block_size;
+
+	blocks.resize(ring_size / block_size);
+	buffers.resize(blocks.size());
+
+	for ( size_t i = 0; i < blocks.size(); ++i )
+		{
+		u_char* start = ring + i * block_size;
+		blocks[i] = reinterpret_cast<struct tpacket_block_desc*>(start);
+		buffers[i] = std::make_unique<BlockBuffer>(this, i, start, block_size);
+		}
+
+	current_block = nullptr;
+	current_packet = nullptr;
+	current_block_num = 0;
+	packets_left = 0;
+	}
+
+void RX_Ring::Destroy()
+	{
+	// Give up our own reference to the block we're reading from.
+	if ( current_block )
+		{
+		current_block = nullptr;
+		current_packet = nullptr;
+		Unref(buffers[current_block_num].get());
+		}
+
+	destroyed = true;
+
+	// The mapping stays valid after the socket is closed, so
+	// outstanding references can still access their data.
+	if ( pinned_blocks == 0 )
+		delete this;
+	}
+
+void RX_Ring::BlockReleased(size_t index)
+	{
+	--pinned_blocks;
+
+	if ( destroyed )
+		{
+		if ( pinned_blocks == 0 )
+			delete this;
+
+		return;
+		}
+
+	__atomic_store_n(&blocks[index]->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	}
+
+struct tpacket3_hdr* RX_Ring::NextPacket()
+	{
+	if ( blocks.empty() )
+		return nullptr;
+
+	if ( ! current_block )
+		{
+		struct tpacket_block_desc* block = blocks[current_block_num];
+
+		// A block still referenced from an earlier round through the
+		// ring hasn't been handed back to the kernel yet. The kernel
+		// fills blocks in order, so waiting for the references to go
+		// away would stall capture for as long as, say, a segment sits
+		// behind a hole. Have their holders copy out their data
+		// instead, which hands the block back.
+		auto* buffer = buffers[current_block_num].get();
+
+		if ( buffer->RefCount() > 0 )
+			{
+			buffer->RevokeClaims();
+
+			if ( buffer->RefCount() > 0 )
+				return nullptr;
+			}
+
+		// Pairs with the kernel's release of the block; everything the
+		// kernel wrote into the block is visible once we see the status.
+		uint32_t status = __atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+
+		if ( ! (status & TP_STATUS_USER) )
+			return nullptr;
+
+		current_block = block;
+		packets_left = block->hdr.bh1.num_pkts;
+
+		Ref(buffers[current_block_num].get());
+		++pinned_blocks;
+
+		if ( packets_left == 0 )
+			{
+			// Can happen for blocks retired by timeout.
+			ReleaseExhaustedBlock();
+			return nullptr;
+			}
+
+		current_packet = reinterpret_cast<struct tpacket3_hdr*>(
+			reinterpret_cast<u_char*>(block) + block->hdr.bh1.offset_to_first_pkt);
+		}
+
+	else
+		{
+		if ( packets_left == 0 )
+			return nullptr;
+
+		current_packet = reinterpret_cast<struct tpacket3_hdr*>(
+			reinterpret_cast<u_char*>(current_packet) + current_packet->tp_next_offset);
+		}
+
+	--packets_left;
+	return current_packet;
+	}
+
+void RX_Ring::ReleaseExhaustedBlock()
+	{
+	if ( ! BlockExhausted() )
+		return;
+
+	auto* buffer = buffers[current_block_num].get();
+
+	current_block = nullptr;
+	current_packet = nullptr;
+	current_block_num = (current_block_num + 1) % blocks.size();
+
+	// This hands the block back to the kernel unless there are
+	// outstanding references to it.
+	Unref(buffer);
+	}
+
+TEST_SUITE_BEGIN("AF_Packet");
+
+namespace {
+
+// Fills in a block with a single packet, as the kernel would.
+void fill_block(u_char* block, const char* payload)
+	{
+	auto desc = reinterpret_cast<struct tpacket_block_desc*>(block);
+	auto hdr = reinterpret_cast<struct tpacket3_hdr*>(block + 64);
+
+	hdr->tp_next_offset = 0;
+	hdr->tp_mac = 128;
+	hdr->tp_snaplen = strlen(payload);
+	memcpy(reinterpret_cast<u_char*>(hdr) + hdr->tp_mac, payload, hdr->tp_snaplen);
+
+	desc->hdr.bh1.num_pkts = 1;
+	desc->hdr.bh1.offset_to_first_pkt = 64;
+	desc->hdr.bh1.block_status = TP_STATUS_USER;
+	}
+
+uint32_t block_status(const u_char* block)
+	{
+	return reinterpret_cast<const struct tpacket_block_desc*>(block)->hdr.bh1.block_status;
+	}
+
+class TestClaim final : public PacketBufferClaim {
+public:
+	TestClaim(PacketBuffer* buf, const u_char* arg_data, size_t arg_len)
+		: PacketBufferClaim(buf), data(arg_data), len(arg_len)
+		{}
+
+	std::string copy;
+
+protected:
+	void Revoked() override
+		{ copy.assign(reinterpret_cast<const char*>(data), len); }
+
+private:
+	const u_char* data;
+	size_t len;
+};
+
+}
+
+TEST_CASE("ring revokes claims held across a wrap")
+	{
+	const size_t block_size = 4096;
+	void* mem = mmap(nullptr, 2 * block_size, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	REQUIRE(mem != MAP_FAILED);
+
+	auto ring = new RX_Ring();
+	ring->SetupBlocks(static_cast<u_char*>(mem), 2 * block_size, block_size);
+
+	u_char* b0 = static_cast<u_char*>(mem);
+	u_char* b1 = b0 + block_size;
+
+	fill_block(b0, "first");
+	auto hdr = ring->NextPacket();
+	REQUIRE(hdr);
+
+	// Hold on to the packet's data, as a reassembler waiting on a hole
+	// would.
+	TestClaim claim(ring->CurrentBlockBuffer(),
+	                reinterpret_cast<u_char*>(hdr) + hdr->tp_mac, hdr->tp_snaplen);
+	ring->ReleaseExhaustedBlock();
+	CHECK(ring->PinnedBlocks() == 1);
+	CHECK(block_status(b0) == TP_STATUS_USER);
+
+	fill_block(b1, "second");
+	REQUIRE(ring->NextPacket());
+	ring->ReleaseExhaustedBlock();
+	CHECK(block_status(b1) == TP_STATUS_KERNEL);
+
+	// Back at the first block, the ring gets it back from the claim
+	// rather than waiting for it.
+	CHECK(! ring->NextPacket());
+	CHECK(! claim.Buffer());
+	CHECK(claim.copy == "first");
+	CHECK(block_status(b0) == TP_STATUS_KERNEL);
+	CHECK(ring->PinnedBlocks() == 0);
+
+	// Once the kernel has filled it again, reading continues.
+	fill_block(b0, "third");
+	hdr = ring->NextPacket();
+	REQUIRE(hdr);
+	CHECK(memcmp(reinterpret_cast<u_char*>(hdr) + hdr->tp_mac, "third", 5) == 0);
+	ring->ReleaseExhaustedBlock();
+
+	ring->Destroy();
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::iosource::af_packet::detail
@@ -0,0 +1,150 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <linux/if_packet.h>
+}
+
+#include "zeek/iosource/PacketBuffer.h"
+
+namespace zeek::iosource::af_packet::detail {
+
+class RX_Ring;
+
+/**
+ * A packet buffer covering one block of the ring. While the ring reads
+ * packets from a block it holds one reference to it; further references
+ * keep the block away from the kernel until they are released. Once the
+ * ring comes around to the block again, it revokes any claims still held
+ * on it.
+ */
+class BlockBuffer : public PacketBuffer {
+public:
+	BlockBuffer(RX_Ring* arg_ring, size_t arg_index, const u_char* data, uint64_t size)
+		: PacketBuffer(data, size, 0), ring(arg_ring), index(arg_index)
+		{}
+
+protected:
+	void Released() override;
+
+private:
+	RX_Ring* ring;
+	size_t index;
+};
+
+/**
+ * A memory-mapped TPACKET_V3 receive ring of an AF_PACKET socket.
+ *
+ * The kernel fills the ring block-wise. A block becomes available to
+ * user space once it has been retired by the kernel, either because it
+ * filled up or because the block timeout expired. All packets of a block
+ * remain valid until the block is handed back to the kernel, so callers
+ * can process them without copying.
+ */
+class RX_Ring {
+public:
+	RX_Ring() = default;
+
+	RX_Ring(const RX_Ring&) = delete;
+	RX_Ring& operator=(const RX_Ring&) = delete;
+
+	/**
+	 * Sets up the ring for the given socket and maps it into memory.
+	 *
+	 * @param sock The AF_PACKET socket.
+	 *
+	 * @param buffer_size The total size of the ring in bytes. This is
+	 * rounded down to a multiple of *block_size*.
+	 *
+	 * @param block_size The size of a single block in bytes. Must be a
+	 * multiple of the page size.
+	 *
+	 * @param block_timeout_msec Time after which the kernel retires a
+	 * partially filled block.
+	 *
+	 * @return True on success. On failure, returns false and sets *err*
+	 * to a description of the problem.
+	 */
+	bool Init(int sock, size_t buffer_size, size_t block_size,
+	          int block_timeout_msec, std::string* err);
+
+	/**
+	 * Sets up the ring's blocks over memory that holds them, as mapped
+	 * by \a Init(). The ring takes ownership of the mapping. Also allows
+	 * for tests to work on rings whose blocks they fill in themselves.
+	 */
+	void SetupBlocks(u_char* mapped, size_t ring_size, size_t block_size);
+
+	/**
+	 * Shuts down the ring and deletes it. If some of the ring's blocks
+	 * are still referenced, this is deferred until the last of them has
+	 * been released. The ring must not be used after calling this.
+	 */
+	void Destroy();
+
+	/**
+	 * Returns the next packet available in the ring, or null if the
+	 * kernel hasn't retired another block yet.
+	 */
+	struct tpacket3_hdr* NextPacket();
+
+	/**
+	 * Returns true if all packets of the current block have been
+	 * returned by \a NextPacket().
+	 */
+	bool BlockExhausted() const	{ return current_block && packets_left == 0; }
+
+	/**
+	 * Returns the current block to the kernel if it has been exhausted.
+	 * This invalidates all packets returned from that block.
+	 */
+	void ReleaseExhaustedBlock();
+
+	/**
+	 * Returns the buffer covering the block that the packets most recently
+	 * returned by \a NextPacket() live in.
+	 */
+	PacketBuffer* CurrentBlockBuffer() const
+		{ return current_block ? buffers[current_block_num].get() : nullptr; }
+
+	/**
+	 * Returns the number of blocks in the ring.
+	 */
+	size_t NumBlocks() const	{ return blocks.size(); }
+
+	/**
+	 * Returns the number of blocks currently held in user space, either
+	 * for reading or through outstanding references.
+	 */
+	size_t PinnedBlocks() const	{ return pinned_blocks; }
+
+private:
+	friend class BlockBuffer;
+
+	~RX_Ring();
+
+	// Hands a block back to the kernel once no references to it remain.
+	void BlockReleased(size_t index);
+
+	u_char* ring = nullptr;
+	size_t ring_size = 0;
+	size_t block_size = 0;
+	std::vector<struct tpacket_block_desc*> blocks;
+	std::vector<std::unique_ptr<BlockBuffer>> buffers;
+	size_t pinned_blocks = 0;
+	bool destroyed = false;
+
+	struct tpacket_block_desc* current_block = nullptr;
+	struct tpacket3_hdr* current_packet = nullptr;
+	size_t current_block_num = 0;
+	uint32_t packets_left = 0;
+};
+
+} // namespace zeek::iosource::af_packet::detail
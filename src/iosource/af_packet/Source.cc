@@ -0,0 +1,407 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/zeek-config.h"
+#include "zeek/iosource/af_packet/Source.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+
+extern "C" {
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+}
+
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/BPF_Program.h"
+
+#include "zeek/iosource/pcap/pcap.bif.h"
+#include "zeek/iosource/af_packet/af_packet.bif.h"
+
+namespace zeek::iosource::af_packet {
+
+AF_PacketSource::AF_PacketSource(const std::string& path, bool is_live)
+	{
+	props.path = path;
+	props.is_live = is_live;
+	}
+
+AF_PacketSource::~AF_PacketSource()
+	{
+	Close();
+	}
+
+void AF_PacketSource::Open()
+	{
+	if ( ! props.is_live )
+		{
+		Error("AF_PACKET sources only support live capture");
+		return;
+		}
+
+	int ifindex = if_nametoindex(props.path.c_str());
+
+	if ( ifindex == 0 )
+		{
+		Error(util::fmt("unknown interface %s", props.path.c_str()));
+		return;
+		}
+
+	socket_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+	if ( socket_fd < 0 )
+		{
+		Error(util::fmt("failed to create AF_PACKET socket (%s)", strerror(errno)));
+		return;
+		}
+
+	std::string err;
+	rx_ring = new detail::RX_Ring();
+
+	if ( ! rx_ring->Init(socket_fd, BifConst::AF_Packet::buffer_size * 1024 * 1024,
+	                    BifConst::AF_Packet::block_size,
+	                    static_cast<int>(BifConst::AF_Packet::block_timeout * 1000), &err) )
+		{
+		Error(err);
+		rx_ring->Destroy();
+		rx_ring = nullptr;
+		close(socket_fd);
+		socket_fd = -1;
+		return;
+		}
+
+	if ( ! BindInterface(ifindex) || ! EnablePromiscMode(ifindex) )
+		return;
+
+	if ( BifConst::AF_Packet::enable_fanout && ! JoinFanoutGroup() )
+		return;
+
+	props.selectable_fd = socket_fd;
+	props.link_type = DLT_EN10MB;
+	props.netmask = NETMASK_UNKNOWN;
+	props.is_live = true;
+
+	Opened(props);
+	}
+
+void AF_PacketSource::Close()
+	{
+	if ( socket_fd < 0 )
+		return;
+
+	// Reassembly may still hold references into the ring, in which case
+	// it sticks around until they are gone.
+	rx_ring->Destroy();
+	rx_ring = nullptr;
+	close(socket_fd);
+	socket_fd = -1;
+
+	Closed();
+	}
+
+bool AF_PacketSource::BindInterface(int ifindex)
+	{
+	struct sockaddr_ll saddr;
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sll_family = AF_PACKET;
+	saddr.sll_protocol = htons(ETH_P_ALL);
+	saddr.sll_ifindex = ifindex;
+
+	if ( bind(socket_fd, reinterpret_cast<struct sockaddr*>(&saddr), sizeof(saddr)) < 0 )
+		{
+		SocketError("bind");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::EnablePromiscMode(int ifindex)
+	{
+	struct packet_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.mr_ifindex = ifindex;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	if ( setsockopt(socket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 )
+		{
+		SocketError("PACKET_ADD_MEMBERSHIP");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::JoinFanoutGroup()
+	{
+	uint32_t mode;
+
+	switch ( BifConst::AF_Packet::fanout_mode->AsEnum() ) {
+	case BifEnum::AF_Packet::FANOUT_CPU:
+		mode = PACKET_FANOUT_CPU;
+		break;
+	case BifEnum::AF_Packet::FANOUT_LB:
+		mode = PACKET_FANOUT_LB;
+		break;
+	default:
+		mode = PACKET_FANOUT_HASH;
+		break;
+	}
+
+	// With hashing, let the kernel reassemble IP fragments before
+	// computing the flow hash so that all fragments of a datagram reach
+	// the same process.
+	if ( mode == PACKET_FANOUT_HASH && BifConst::AF_Packet::enable_defrag )
+		mode |= PACKET_FANOUT_FLAG_DEFRAG;
+
+	uint32_t fanout_arg = (BifConst::AF_Packet::fanout_id & 0xffff) | (mode << 16);
+
+	if ( setsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) < 0 )
+		{
+		SocketError("PACKET_FANOUT");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::ConvertPacket(struct tpacket3_hdr* hdr, Packet* pkt)
+	{
+	u_char* data = reinterpret_cast<u_char*>(hdr) + hdr->tp_mac;
+	uint32_t caplen = hdr->tp_snaplen;
+	uint32_t len = hdr->tp_len;
+	bool copy = false;
+
+	pkt_timeval ts = { static_cast<time_t>(hdr->tp_sec),
+	                   static_cast<suseconds_t>(hdr->tp_nsec / 1000) };
+
+	// The kernel strips the VLAN tag from the frame and passes it out of
+	// band. Put it back so that the VLAN analyzer sees the frame as it
+	// was on the wire.
+	if ( (hdr->tp_status & TP_STATUS_VLAN_VALID) && caplen >= 2 * ETH_ALEN )
+		{
+		uint16_t tpid = (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID) ?
+			hdr->hv1.tp_vlan_tpid : ETH_P_8021Q;
+		uint16_t tag[2] = { htons(tpid), htons(hdr->hv1.tp_vlan_tci) };
+
+		// The frame's own header (and the sockaddr_ll after it) come
+		// first; whatever lies between those and the MAC header is
+		// headroom we can move the addresses into.
+		if ( hdr->tp_mac >= TPACKET3_HDRLEN + sizeof(tag) )
+			{
+			memmove(data - sizeof(tag), data, 2 * ETH_ALEN);
+			data -= sizeof(tag);
+			memcpy(data + 2 * ETH_ALEN, tag, sizeof(tag));
+			}
+		else
+			{
+			// No room, so rebuild the frame on the side. The
+			// packet then keeps its own copy of it.
+			vlan_frame.resize(caplen + sizeof(tag));
+			memcpy(vlan_frame.data(), data, 2 * ETH_ALEN);
+			memcpy(vlan_frame.data() + 2 * ETH_ALEN, tag, sizeof(tag));
+			memcpy(vlan_frame.data() + 2 * ETH_ALEN + sizeof(tag),
+			       data + 2 * ETH_ALEN, caplen - 2 * ETH_ALEN);
+			data = vlan_frame.data();
+			copy = true;
+			}
+
+		caplen += sizeof(tag);
+		len += sizeof(tag);
+		}
+
+	pkt->Init(props.link_type, &ts, caplen, len, data, copy);
+
+	// Only hand out references while most of the ring remains available
+	// to the kernel. Beyond that, consumers fall back to copying.
+	if ( ! copy && BifConst::AF_Packet::enable_buffer_references &&
+	     rx_ring->PinnedBlocks() <= rx_ring->NumBlocks() / 2 )
+		pkt->buffer = PacketBufferPtr{NewRef{}, rx_ring->CurrentBlockBuffer()};
+
+	++stats.received;
+	stats.bytes_received += len;
+	}
+
+bool AF_PacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	if ( socket_fd < 0 )
+		return false;
+
+	struct tpacket3_hdr* hdr = rx_ring->NextPacket();
+
+	if ( ! hdr )
+		return false;
+
+	ConvertPacket(hdr, pkt);
+	return true;
+	}
+
+void AF_PacketSource::DoneWithPacket()
+	{
+	if ( rx_ring )
+		rx_ring->ReleaseExhaustedBlock();
+	}
+
+size_t AF_PacketSource::ExtractPacketBatch(Packet* pkts, size_t max)
+	{
+	if ( socket_fd < 0 )
+		return 0;
+
+	// A batch never spans blocks, so that DoneWithPackets() can hand the
+	// block back as a whole.
+	size_t n = 0;
+
+	while ( n < max )
+		{
+		struct tpacket3_hdr* hdr = rx_ring->NextPacket();
+
+		if ( ! hdr )
+			break;
+
+		ConvertPacket(hdr, &pkts[n++]);
+
+		if ( rx_ring->BlockExhausted() )
+			break;
+		}
+
+	return n;
+	}
+
+void AF_PacketSource::DoneWithPackets()
+	{
+	if ( rx_ring )
+		rx_ring->ReleaseExhaustedBlock();
+	}
+
+bool AF_PacketSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	if ( socket_fd < 0 || index < 0 )
+		return PktSrc::PrecompileBPFFilter(index, filter);
+
+	// The kernel strips VLAN tags from frames before socket filters get
+	// to see them, passing the tags along as ancillary data instead. A
+	// filter compiled for plain Ethernet would thus look for "vlan" in
+	// the wrong place. libpcap generates code that checks the ancillary
+	// data only when compiling for a live Linux interface, so we compile
+	// through a short-lived handle on ours, which also gets our filters
+	// to match the way they do with the libpcap source.
+	char errbuf[PCAP_ERRBUF_SIZE];
+	*errbuf = '\0';
+
+	pcap_t* pd = pcap_create(props.path.c_str(), errbuf);
+
+	if ( ! pd )
+		{
+		Error(util::fmt("cannot compile BPF filter \"%s\": %s", filter.c_str(), errbuf));
+		return false;
+		}
+
+	// The handle captures until we close it again; keep its ring small.
+	pcap_set_snaplen(pd, BifConst::Pcap::snaplen);
+	pcap_set_buffer_size(pd, 64 * 1024);
+
+	if ( pcap_activate(pd) < 0 )
+		{
+		Error(util::fmt("cannot compile BPF filter \"%s\": %s", filter.c_str(),
+		                pcap_geterr(pd)));
+		pcap_close(pd);
+		return false;
+		}
+
+	auto* code = new iosource::detail::BPF_Program();
+	bool compiled = code->Compile(pd, filter.c_str(), Netmask(), errbuf, sizeof(errbuf));
+	pcap_close(pd);
+
+	if ( ! compiled )
+		{
+		std::string msg = util::fmt("cannot compile BPF filter \"%s\"", filter.c_str());
+
+		if ( *errbuf )
+			msg += ": " + std::string(errbuf);
+
+		Error(msg);
+		delete code;
+		return false;
+		}
+
+	StoreBPFFilter(index, code);
+	return true;
+	}
+
+bool AF_PacketSource::SetFilter(int index)
+	{
+	if ( socket_fd < 0 )
+		return true; // Prevent error message.
+
+	iosource::detail::BPF_Program* code = GetBPFFilter(index);
+
+	if ( ! code )
+		{
+		Error(util::fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	if ( code->MatchesAnything() )
+		{
+		// Nothing to filter in the kernel; drop any filter that an
+		// earlier call attached.
+		int dummy = 0;
+		setsockopt(socket_fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+		return true;
+		}
+
+	// Classic BPF instructions have the same layout as the kernel's
+	// socket filter instructions.
+	struct sock_fprog fprog;
+	fprog.len = code->GetProgram()->bf_len;
+	fprog.filter = reinterpret_cast<struct sock_filter*>(code->GetProgram()->bf_insns);
+
+	if ( setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 )
+		{
+		SocketError("SO_ATTACH_FILTER");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Statistics(Stats* s)
+	{
+	if ( socket_fd < 0 )
+		{
+		s->received = s->dropped = s->link = s->bytes_received = 0;
+		return;
+		}
+
+	// The kernel resets its counters with every query, so we accumulate
+	// them ourselves.
+	struct tpacket_stats_v3 tp_stats;
+	socklen_t tp_stats_len = sizeof(tp_stats);
+
+	if ( getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &tp_stats_len) == 0 )
+		{
+		stats.link += tp_stats.tp_packets;
+		stats.dropped += tp_stats.tp_drops;
+		}
+
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->link = stats.link;
+	s->dropped = stats.dropped;
+	}
+
+void AF_PacketSource::SocketError(const char* where)
+	{
+	Error(util::fmt("%s failed on %s (%s)", where, props.path.c_str(), strerror(errno)));
+	Close();
+	}
+
+iosource::PktSrc* AF_PacketSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new AF_PacketSource(path, is_live);
+	}
+
+} // namespace zeek::iosource::af_packet
@@ -0,0 +1,56 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <vector>
+
+#include "zeek/iosource/PktSrc.h"
+#include "zeek/iosource/af_packet/RX_Ring.h"
+
+namespace zeek::iosource::af_packet {
+
+/**
+ * Packet source reading from a Linux AF_PACKET socket through a
+ * memory-mapped TPACKET_V3 ring. Packets are handed to Zeek directly from
+ * the ring without copying. Optionally, the socket joins a PACKET_FANOUT
+ * group so that multiple Zeek processes can share the traffic of a
+ * single interface.
+ */
+class AF_PacketSource : public PktSrc {
+public:
+	AF_PacketSource(const std::string& path, bool is_live);
+	~AF_PacketSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	void DoneWithPacket() override;
+	size_t ExtractPacketBatch(Packet* pkts, size_t max) override;
+	void DoneWithPackets() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	bool BindInterface(int ifindex);
+	bool EnablePromiscMode(int ifindex);
+	bool JoinFanoutGroup();
+	void ConvertPacket(struct tpacket3_hdr* hdr, Packet* pkt);
+	void SocketError(const char* where);
+
+	Properties props;
+	Stats stats;
+
+	int socket_fd = -1;
+	detail::RX_Ring* rx_ring = nullptr;
+
+	// Scratch space for re-inserting a VLAN tag into frames that lack
+	// the headroom to do so in place.
+	std::vector<u_char> vlan_frame;
+};
+
+} // namespace zeek::iosource::af_packet
@@ -10,6 +10,7 @@
 #include "zeek/iosource/Packet.h"
 #include "zeek/iosource/BPF_Program.h"
 #include "zeek/Event.h"
+#include "zeek/RunState.h"
 
 #include "zeek/iosource/pcap/pcap.bif.h"
 
@@ -253,6 +254,79 @@ void PcapSource::DoneWithPacket()
 	// Nothing to do.
 	}
 
+size_t PcapSource::DispatchPacketBatch(size_t max)
+	{
+	if ( ! pd || max == 0 )
+		return 0;
+
+	batch_count = 0;
+
+	int res = pcap_dispatch(pd, static_cast<int>(max), BatchCallback,
+	                        reinterpret_cast<u_char*>(this));
+
+	switch ( res ) {
+	case PCAP_ERROR_BREAK: // -2
+		// Loop terminated by pcap_breakloop() before any packet was
+		// processed.
+		break;
+	case PCAP_ERROR: // -1
+		// Error occurred while reading packets.
+		if ( props.is_live )
+			reporter->Error("failed to read a packet from %s: %s",
+			                props.path.data(), pcap_geterr(pd));
+		else
+			reporter->FatalError("failed to read a packet from %s: %s",
+			                     props.path.data(), pcap_geterr(pd));
+		break;
+	case 0:
+		// For trace files, this signals that the file has been
+		// exhausted. For live interfaces, the read timed out (ok).
+		if ( ! props.is_live )
+			Close();
+		break;
+	default:
+		break;
+	}
+
+	return batch_count;
+	}
+
+void PcapSource::BatchCallback(u_char* user, const struct pcap_pkthdr* hdr,
+                               const u_char* data)
+	{
+	reinterpret_cast<PcapSource*>(user)->DispatchFromBatch(hdr, data);
+	}
+
+void PcapSource::DispatchFromBatch(const struct pcap_pkthdr* hdr, const u_char* data)
+	{
+	// See ExtractNextPacket() for the null-data check.
+	if ( ! data )
+		{
+		reporter->Weird("pcap_null_data_packet");
+		return;
+		}
+
+	pkt_timeval ts = hdr->ts;
+	batch_packet.Init(props.link_type, &ts, hdr->caplen, hdr->len, data);
+
+	if ( hdr->len == 0 || hdr->caplen == 0 )
+		{
+		Weird("empty_pcap_header", &batch_packet);
+		return;
+		}
+
+	++stats.received;
+	stats.bytes_received += hdr->len;
+	++batch_count;
+
+	DispatchBatchPacket(&batch_packet);
+
+	// The packet data is only valid within the callback, so the rest of
+	// the batch stays with libpcap until processing continues.
+	if ( run_state::is_processing_suspended() )
+		pcap_breakloop(pd);
+	}
+
 bool PcapSource::PrecompileFilter(int index, const std::string& filter)
 	{
 	return PktSrc::PrecompileBPFFilter(index, filter);
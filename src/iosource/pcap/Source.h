@@ -25,6 +25,7 @@ protected:
 	void Close() override;
 	bool ExtractNextPacket(Packet* pkt) override;
 	void DoneWithPacket() override;
+	size_t DispatchPacketBatch(size_t max) override;
 	bool PrecompileFilter(int index, const std::string& filter) override;
 	bool SetFilter(int index) override;
 	void Statistics(Stats* stats) override;
@@ -34,10 +35,22 @@ private:
 	void OpenOffline();
 	void PcapError(const char* where = nullptr);
 
+	// Callback for pcap_dispatch() that analyzes a packet of the
+	// current batch.
+	static void BatchCallback(u_char* user, const struct pcap_pkthdr* hdr,
+	                          const u_char* data);
+	void DispatchFromBatch(const struct pcap_pkthdr* hdr, const u_char* data);
+
 	Properties props;
 	Stats stats;
 
 	pcap_t *pd;
+
+	// The packet of the batch that pcap_dispatch() is currently handing
+	// over. libpcap only guarantees its data to remain valid until the
+	// callback returns, so it gets analyzed right there.
+	Packet batch_packet;
+	size_t batch_count = 0;
 };
 
 } // namespace zeek::iosource::pcap
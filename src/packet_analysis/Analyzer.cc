@@ -75,9 +75,37 @@ AnalyzerPtr Analyzer::Lookup(uint32_t identifier) const
 bool Analyzer::ForwardPacket(size_t len, const uint8_t* data, Packet* packet,
                              uint32_t identifier) const
 	{
-	auto inner_analyzer = Lookup(identifier);
-	if ( ! inner_analyzer )
-		inner_analyzer = default_analyzer;
+	Analyzer* inner_analyzer = nullptr;
+
+	if ( hot_analyzer && identifier == hot_identifier )
+		{
+		// Fast path: same next layer as the dominant one seen so far.
+		inner_analyzer = hot_analyzer;
+		packet_mgr->CountDispatchCacheHit();
+
+		if ( hot_confidence < MAX_HOT_CONFIDENCE )
+			++hot_confidence;
+		}
+	else
+		{
+		inner_analyzer = dispatcher.Lookup(identifier).get();
+
+		// Only replace the cached next layer once it has stopped being
+		// the dominant one, so that a mix of, e.g., TCP and UDP doesn't
+		// flip the cache back and forth on every packet.
+		if ( inner_analyzer )
+			{
+			if ( hot_confidence > 0 )
+				--hot_confidence;
+			else
+				{
+				hot_identifier = identifier;
+				hot_analyzer = inner_analyzer;
+				}
+			}
+		else
+			inner_analyzer = default_analyzer.get();
+		}
 
 	if ( inner_analyzer == nullptr )
 		{
@@ -125,6 +153,9 @@ void Analyzer::RegisterProtocol(uint32_t identifier, AnalyzerPtr child)
 		reporter->FatalError("Packet protocols cannot be registered after zeek_init has finished.");
 
 	dispatcher.Register(identifier, std::move(child));
+
+	hot_analyzer = nullptr;
+	hot_confidence = 0;
 	}
 
 void Analyzer::Weird(const char* name, Packet* packet, const char* addl) const
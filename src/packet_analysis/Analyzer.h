@@ -173,6 +173,16 @@ private:
 	 */
 	bool report_unknown_protocols = true;
 
+	/**
+	 * Cache of the next-layer analyzer that ForwardPacket() dispatches to
+	 * most often, along with its identifier. While packets keep following
+	 * the same chain of protocols, this skips the dispatcher lookups.
+	 */
+	static constexpr uint8_t MAX_HOT_CONFIDENCE = 3;
+	mutable uint32_t hot_identifier = 0;
+	mutable Analyzer* hot_analyzer = nullptr;
+	mutable uint8_t hot_confidence = 0;
+
 	void Init(const Tag& tag);
 };
 
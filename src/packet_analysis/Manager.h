@@ -85,6 +85,19 @@ public:
 
 	uint64_t PacketsProcessed() const	{ return num_packets_processed; }
 
+	/**
+	 * Returns the number of times a packet analyzer forwarded a packet to
+	 * its cached next-layer analyzer without looking it up in its
+	 * dispatcher.
+	 */
+	uint64_t DispatchCacheHits() const	{ return num_dispatch_cache_hits; }
+
+	/**
+	 * Records a hit of an analyzer's next-layer cache. Called from
+	 * Analyzer::ForwardPacket().
+	 */
+	void CountDispatchCacheHit()	{ ++num_dispatch_cache_hits; }
+
 	/**
 	 * Records the given packet if a dumper is active.
 	 *
@@ -147,6 +160,7 @@ private:
 	AnalyzerPtr root_analyzer = nullptr;
 
 	uint64_t num_packets_processed = 0;
+	uint64_t num_dispatch_cache_hits = 0;
 	detail::PacketProfiler* pkt_profiler = nullptr;
 	detail::PacketFilter* pkt_filter = nullptr;
 
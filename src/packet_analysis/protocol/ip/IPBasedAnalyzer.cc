@@ -4,7 +4,9 @@
 
 #include "zeek/RunState.h"
 #include "zeek/Conn.h"
+#include "zeek/Stats.h"
 #include "zeek/Val.h"
+#include "zeek/Reassem.h"
 #include "zeek/session/Manager.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/protocol/pia/PIA.h"
@@ -33,7 +35,9 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 	const std::unique_ptr<IP_Hdr>& ip_hdr = pkt->ip_hdr;
 	detail::ConnKey key(tuple);
 
+	uint64_t stage_start = zeek::detail::StageLatencies::Now();
 	Connection* conn = session_mgr->FindConnection(key);
+	zeek::detail::StageLatencies::Record(zeek::detail::STAGE_SESSION_LOOKUP, stage_start);
 
 	if ( ! conn )
 		{
@@ -93,7 +97,14 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 		if ( conn->Skipping() )
 			return true;
 
+		stage_start = zeek::detail::StageLatencies::Now();
 		DeliverPacket(conn, run_state::processing_start_time, is_orig, len, pkt);
+		zeek::detail::StageLatencies::Record(zeek::detail::STAGE_SESSION_DELIVERY, stage_start);
+
+		// Evict while the packet that pushed reassembly over its limit
+		// is still current, so analyzers receiving the evicted data see
+		// the same context as for any other delivery.
+		Reassembler::EnforceMemoryLimit();
 
 		run_state::current_timestamp = 0;
 		run_state::current_pkt = nullptr;
@@ -119,8 +130,10 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 
 		const u_char* data = pkt->ip_hdr->Payload();
 
+		stage_start = zeek::detail::StageLatencies::Now();
 		conn->NextPacket(run_state::processing_start_time, is_orig, ip_hdr.get(), ip_hdr->PayloadLen(),
 		                 len, data, record_packet, record_content, pkt);
+		zeek::detail::StageLatencies::Record(zeek::detail::STAGE_SESSION_DELIVERY, stage_start);
 
 		// If the packet is reassembled, disable packet dumping because the
 		// pointer math to dump the data wouldn't work.
@@ -2430,7 +2430,7 @@ bool InlineExpr::IsPure() const
 	return args->IsPure() && body->IsPure();
 	}
 
-ValPtr InlineExpr::Eval(Frame* f) const
+ValPtr InlineExpr::DoEval(Frame* f) const
 	{
 	auto v = eval_list(f, args.get());
 
@@ -2551,7 +2551,7 @@ AppendToExpr::AppendToExpr(ExprPtr arg_op1, ExprPtr arg_op2)
 	SetType(op1->GetType());
 	}
 
-ValPtr AppendToExpr::Eval(Frame* f) const
+ValPtr AppendToExpr::DoEval(Frame* f) const
 	{
 	auto v1 = op1->Eval(f);
 
@@ -2604,7 +2604,7 @@ IndexAssignExpr::IndexAssignExpr(ExprPtr arg_op1, ExprPtr arg_op2,
 	SetType(op3->GetType());
 	}
 
-ValPtr IndexAssignExpr::Eval(Frame* f) const
+ValPtr IndexAssignExpr::DoEval(Frame* f) const
 	{
 	auto v1 = op1->Eval(f);
 	auto v2 = op2->Eval(f);
@@ -2713,7 +2713,7 @@ FieldLHSAssignExpr::FieldLHSAssignExpr(ExprPtr arg_op1, ExprPtr arg_op2,
 	SetType(op2->GetType());
 	}
 
-ValPtr FieldLHSAssignExpr::Eval(Frame* f) const
+ValPtr FieldLHSAssignExpr::DoEval(Frame* f) const
 	{
 	auto v1 = op1->Eval(f);
 	auto v2 = op2->Eval(f);
@@ -2879,7 +2879,7 @@ void NopExpr::ExprDescribe(ODesc* d) const
 		d->Add("NOP");
 	}
 
-ValPtr NopExpr::Eval(Frame* /* f */) const
+ValPtr NopExpr::DoEval(Frame* /* f */) const
 	{
 	return nullptr;
 	}
@@ -14,6 +14,7 @@
 #include "zeek/script_opt/UseDefs.h"
 #include "zeek/script_opt/CPP/Compile.h"
 #include "zeek/script_opt/CPP/Func.h"
+#include "zeek/script_opt/ZAM/Compile.h"
 
 
 namespace zeek::detail {
@@ -46,7 +47,7 @@ void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf,
 	if ( analysis_options.only_func )
 		printf("Original: %s\n", obj_desc(body.get()).c_str());
 
-	if ( body->Tag() == STMT_CPP )
+	if ( body->Tag() == STMT_CPP || body->Tag() == STMT_ZAM )
 		// We're not able to optimize this.
 		return;
 
@@ -143,6 +144,21 @@ void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf,
 	if ( new_frame_size > f->FrameSize() )
 		f->SetFrameSize(new_frame_size);
 
+	if ( analysis_options.gen_ZAM_code )
+		{
+		ZAMCompiler zc(f, body);
+		auto zam_body = zc.Compile();
+
+		if ( zam_body )
+			{
+			if ( analysis_options.only_func || analysis_options.dump_ZAM )
+				printf("ZAM: %s\n", obj_desc(zam_body.get()).c_str());
+
+			f->ReplaceBody(body, zam_body);
+			body = zam_body;
+			}
+		}
+
 	pop_scope();
 	}
 
@@ -218,10 +234,14 @@ void analyze_scripts()
 		              analysis_options.gen_standalone_CPP);
 		check_env_opt("ZEEK_REPORT_CPP", analysis_options.report_CPP);
 		check_env_opt("ZEEK_USE_CPP", analysis_options.use_CPP);
+		check_env_opt("ZEEK_ZAM", analysis_options.gen_ZAM_code);
 
 		if ( analysis_options.gen_standalone_CPP )
 			analysis_options.gen_CPP = true;
 
+		if ( analysis_options.gen_ZAM_code )
+			analysis_options.optimize_AST = true;
+
 		if ( analysis_options.gen_CPP )
 			{
 			if ( analysis_options.add_CPP )
@@ -268,6 +288,7 @@ void analyze_scripts()
 
 		if ( analysis_options.only_func ||
 		     analysis_options.optimize_AST ||
+		     analysis_options.gen_ZAM_code ||
 		     analysis_options.usage_issues > 0 )
 			analysis_options.activate = true;
 
@@ -58,6 +58,12 @@ struct AnalyOpt {
 	// runs without including the associated scripts.
 	bool add_CPP = false;
 
+	// If true, compile script bodies to ZAM code.
+	bool gen_ZAM_code = false;
+
+	// If true, dump out the ZAM code of compiled bodies.
+	bool dump_ZAM = false;
+
 	// If true, use C++ bodies if available.
 	bool use_CPP = false;
 
@@ -0,0 +1,684 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/script_opt/ZAM/Compile.h"
+
+#include "zeek/Desc.h"
+#include "zeek/Expr.h"
+#include "zeek/Reporter.h"
+#include "zeek/Stmt.h"
+#include "zeek/Traverse.h"
+
+namespace zeek::detail {
+
+// The kinds of native values, which determine the ZVal member that
+// operations work on.
+enum NativeKind { NK_NONE, NK_INT, NK_COUNT, NK_DOUBLE };
+
+static NativeKind native_kind(const Type* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		return NK_INT;
+
+	case TYPE_COUNT:
+		return NK_COUNT;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		return NK_DOUBLE;
+
+	default:
+		return NK_NONE;
+	}
+	}
+
+static NativeKind native_kind(const Expr* e)
+	{
+	return native_kind(e->GetType().get());
+	}
+
+static ZOp by_kind(NativeKind k, ZOp op_i, ZOp op_u, ZOp op_d)
+	{
+	switch ( k ) {
+	case NK_INT:	return op_i;
+	case NK_COUNT:	return op_u;
+	case NK_DOUBLE:	return op_d;
+	default:	return OP_NOP;
+	}
+	}
+
+// Collects the locals an AST node refers to, noting which of them it
+// reads rather than just assigns to.
+class LocalRefs : public TraversalCallback {
+public:
+	TraversalCode PreStmt(const Stmt* s) override
+		{
+		// The value variable of a "for" loop is the one local
+		// that traversal doesn't get to.
+		if ( s->Tag() == STMT_FOR && s->AsForStmt()->ValueVar() )
+			Add(s->AsForStmt()->ValueVar().get(), false);
+
+		return TC_CONTINUE;
+		}
+
+	TraversalCode PreExpr(const Expr* e) override
+		{
+		if ( e->Tag() == EXPR_ASSIGN )
+			{
+			auto lhs = e->GetOp1();
+
+			if ( lhs->Tag() == EXPR_REF )
+				lhs = lhs->GetOp1();
+
+			if ( lhs->Tag() == EXPR_NAME )
+				targets.insert(lhs.get());
+			}
+
+		else if ( e->Tag() == EXPR_NAME )
+			{
+			Add(e->AsNameExpr()->Id(), targets.count(e) == 0);
+			return TC_ABORTSTMT;
+			}
+
+		return TC_CONTINUE;
+		}
+
+	TraversalCode PreID(const ID* id) override
+		{
+		// Loop variables and the like, which get assigned.
+		Add(id, false);
+		return TC_ABORTSTMT;
+		}
+
+	std::vector<const ID*> ids;
+	std::unordered_set<const ID*> read_ids;
+
+private:
+	void Add(const ID* id, bool is_read)
+		{
+		if ( id->IsGlobal() )
+			return;
+
+		if ( seen.insert(id).second )
+			ids.push_back(id);
+
+		if ( is_read )
+			read_ids.insert(id);
+		}
+
+	std::unordered_set<const ID*> seen;
+	std::unordered_set<const Expr*> targets;
+};
+
+ZAMCompiler::ZAMCompiler(const ScriptFunc* f, StmtPtr orig_body)
+	: func(f)
+	{
+	body = make_intrusive<ZBody>(f->Name(), std::move(orig_body));
+	}
+
+ZBodyPtr ZAMCompiler::Compile()
+	{
+	CompileStmt(body->OrigBody().get());
+	Emit(OP_EXIT_FLOW, FLOW_NEXT);
+
+	if ( num_native == 0 )
+		return nullptr;
+
+	for ( const auto& refs : sync_refs )
+		{
+		ZBody::SyncSet ss;
+
+		for ( auto id : refs.ids )
+			{
+			auto l = local_regs.find(id);
+			if ( l == local_regs.end() )
+				continue;
+
+			if ( refs.read_ids.count(id) > 0 )
+				ss.boxed.push_back(l->second);
+			else
+				ss.cleared.push_back(l->second);
+			}
+
+		body->sync_sets.emplace_back(std::move(ss));
+		}
+
+	int num_params = func->GetType()->Params()->NumFields();
+
+	for ( const auto& [id, r] : local_regs )
+		if ( id->Offset() < num_params )
+			body->param_regs.push_back(r);
+
+	return body;
+	}
+
+void ZAMCompiler::CompileStmt(const Stmt* s)
+	{
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+		for ( auto st : s->AsStmtList()->Stmts() )
+			CompileStmt(st);
+		break;
+
+	case STMT_NULL:
+		break;
+
+	case STMT_EXPR:
+		CompileExprStmt(s->AsExprStmt());
+		break;
+
+	case STMT_IF:
+		CompileIf(s->AsIfStmt());
+		break;
+
+	case STMT_WHILE:
+		CompileWhile(s->AsWhileStmt());
+		break;
+
+	case STMT_NEXT:
+		CompileLoopExit(s, false);
+		break;
+
+	case STMT_BREAK:
+		CompileLoopExit(s, true);
+		break;
+
+	case STMT_RETURN:
+		CompileReturn(s->AsReturnStmt());
+		break;
+
+	case STMT_CATCH_RETURN:
+		CompileCatchReturn(s->AsCatchReturnStmt());
+		break;
+
+	case STMT_INIT:
+		CompileInit(s->AsInitStmt());
+		break;
+
+	default:
+		CompileGeneric(s);
+		break;
+	}
+	}
+
+void ZAMCompiler::CompileExprStmt(const ExprStmt* s)
+	{
+	auto e = s->StmtExpr();
+
+	if ( e->Tag() == EXPR_ASSIGN )
+		{
+		auto lhs = e->GetOp1();
+
+		if ( lhs->Tag() == EXPR_REF )
+			lhs = lhs->GetOp1();
+
+		if ( lhs->Tag() == EXPR_NAME )
+			{
+			int r = LocalReg(lhs->AsNameExpr()->Id());
+			if ( r >= 0 )
+				{
+				CompileAssign(r, e->GetOp2().get());
+				return;
+				}
+			}
+		}
+
+	CompileGeneric(s);
+	}
+
+void ZAMCompiler::CompileIf(const IfStmt* s)
+	{
+	int to_false = CompileCondBranch(s->StmtExpr());
+
+	CompileStmt(s->TrueBranch());
+
+	auto false_branch = s->FalseBranch();
+
+	if ( false_branch && false_branch->Tag() != STMT_NULL )
+		{
+		int to_end = Emit(OP_GOTO);
+		SetTarget(to_false, NextInst());
+		CompileStmt(false_branch);
+		SetTarget(to_end, NextInst());
+		}
+	else
+		SetTarget(to_false, NextInst());
+	}
+
+void ZAMCompiler::CompileWhile(const WhileStmt* s)
+	{
+	int top = NextInst();
+
+	if ( auto pred = s->CondPredStmt() )
+		CompileStmt(pred.get());
+
+	int to_end = CompileCondBranch(s->Condition().get());
+
+	loops.push_back({top, {}, {}});
+	CompileStmt(s->Body().get());
+	SetTarget(Emit(OP_GOTO), top);
+
+	int end = NextInst();
+	SetTarget(to_end, end);
+
+	for ( auto i : loops.back().break_gotos )
+		SetTarget(i, end);
+
+	for ( auto i : loops.back().break_stmts )
+		body->insts[i].v2 = end;
+
+	loops.pop_back();
+	}
+
+void ZAMCompiler::CompileLoopExit(const Stmt* s, bool is_break)
+	{
+	if ( loops.empty() )
+		{
+		// Outside of a loop, the flow passes out of the body, as
+		// with "break" in a hook.
+		Emit(OP_EXIT_FLOW, is_break ? FLOW_BREAK : FLOW_LOOP);
+		return;
+		}
+
+	int i = Emit(OP_GOTO);
+
+	if ( is_break )
+		loops.back().break_gotos.push_back(i);
+	else
+		SetTarget(i, loops.back().top);
+	}
+
+void ZAMCompiler::CompileReturn(const ReturnStmt* s)
+	{
+	auto e = s->StmtExpr();
+
+	if ( ! catches.empty() )
+		{
+		auto& c = catches.back();
+
+		if ( e && c.ret_reg >= 0 )
+			CompileAssign(c.ret_reg, e);
+
+		c.exits.push_back(Emit(OP_GOTO));
+		return;
+		}
+
+	if ( ! e )
+		{
+		Emit(OP_EXIT_FLOW, FLOW_RETURN);
+		return;
+		}
+
+	int r = Operand(e);
+
+	if ( r >= 0 )
+		Emit(OP_RETURN, r);
+	else
+		CompileGeneric(s);
+	}
+
+void ZAMCompiler::CompileCatchReturn(const CatchReturnStmt* s)
+	{
+	int ret_reg = -1;
+
+	if ( auto rv = s->RetVar() )
+		{
+		ret_reg = LocalReg(rv->Id());
+
+		if ( ret_reg < 0 )
+			{
+			CompileGeneric(s);
+			return;
+			}
+		}
+
+	catches.push_back({ret_reg, {}});
+	CompileStmt(s->Block().get());
+
+	int end = NextInst();
+	for ( auto i : catches.back().exits )
+		SetTarget(i, end);
+
+	catches.pop_back();
+	}
+
+void ZAMCompiler::CompileInit(const InitStmt* s)
+	{
+	// The interpreter clears the frame slots of the native locals,
+	// which doesn't make the registers reload. Reset those, too, so
+	// that a re-declared local doesn't keep its previous value.
+	CompileGeneric(s);
+
+	for ( const auto& id : s->Inits() )
+		{
+		int r = LocalReg(id.get());
+		if ( r >= 0 )
+			Emit(OP_INIT, r);
+		}
+	}
+
+void ZAMCompiler::CompileGeneric(const Stmt* s)
+	{
+	int i = EmitGeneric(OP_EXEC_STMT, nullptr, s);
+	auto& z = body->insts[i];
+
+	if ( ! loops.empty() )
+		{
+		z.v1 = loops.back().top;
+		loops.back().break_stmts.push_back(i);
+		}
+
+	if ( ! catches.empty() )
+		{
+		catches.back().exits.push_back(i);
+		z.v4 = catches.back().ret_reg;
+		}
+	}
+
+void ZAMCompiler::CompileAssign(int r, const Expr* e)
+	{
+	if ( native_kind(e) == native_kind(body->reg_types[r].get()) )
+		{
+		int r_e = Operand(e);
+
+		if ( r_e >= 0 )
+			{
+			Emit(OP_ASSIGN, r, r_e);
+			++num_native;
+			return;
+			}
+
+		if ( CompileNativeOp(r, e) || CompileFieldLoad(r, e) )
+			{
+			++num_native;
+			return;
+			}
+		}
+
+	body->insts[EmitGeneric(OP_EVAL_EXPR, e, nullptr)].v1 = r;
+	}
+
+bool ZAMCompiler::CompileNativeOp(int r, const Expr* e)
+	{
+	auto op1 = e->GetOp1();
+	auto op2 = e->GetOp2();
+
+	if ( ! op1 )
+		return false;
+
+	int r1 = Operand(op1.get());
+	if ( r1 < 0 )
+		return false;
+
+	auto k = native_kind(e);
+	auto k1 = native_kind(op1.get());
+
+	if ( ! op2 )
+		{
+		ZOp op = OP_NOP;
+
+		switch ( e->Tag() ) {
+		case EXPR_NOT:
+			if ( k1 == NK_INT )
+				op = OP_NOT_I;
+			break;
+
+		case EXPR_NEGATE:
+			if ( k1 == k )
+				op = by_kind(k, OP_NEGATE_I, OP_NOP, OP_NEGATE_D);
+			break;
+
+		case EXPR_ARITH_COERCE:
+			if ( k == NK_DOUBLE )
+				op = by_kind(k1, OP_COERCE_ID, OP_COERCE_UD, OP_NOP);
+			break;
+
+		default:
+			break;
+		}
+
+		if ( op == OP_NOP )
+			return false;
+
+		Emit(op, r, r1, -1, e);
+		return true;
+		}
+
+	int r2 = Operand(op2.get());
+	if ( r2 < 0 || native_kind(op2.get()) != k1 )
+		return false;
+
+	ZOp op = OP_NOP;
+	bool is_cmp = false;
+	bool swap = false;
+
+	switch ( e->Tag() ) {
+	case EXPR_ADD:
+		op = by_kind(k1, OP_ADD_I, OP_ADD_U, OP_ADD_D);
+		break;
+
+	case EXPR_SUB:
+		op = by_kind(k1, OP_SUB_I, OP_SUB_U, OP_SUB_D);
+		break;
+
+	case EXPR_TIMES:
+		op = by_kind(k1, OP_TIMES_I, OP_TIMES_U, OP_TIMES_D);
+		break;
+
+	case EXPR_DIVIDE:
+		op = by_kind(k1, OP_DIVIDE_I, OP_DIVIDE_U, OP_DIVIDE_D);
+		break;
+
+	case EXPR_MOD:
+		op = by_kind(k1, OP_MOD_I, OP_MOD_U, OP_NOP);
+		break;
+
+	case EXPR_AND:
+		op = by_kind(k1, OP_NOP, OP_AND_U, OP_NOP);
+		break;
+
+	case EXPR_OR:
+		op = by_kind(k1, OP_NOP, OP_OR_U, OP_NOP);
+		break;
+
+	case EXPR_XOR:
+		op = by_kind(k1, OP_NOP, OP_XOR_U, OP_NOP);
+		break;
+
+	case EXPR_GT:
+		swap = true;
+		// fall through
+	case EXPR_LT:
+		op = by_kind(k1, OP_LT_I, OP_LT_U, OP_LT_D);
+		is_cmp = true;
+		break;
+
+	case EXPR_GE:
+		swap = true;
+		// fall through
+	case EXPR_LE:
+		op = by_kind(k1, OP_LE_I, OP_LE_U, OP_LE_D);
+		is_cmp = true;
+		break;
+
+	case EXPR_EQ:
+		op = by_kind(k1, OP_EQ_I, OP_EQ_U, OP_EQ_D);
+		is_cmp = true;
+		break;
+
+	case EXPR_NE:
+		op = by_kind(k1, OP_NE_I, OP_NE_U, OP_NE_D);
+		is_cmp = true;
+		break;
+
+	default:
+		break;
+	}
+
+	// Arithmetic stays within its kind; comparisons yield bools.
+	if ( op == OP_NOP || (is_cmp ? k != NK_INT : k != k1) )
+		return false;
+
+	if ( swap )
+		std::swap(r1, r2);
+
+	Emit(op, r, r1, r2, e);
+	return true;
+	}
+
+int ZAMCompiler::CompileCondBranch(const Expr* cond)
+	{
+	int r = Operand(cond);
+
+	if ( r >= 0 && native_kind(cond) == NK_INT )
+		{
+		++num_native;
+		return Emit(OP_IF_FALSE, r, -1, -1, cond);
+		}
+
+	auto op1 = cond->GetOp1();
+	auto op2 = cond->GetOp2();
+
+	if ( op1 && op2 )
+		{
+		int r1 = Operand(op1.get());
+		int r2 = Operand(op2.get());
+		auto k = native_kind(op1.get());
+
+		if ( r1 >= 0 && r2 >= 0 && native_kind(op2.get()) == k )
+			{
+			ZOp op = OP_NOP;
+			bool swap = false;
+
+			switch ( cond->Tag() ) {
+			case EXPR_GT:
+				swap = true;
+				// fall through
+			case EXPR_LT:
+				op = by_kind(k, OP_IF_NOT_LT_I, OP_IF_NOT_LT_U,
+				             OP_IF_NOT_LT_D);
+				break;
+
+			case EXPR_GE:
+				swap = true;
+				// fall through
+			case EXPR_LE:
+				op = by_kind(k, OP_IF_NOT_LE_I, OP_IF_NOT_LE_U,
+				             OP_IF_NOT_LE_D);
+				break;
+
+			case EXPR_EQ:
+				op = by_kind(k, OP_IF_NOT_EQ_I, OP_IF_NOT_EQ_U,
+				             OP_IF_NOT_EQ_D);
+				break;
+
+			case EXPR_NE:
+				op = by_kind(k, OP_IF_NOT_NE_I, OP_IF_NOT_NE_U,
+				             OP_IF_NOT_NE_D);
+				break;
+
+			default:
+				break;
+			}
+
+			if ( op != OP_NOP )
+				{
+				if ( swap )
+					std::swap(r1, r2);
+
+				++num_native;
+				return Emit(op, r1, r2, -1, cond);
+				}
+			}
+		}
+
+	return EmitGeneric(OP_EVAL_COND, cond, nullptr);
+	}
+
+bool ZAMCompiler::CompileFieldLoad(int r, const Expr* e)
+	{
+	if ( e->Tag() != EXPR_FIELD || e->GetOp1()->Tag() != EXPR_NAME )
+		return false;
+
+	auto id = e->GetOp1()->AsNameExpr()->Id();
+	auto field = static_cast<const FieldExpr*>(e)->Field();
+
+	// Records aren't kept in registers, so the local's frame slot
+	// is always current.
+	if ( id->IsGlobal() || field < 0 )
+		return false;
+
+	Emit(OP_FIELD_LOAD, r, id->Offset(), field, e);
+	return true;
+	}
+
+int ZAMCompiler::LocalReg(const ID* id)
+	{
+	auto l = local_regs.find(id);
+	if ( l != local_regs.end() )
+		return l->second;
+
+	if ( id->IsGlobal() || native_kind(id->GetType().get()) == NK_NONE )
+		return -1;
+
+	int r = body->init_regs.size();
+	body->init_regs.emplace_back();
+	body->reg_types.push_back(id->GetType());
+	body->reg_slots.push_back(id->Offset());
+	local_regs[id] = r;
+
+	return r;
+	}
+
+int ZAMCompiler::Operand(const Expr* e)
+	{
+	if ( e->Tag() == EXPR_NAME )
+		return LocalReg(e->AsNameExpr()->Id());
+
+	if ( e->Tag() != EXPR_CONST || native_kind(e) == NK_NONE )
+		return -1;
+
+	auto v = e->AsConstExpr()->ValuePtr();
+
+	int r = body->init_regs.size();
+	body->init_regs.emplace_back(v, e->GetType());
+	body->reg_types.push_back(e->GetType());
+	body->reg_slots.push_back(-1);
+
+	return r;
+	}
+
+int ZAMCompiler::Emit(ZOp op, int v1, int v2, int v3, const Expr* e)
+	{
+	ZInst z;
+	z.op = op;
+	z.v1 = v1;
+	z.v2 = v2;
+	z.v3 = v3;
+	z.e = e;
+
+	body->insts.push_back(z);
+	return NextInst() - 1;
+	}
+
+int ZAMCompiler::EmitGeneric(ZOp op, const Expr* e, const Stmt* s)
+	{
+	LocalRefs refs;
+
+	if ( e )
+		e->Traverse(&refs);
+	else
+		s->Traverse(&refs);
+
+	int i = Emit(op, -1, -1, -1, e);
+	auto& z = body->insts[i];
+	z.s = const_cast<Stmt*>(s);
+	z.sync = sync_refs.size();
+	sync_refs.push_back({std::move(refs.ids), std::move(refs.read_ids)});
+
+	return i;
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,107 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Compiles reduced script bodies to ZAM code.
+//
+// Locals of native type (bool, int, count, double, time, interval) live
+// in registers, and statements and expressions that only involve those
+// compile to ZAM operations.  Everything else is left to the interpreter
+// via generic operations, which keep the frame and the registers in sync
+// for the locals they refer to.
+
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "zeek/Func.h"
+#include "zeek/script_opt/ZAM/ZBody.h"
+
+namespace zeek::detail {
+
+class ZAMCompiler {
+public:
+	ZAMCompiler(const ScriptFunc* f, StmtPtr body);
+
+	// Returns the compiled body, or nil if compiling wouldn't gain
+	// anything because no part of the body runs natively.
+	ZBodyPtr Compile();
+
+private:
+	void CompileStmt(const Stmt* s);
+	void CompileExprStmt(const ExprStmt* s);
+	void CompileIf(const IfStmt* s);
+	void CompileWhile(const WhileStmt* s);
+	void CompileReturn(const ReturnStmt* s);
+	void CompileCatchReturn(const CatchReturnStmt* s);
+	void CompileLoopExit(const Stmt* s, bool is_break);
+	void CompileInit(const InitStmt* s);
+	void CompileGeneric(const Stmt* s);
+
+	// Emits code that assigns the value of e to register r.
+	void CompileAssign(int r, const Expr* e);
+
+	// Emits a native operation computing e into register r.  Returns
+	// false if e doesn't have one.
+	bool CompileNativeOp(int r, const Expr* e);
+
+	// Emits a load of a field of a local record into register r, with
+	// the field found at its fixed offset.  Returns false if e isn't
+	// such an access.
+	bool CompileFieldLoad(int r, const Expr* e);
+
+	// Emits code that jumps if the condition is false.  Returns the
+	// instruction whose target to set.
+	int CompileCondBranch(const Expr* cond);
+
+	// Returns the register of a native local, or -1 if the ID is not
+	// such.
+	int LocalReg(const ID* id);
+
+	// Returns the register holding the value of a native local or
+	// constant, or -1 if the expression is not such.
+	int Operand(const Expr* e);
+
+	int Emit(ZOp op, int v1 = -1, int v2 = -1, int v3 = -1,
+	         const Expr* e = nullptr);
+
+	// Emits a generic operation for the given AST node.
+	int EmitGeneric(ZOp op, const Expr* e, const Stmt* s);
+
+	void SetTarget(int inst, int target)	{ body->insts[inst].v3 = target; }
+	int NextInst() const	{ return body->insts.size(); }
+
+	const ScriptFunc* func;
+	ZBodyPtr body;
+
+	std::unordered_map<const ID*, int> local_regs;
+
+	// For each sync set, the locals it covers.  These only get mapped
+	// to registers once compilation has seen all of the native locals.
+	// Reads are kept apart from locals that are only assigned to.
+	struct SyncRefs {
+		std::vector<const ID*> ids;
+		std::unordered_set<const ID*> read_ids;
+	};
+
+	std::vector<SyncRefs> sync_refs;
+
+	struct LoopInfo {
+		int top;
+		std::vector<int> break_gotos;
+		std::vector<int> break_stmts;
+	};
+
+	// Inlined blocks catch "return" statements.
+	struct CatchInfo {
+		int ret_reg;
+		std::vector<int> exits;
+	};
+
+	std::vector<LoopInfo> loops;
+	std::vector<CatchInfo> catches;
+
+	int num_native = 0;
+};
+
+} // namespace zeek::detail
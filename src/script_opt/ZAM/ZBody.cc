@@ -0,0 +1,393 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/script_opt/ZAM/ZBody.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "zeek/Desc.h"
+#include "zeek/Expr.h"
+#include "zeek/Frame.h"
+#include "zeek/Reporter.h"
+#include "zeek/Traverse.h"
+
+namespace zeek::detail {
+
+const char* ZOpName(ZOp op)
+	{
+	static const char* op_names[NUM_ZOPS] = {
+#define ZAM_OP_NAME(name) #name,
+		ZAM_OPS(ZAM_OP_NAME)
+#undef ZAM_OP_NAME
+	};
+
+	return op_names[op];
+	}
+
+ZBody::ZBody(std::string _func_name, StmtPtr _orig_body)
+	: Stmt(STMT_ZAM), func_name(std::move(_func_name)),
+	  orig_body(std::move(_orig_body))
+	{
+	SetOriginal(orig_body);
+	}
+
+// The register files of active bodies form a stack that grows as calls
+// nest.  Its memory comes in chunks that stay around once allocated, so
+// setting up the registers of a call usually just moves the top.
+class RegisterStack {
+public:
+	struct Mark {
+		size_t chunk;
+		size_t top;
+	};
+
+	ZVal* Push(size_t n, Mark* mark)
+		{
+		*mark = {cur, top};
+
+		if ( cur < chunks.size() && top + n <= chunks[cur].size )
+			{
+			auto regs = chunks[cur].regs.get() + top;
+			top += n;
+			return regs;
+			}
+
+		// Start a new chunk.  Everything past the current one is
+		// unused, so one that's too small can simply be replaced.
+		if ( cur < chunks.size() )
+			++cur;
+
+		if ( cur == chunks.size() )
+			chunks.emplace_back();
+
+		auto& c = chunks[cur];
+
+		if ( c.size < n )
+			{
+			c.size = std::max(n, CHUNK_SIZE);
+			c.regs = std::make_unique<ZVal[]>(c.size);
+			}
+
+		top = n;
+		return c.regs.get();
+		}
+
+	void Pop(const Mark& mark)
+		{
+		cur = mark.chunk;
+		top = mark.top;
+		}
+
+private:
+	static constexpr size_t CHUNK_SIZE = 4096;
+
+	struct Chunk {
+		std::unique_ptr<ZVal[]> regs;
+		size_t size = 0;
+	};
+
+	std::vector<Chunk> chunks;
+	size_t cur = 0;
+	size_t top = 0;
+};
+
+static RegisterStack register_stack;
+
+// Takes a register file off the stack for the lifetime of a call,
+// including when it ends by exception.
+class RegisterFile {
+public:
+	RegisterFile(size_t n)	{ regs = register_stack.Push(n, &mark); }
+	~RegisterFile()		{ register_stack.Pop(mark); }
+
+	ZVal* Regs() const	{ return regs; }
+
+private:
+	ZVal* regs;
+	RegisterStack::Mark mark;
+};
+
+void ZBody::SyncToFrame(Frame* f, const ZVal* regs, int sync) const
+	{
+	const auto& s = sync_sets[sync];
+
+	for ( auto r : s.boxed )
+		f->SetElement(reg_slots[r], regs[r].ToVal(reg_types[r]));
+
+	for ( auto r : s.cleared )
+		f->SetElement(reg_slots[r], nullptr);
+	}
+
+void ZBody::SyncFromFrame(Frame* f, ZVal* regs, int sync) const
+	{
+	const auto& s = sync_sets[sync];
+
+	for ( const auto& rs : {&s.boxed, &s.cleared} )
+		for ( auto r : *rs )
+			{
+			const auto& v = f->GetElement(reg_slots[r]);
+			if ( v )
+				regs[r] = ZVal(v, reg_types[r]);
+			}
+	}
+
+ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow)
+	{
+	RegisterAccess();
+	flow = FLOW_NEXT;
+
+	RegisterFile reg_file(init_regs.size());
+	ZVal* regs = reg_file.Regs();
+
+	std::copy(init_regs.begin(), init_regs.end(), regs);
+
+	for ( auto r : param_regs )
+		{
+		const auto& v = f->GetElement(reg_slots[r]);
+		if ( v )
+			regs[r] = ZVal(v, reg_types[r]);
+		}
+
+	const ZInst* code = insts.data();
+	int pc = 0;
+
+#define ZAM_BINARY(name, accessor, op) \
+	case OP_ ## name: \
+		regs[z.v1] = ZVal(regs[z.v2].accessor() op regs[z.v3].accessor()); \
+		break;
+
+#define ZAM_COMPARE(name, accessor, op) \
+	case OP_ ## name: \
+		regs[z.v1] = ZVal(bro_int_t(regs[z.v2].accessor() op regs[z.v3].accessor())); \
+		break; \
+	case OP_IF_NOT_ ## name: \
+		if ( ! (regs[z.v1].accessor() op regs[z.v2].accessor()) ) \
+			pc = z.v3; \
+		break;
+
+#define ZAM_DIVIDE(name, accessor, op, what) \
+	case OP_ ## name: \
+		if ( regs[z.v3].accessor() == 0 ) \
+			reporter->ExprRuntimeError(z.e, what " by zero"); \
+		regs[z.v1] = ZVal(regs[z.v2].accessor() op regs[z.v3].accessor()); \
+		break;
+
+	for ( ; ; )
+		{
+		const ZInst& z = code[pc++];
+
+		switch ( z.op ) {
+		case OP_NOP:
+			break;
+
+		case OP_ASSIGN:
+			regs[z.v1] = regs[z.v2];
+			break;
+
+		ZAM_BINARY(ADD_I, AsInt, +)
+		ZAM_BINARY(ADD_U, AsCount, +)
+		ZAM_BINARY(ADD_D, AsDouble, +)
+		ZAM_BINARY(SUB_I, AsInt, -)
+		ZAM_BINARY(SUB_U, AsCount, -)
+		ZAM_BINARY(SUB_D, AsDouble, -)
+		ZAM_BINARY(TIMES_I, AsInt, *)
+		ZAM_BINARY(TIMES_U, AsCount, *)
+		ZAM_BINARY(TIMES_D, AsDouble, *)
+		ZAM_BINARY(AND_U, AsCount, &)
+		ZAM_BINARY(OR_U, AsCount, |)
+		ZAM_BINARY(XOR_U, AsCount, ^)
+
+		ZAM_DIVIDE(DIVIDE_I, AsInt, /, "division")
+		ZAM_DIVIDE(DIVIDE_U, AsCount, /, "division")
+		ZAM_DIVIDE(DIVIDE_D, AsDouble, /, "division")
+		ZAM_DIVIDE(MOD_I, AsInt, %, "modulo")
+		ZAM_DIVIDE(MOD_U, AsCount, %, "modulo")
+
+		ZAM_COMPARE(LT_I, AsInt, <)
+		ZAM_COMPARE(LT_U, AsCount, <)
+		ZAM_COMPARE(LT_D, AsDouble, <)
+		ZAM_COMPARE(LE_I, AsInt, <=)
+		ZAM_COMPARE(LE_U, AsCount, <=)
+		ZAM_COMPARE(LE_D, AsDouble, <=)
+		ZAM_COMPARE(EQ_I, AsInt, ==)
+		ZAM_COMPARE(EQ_U, AsCount, ==)
+		ZAM_COMPARE(EQ_D, AsDouble, ==)
+		ZAM_COMPARE(NE_I, AsInt, !=)
+		ZAM_COMPARE(NE_U, AsCount, !=)
+		ZAM_COMPARE(NE_D, AsDouble, !=)
+
+		case OP_NOT_I:
+			regs[z.v1] = ZVal(bro_int_t(! regs[z.v2].AsInt()));
+			break;
+
+		case OP_NEGATE_I:
+			regs[z.v1] = ZVal(- regs[z.v2].AsInt());
+			break;
+
+		case OP_NEGATE_D:
+			regs[z.v1] = ZVal(- regs[z.v2].AsDouble());
+			break;
+
+		case OP_COERCE_ID:
+			regs[z.v1] = ZVal(double(regs[z.v2].AsInt()));
+			break;
+
+		case OP_COERCE_UD:
+			regs[z.v1] = ZVal(double(regs[z.v2].AsCount()));
+			break;
+
+		case OP_FIELD_LOAD:
+			{
+			const auto& rv = f->GetElement(z.v2);
+
+			if ( rv && rv->AsRecordVal()->HasField(z.v3) )
+				regs[z.v1] = rv->AsRecordVal()->RawField(z.v3);
+
+			// Leave &default's and errors to the interpreter.
+			else if ( auto v = z.e->Eval(f) )
+				regs[z.v1] = ZVal(v, reg_types[z.v1]);
+			}
+			break;
+
+		case OP_INIT:
+			regs[z.v1] = ZVal();
+			break;
+
+		case OP_GOTO:
+			pc = z.v3;
+			break;
+
+		case OP_IF_FALSE:
+			if ( ! regs[z.v1].AsInt() )
+				pc = z.v3;
+			break;
+
+		case OP_EVAL_EXPR:
+			{
+			SyncToFrame(f, regs, z.sync);
+			auto v = z.e->Eval(f);
+			SyncFromFrame(f, regs, z.sync);
+
+			if ( v )
+				regs[z.v1] = ZVal(v, reg_types[z.v1]);
+			}
+			break;
+
+		case OP_EVAL_COND:
+			{
+			SyncToFrame(f, regs, z.sync);
+			auto v = z.e->Eval(f);
+			SyncFromFrame(f, regs, z.sync);
+
+			if ( ! v || v->IsZero() )
+				pc = z.v3;
+			}
+			break;
+
+		case OP_EXEC_STMT:
+			{
+			SyncToFrame(f, regs, z.sync);
+			auto v = z.s->Exec(f, flow);
+			SyncFromFrame(f, regs, z.sync);
+
+			if ( f->HasDelayed() )
+				return nullptr;
+
+			if ( flow == FLOW_NEXT || flow == FLOW_FALLTHROUGH )
+				break;
+
+			int target;
+
+			if ( flow == FLOW_LOOP )
+				target = z.v1;
+			else if ( flow == FLOW_BREAK )
+				target = z.v2;
+			else
+				{
+				target = z.v3;
+				if ( target >= 0 && z.v4 >= 0 && v )
+					regs[z.v4] = ZVal(v, reg_types[z.v4]);
+				}
+
+			if ( target < 0 )
+				return v;
+
+			flow = FLOW_NEXT;
+			pc = target;
+			}
+			break;
+
+		case OP_RETURN:
+			flow = FLOW_RETURN;
+			return regs[z.v1].ToVal(reg_types[z.v1]);
+
+		case OP_EXIT_FLOW:
+			flow = static_cast<StmtFlowType>(z.v1);
+			return nullptr;
+
+		default:
+			reporter->InternalError("bad ZAM operation %d", z.op);
+		}
+		}
+
+#undef ZAM_BINARY
+#undef ZAM_COMPARE
+#undef ZAM_DIVIDE
+	}
+
+void ZBody::StmtDescribe(ODesc* d) const
+	{
+	Stmt::StmtDescribe(d);
+	d->Add(func_name.c_str());
+
+	if ( ! d->IsReadable() )
+		return;
+
+	d->AddSP(":");
+	d->Add(NumInsts());
+	d->AddSP(" instructions,");
+	d->Add(NumRegs());
+	d->Add(" registers");
+	d->NL();
+
+	for ( auto i = 0; i < NumInsts(); ++i )
+		{
+		const auto& z = insts[i];
+
+		d->Add(i);
+		d->AddSP(":");
+		d->Add(ZOpName(z.op));
+
+		for ( auto v : {z.v1, z.v2, z.v3, z.v4} )
+			if ( v >= 0 )
+				{
+				d->SP();
+				d->Add(v);
+				}
+
+		if ( z.e )
+			{
+			d->AddSP(" #");
+			z.e->Describe(d);
+			}
+
+		else if ( z.s && z.s->Tag() != STMT_LIST )
+			{
+			d->AddSP(" #");
+			d->Add(stmt_name(z.s->Tag()));
+			}
+
+		d->NL();
+		}
+	}
+
+TraversalCode ZBody::Traverse(TraversalCallback* cb) const
+	{
+	TraversalCode tc = cb->PreStmt(this);
+	HANDLE_TC_STMT_PRE(tc);
+
+	tc = cb->PostStmt(this);
+	HANDLE_TC_STMT_POST(tc);
+	}
+
+} // namespace zeek::detail
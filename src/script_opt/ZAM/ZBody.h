@@ -0,0 +1,77 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A Stmt subclass that replaces a function/event handler/hook body with
+// its ZAM code.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "zeek/Stmt.h"
+#include "zeek/ZVal.h"
+#include "zeek/script_opt/ZAM/ZInst.h"
+
+namespace zeek::detail {
+
+class ZBody : public Stmt {
+public:
+	ZBody(std::string func_name, StmtPtr orig_body);
+
+	const std::string& FuncName() const	{ return func_name; }
+
+	// The reduced body the code was compiled from.
+	const StmtPtr& OrigBody() const		{ return orig_body; }
+
+	int NumInsts() const	{ return insts.size(); }
+	int NumRegs() const	{ return init_regs.size(); }
+
+	ValPtr Exec(Frame* f, StmtFlowType& flow) override;
+
+	void StmtDescribe(ODesc* d) const override;
+
+	TraversalCode Traverse(TraversalCallback* cb) const override;
+
+protected:
+	friend class ZAMCompiler;
+
+	// Like compiled C++ bodies, ZAM bodies are created after inlining
+	// and so never duplicated.
+	StmtPtr Duplicate() override	{ ASSERT(0); return ThisPtr(); }
+
+	// Writes the given registers to their frame slots, or reads them
+	// back from there.
+	void SyncToFrame(Frame* f, const ZVal* regs, int sync) const;
+	void SyncFromFrame(Frame* f, ZVal* regs, int sync) const;
+
+	std::string func_name;
+	StmtPtr orig_body;
+
+	std::vector<ZInst> insts;
+
+	// Per register, its type, and for those holding locals the frame
+	// slot of the local (-1 for constants).
+	std::vector<TypePtr> reg_types;
+	std::vector<int> reg_slots;
+
+	// The register file at entry: constants in place, zero elsewhere.
+	std::vector<ZVal> init_regs;
+
+	// The registers of parameters, loaded from the frame at entry.
+	std::vector<int> param_regs;
+
+	// Registers to synchronize with the frame around generic operations.
+	// Only the locals the operation reads get boxed into the frame.
+	// Those it merely assigns to have their slots cleared instead, so
+	// that afterwards a value in the slot means a new one to reload.
+	struct SyncSet {
+		std::vector<int> boxed;
+		std::vector<int> cleared;
+	};
+
+	std::vector<SyncSet> sync_sets;
+};
+
+using ZBodyPtr = IntrusivePtr<ZBody>;
+
+} // namespace zeek::detail
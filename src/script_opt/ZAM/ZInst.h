@@ -0,0 +1,97 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Instructions for ZAM, the "Zeek Abstract Machine": a register machine
+// over ZVal's that executes reduced script bodies.
+
+#pragma once
+
+namespace zeek::detail {
+
+class Expr;
+class Stmt;
+
+// The operations.  Those specific to a kind of native value carry a
+// suffix: _I for bool and int, _U for count, and _D for double, time
+// and interval.  Comparisons for ">" and ">=" are expressed by swapping
+// the operands of "<" and "<=".
+#define ZAM_OPS(X) \
+	X(NOP) \
+	X(ASSIGN) \
+	X(ADD_I) X(ADD_U) X(ADD_D) \
+	X(SUB_I) X(SUB_U) X(SUB_D) \
+	X(TIMES_I) X(TIMES_U) X(TIMES_D) \
+	X(DIVIDE_I) X(DIVIDE_U) X(DIVIDE_D) \
+	X(MOD_I) X(MOD_U) \
+	X(AND_U) X(OR_U) X(XOR_U) \
+	X(LT_I) X(LT_U) X(LT_D) \
+	X(LE_I) X(LE_U) X(LE_D) \
+	X(EQ_I) X(EQ_U) X(EQ_D) \
+	X(NE_I) X(NE_U) X(NE_D) \
+	X(NOT_I) X(NEGATE_I) X(NEGATE_D) \
+	X(COERCE_ID) X(COERCE_UD) \
+	X(FIELD_LOAD) \
+	X(INIT) \
+	X(GOTO) \
+	X(IF_FALSE) \
+	X(IF_NOT_LT_I) X(IF_NOT_LT_U) X(IF_NOT_LT_D) \
+	X(IF_NOT_LE_I) X(IF_NOT_LE_U) X(IF_NOT_LE_D) \
+	X(IF_NOT_EQ_I) X(IF_NOT_EQ_U) X(IF_NOT_EQ_D) \
+	X(IF_NOT_NE_I) X(IF_NOT_NE_U) X(IF_NOT_NE_D) \
+	X(EVAL_EXPR) \
+	X(EVAL_COND) \
+	X(EXEC_STMT) \
+	X(RETURN) \
+	X(EXIT_FLOW)
+
+enum ZOp {
+#define ZAM_OP_ENUM(name) OP_ ## name,
+	ZAM_OPS(ZAM_OP_ENUM)
+#undef ZAM_OP_ENUM
+	NUM_ZOPS
+};
+
+extern const char* ZOpName(ZOp op);
+
+// Operand usage:
+//
+//	ASSIGN			v1 = v2
+//	binary operations	v1 = v2 <op> v3
+//	unary operations	v1 = <op> v2
+//	FIELD_LOAD		v1 = field v3 of the record in frame slot v2,
+//				evaluating e instead if the field is missing
+//	INIT			v1 = zero, as at entry
+//	GOTO			jump to v3
+//	IF_FALSE		if ( ! v1 ) jump to v3
+//	IF_NOT_<cmp>		if ( ! (v1 <cmp> v2) ) jump to v3
+//	EVAL_EXPR		v1 = value of e
+//	EVAL_COND		if ( ! value of e ) jump to v3
+//	EXEC_STMT		execute s, then continue at v1 if it did a
+//				"next", at v2 if it did a "break", and at v3
+//				if it returned from an inlined block, with the
+//				value going into v4 (for each, -1 means the
+//				flow passes out of the body instead)
+//	RETURN			return v1
+//	EXIT_FLOW		return nothing, with flow type v1
+//
+// The generic operations (EVAL_EXPR, EVAL_COND and EXEC_STMT) run their
+// AST node with the interpreter.  Around that, they synchronize the
+// frame with the registers of the locals the node refers to, as listed
+// in the body's sync set "sync".
+
+struct ZInst {
+	ZOp op = OP_NOP;
+
+	int v1 = -1;
+	int v2 = -1;
+	int v3 = -1;
+	int v4 = -1;
+
+	// The AST node a generic operation runs, or that run-time errors
+	// get reported against.
+	const Expr* e = nullptr;
+	Stmt* s = nullptr;
+
+	int sync = -1;
+};
+
+} // namespace zeek::detail
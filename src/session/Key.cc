@@ -1,42 +1,35 @@
 #include "zeek/session/Key.h"
 
 #include <cstring>
+#include <utility>
+
+#include "zeek/3rdparty/doctest.h"
+
+#include "zeek/Hash.h"
 
 namespace zeek::session::detail {
 
 Key::Key(const void* session, size_t size, size_t type, bool copy) :
-	size(size), type(type)
+	type(type), size(size)
 	{
 	data = reinterpret_cast<const uint8_t*>(session);
+	hash = zeek::detail::KeyedHash::Hash64(data, size);
 
 	if ( copy )
 		CopyData();
-
-	copied = copy;
 	}
 
-Key::Key(Key&& rhs)
+Key::Key(Key&& rhs) noexcept
 	{
-	data = rhs.data;
-	size = rhs.size;
-	copied = rhs.copied;
-
-	rhs.data = nullptr;
-	rhs.size = 0;
-	rhs.copied = false;
+	MoveFrom(rhs);
 	}
 
-Key& Key::operator=(Key&& rhs)
+Key& Key::operator=(Key&& rhs) noexcept
 	{
 	if ( this != &rhs )
 		{
-		data = rhs.data;
-		size = rhs.size;
-		copied = rhs.copied;
-
-		rhs.data = nullptr;
-		rhs.size = 0;
-		rhs.copied = false;
+		Release();
+		MoveFrom(rhs);
 		}
 
 	return *this;
@@ -44,20 +37,58 @@ Key& Key::operator=(Key&& rhs)
 
 Key::~Key()
 	{
-	if ( copied )
+	Release();
+	}
+
+void Key::MoveFrom(Key& rhs)
+	{
+	data = rhs.data;
+	hash = rhs.hash;
+	type = rhs.type;
+	size = rhs.size;
+	storage = rhs.storage;
+
+	if ( storage == Storage::Inline )
+		memcpy(inline_data, rhs.inline_data, size);
+
+	rhs.data = nullptr;
+	rhs.hash = 0;
+	rhs.size = 0;
+	rhs.storage = Storage::Borrowed;
+	}
+
+void Key::Release()
+	{
+	if ( storage == Storage::Heap )
 		delete [] data;
+
+	data = nullptr;
+	storage = Storage::Borrowed;
 	}
 
 void Key::CopyData()
 	{
-	if ( copied )
+	if ( storage != Storage::Borrowed )
 		return;
 
-	copied = true;
+	if ( size <= MAX_INLINE_SIZE )
+		{
+		memcpy(inline_data, data, size);
+		data = nullptr;
+		storage = Storage::Inline;
+		return;
+		}
 
 	uint8_t *temp = new uint8_t[size];
 	memcpy(temp, data, size);
 	data = temp;
+	storage = Storage::Heap;
+	}
+
+bool Key::Matches(const void* key_data, size_t arg_size, size_t arg_type) const
+	{
+	return size == arg_size && type == arg_type &&
+		memcmp(Data(), key_data, size) == 0;
 	}
 
 bool Key::operator<(const Key& rhs) const
@@ -67,7 +98,53 @@ bool Key::operator<(const Key& rhs) const
 	else if ( type != rhs.type )
 		return type < rhs.type;
 
-	return memcmp(data, rhs.data, size) < 0;
+	return memcmp(Data(), rhs.Data(), size) < 0;
+	}
+
+bool Key::operator==(const Key& rhs) const
+	{
+	return hash == rhs.hash && size == rhs.size && type == rhs.type &&
+		memcmp(Data(), rhs.Data(), size) == 0;
+	}
+
+TEST_CASE("session key inline copy")
+	{
+	uint8_t buf[16];
+	uint8_t orig[16];
+	memset(buf, 0x2a, sizeof(buf));
+	memset(orig, 0x2a, sizeof(orig));
+
+	Key borrowed(buf, sizeof(buf), Key::CONNECTION_KEY_TYPE);
+	Key copied(buf, sizeof(buf), Key::CONNECTION_KEY_TYPE, true);
+	CHECK(borrowed == copied);
+	CHECK(borrowed.Hash() == copied.Hash());
+
+	// The copy must not depend on the original memory anymore.
+	buf[0] = 0;
+	Key lookup(orig, sizeof(orig), Key::CONNECTION_KEY_TYPE);
+	CHECK(copied == lookup);
+
+	Key moved(std::move(copied));
+	CHECK(moved == lookup);
+
+	Key other_type(orig, sizeof(orig), 1);
+	CHECK(other_type != lookup);
+	}
+
+TEST_CASE("session key heap copy")
+	{
+	uint8_t buf[Key::MAX_INLINE_SIZE * 2];
+	memset(buf, 0x17, sizeof(buf));
+
+	Key copied(buf, sizeof(buf), Key::CONNECTION_KEY_TYPE, true);
+	Key lookup(buf, sizeof(buf), Key::CONNECTION_KEY_TYPE);
+	CHECK(copied == lookup);
+
+	Key moved(buf, 1, 1);
+	moved = std::move(copied);
+	CHECK(moved == lookup);
+	CHECK(moved.Matches(buf, sizeof(buf), Key::CONNECTION_KEY_TYPE));
+	CHECK_FALSE(moved.Matches(buf, sizeof(buf), 1));
 	}
 
 } // namespace zeek::session::detail
@@ -8,20 +8,30 @@
 namespace zeek::session::detail {
 
 /**
- * This type is used as the key for the map in SessionManager. It represents a
- * raw block of memory that points to a key of some type for a session, such as
- * a ConnKey for a Connection. This allows us to do type-independent
- * comparison of the keys in the map. By default, this type does not maintain
- * the lifetime of the data pointed to by the Key. It only holds a
- * pointer. When a Key object is inserted into the SessionManager's map,
- * the data is copied into the object so the lifetime of the key data is
- * guaranteed over the lifetime of the map entry.
+ * This type is used as the key for the session table in SessionManager. It
+ * represents a raw block of memory that points to a key of some type for a
+ * session, such as a ConnKey for a Connection. This allows us to do
+ * type-independent comparison of the keys in the table. By default, this
+ * type does not maintain the lifetime of the data pointed to by the Key. It
+ * only holds a pointer. The session table doesn't store keys at all: it
+ * keeps each key's hash next to the session and asks the session to
+ * compare against its own key (see Session::MatchesKey()). Keys that do
+ * copy their data store up to MAX_INLINE_SIZE bytes, which includes all
+ * connection keys, inside the Key itself rather than on the heap.
+ *
+ * The hash of the key data is computed once during construction and cached
+ * for the lifetime of the Key.
  */
 class Key final {
 public:
 
 	const static size_t CONNECTION_KEY_TYPE=0;
 
+	/**
+	 * The largest key size, in bytes, that gets stored inline when copied.
+	 */
+	constexpr static size_t MAX_INLINE_SIZE = 40;
+
 	/**
 	 * Create a new session key from a data pointer.
 	 *
@@ -40,9 +50,9 @@ public:
 	~Key();
 
 	// Implement move semantics for Key, since they're used as keys
-	// in a map.
-	Key(Key&& rhs);
-	Key& operator=(Key&& rhs);
+	// in a table.
+	Key(Key&& rhs) noexcept;
+	Key& operator=(Key&& rhs) noexcept;
 
 	// Explicitly delete the copy constructor and operator since copying
 	// may cause issues with double-freeing pointers.
@@ -56,13 +66,40 @@ public:
 	 */
 	void CopyData();
 
+	/**
+	 * Returns the cached hash of the key data.
+	 */
+	uint64_t Hash() const	{ return hash; }
+
+	/**
+	 * Returns true if the key holds the given data. This compares the same
+	 * as operator==, but without needing to hash the other side.
+	 */
+	bool Matches(const void* key_data, size_t size, size_t type) const;
+
 	bool operator<(const Key& rhs) const;
+	bool operator==(const Key& rhs) const;
+	bool operator!=(const Key& rhs) const	{ return ! (*this == rhs); }
 
 private:
+	enum class Storage : uint8_t {
+		Borrowed,	// data points to memory owned by the caller
+		Inline,	// the key data lives in inline_data
+		Heap,	// data points to a heap copy owned by the key
+	};
+
+	const uint8_t* Data() const
+		{ return storage == Storage::Inline ? inline_data : data; }
+
+	void MoveFrom(Key& rhs);
+	void Release();
+
 	const uint8_t* data = nullptr;
-	size_t size = 0;
+	uint64_t hash = 0;
 	size_t type = CONNECTION_KEY_TYPE;
-	bool copied = false;
+	uint32_t size = 0;
+	Storage storage = Storage::Borrowed;
+	uint8_t inline_data[MAX_INLINE_SIZE];
 };
 
 } // namespace zeek::session::detail
@@ -157,11 +157,7 @@ Connection* Manager::FindConnection(const zeek::detail::ConnKey& conn_key)
 	detail::Key key(&conn_key, sizeof(conn_key),
 	                detail::Key::CONNECTION_KEY_TYPE, false);
 
-	auto it = session_map.find(key);
-	if ( it != session_map.end() )
-		return static_cast<Connection*>(it->second);
-
-	return nullptr;
+	return static_cast<Connection*>(session_map.Lookup(key));
 	}
 
 void Manager::Remove(Session* s)
@@ -174,7 +170,7 @@ void Manager::Remove(Session* s)
 
 		detail::Key key = s->SessionKey(false);
 
-		if ( session_map.erase(key) == 0 )
+		if ( ! session_map.Remove(key) )
 			reporter->InternalWarning("connection missing");
 		else
 			{
@@ -195,18 +191,12 @@ void Manager::Remove(Session* s)
 void Manager::Insert(Session* s, bool remove_existing)
 	{
 	Session* old = nullptr;
-	detail::Key key = s->SessionKey(true);
+	detail::Key key = s->SessionKey(false);
 
 	if ( remove_existing )
-		{
-		auto it = session_map.find(key);
-		if ( it != session_map.end() )
-			old = it->second;
+		old = session_map.Remove(key);
 
-		session_map.erase(key);
-		}
-
-	InsertSession(std::move(key), s);
+	InsertSession(key, s);
 
 	if ( old && old != s )
 		{
@@ -220,9 +210,11 @@ void Manager::Insert(Session* s, bool remove_existing)
 
 void Manager::Drain()
 	{
-	for ( const auto& entry : session_map )
+	// Go in key order rather than the table's, so that the removal events
+	// (and with them the log entries) at shutdown come out the same way
+	// every run.
+	for ( Session* tc : session_map.SortedByKey() )
 		{
-		Session* tc = entry.second;
 		tc->Done();
 		tc->RemovalEvent();
 		}
@@ -230,10 +222,10 @@ void Manager::Drain()
 
 void Manager::Clear()
 	{
-	for ( const auto& entry : session_map )
-		Unref(entry.second);
+	for ( Session* s : session_map.SortedByKey() )
+		Unref(s);
 
-	session_map.clear();
+	session_map.Clear();
 
 	zeek::detail::fragment_mgr->Clear();
 	}
@@ -294,8 +286,8 @@ unsigned int Manager::SessionMemoryUsage()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : session_map )
-		mem += entry.second->MemoryAllocation();
+	for ( Session* s : session_map )
+		mem += s->MemoryAllocation();
 
 	return mem;
 	}
@@ -308,8 +300,8 @@ unsigned int Manager::SessionMemoryUsageVals()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : session_map )
-		mem += entry.second->MemoryAllocationVal();
+	for ( Session* s : session_map )
+		mem += s->MemoryAllocationVal();
 
 	return mem;
 	}
@@ -322,17 +314,16 @@ unsigned int Manager::MemoryAllocation()
 
 	return SessionMemoryUsage()
 		+ padded_sizeof(*this)
-		+ (session_map.size() * (sizeof(SessionMap::key_type) + sizeof(SessionMap::value_type)))
+		+ session_map.MemoryAllocation()
 		+ zeek::detail::fragment_mgr->MemoryAllocation();
 		// FIXME: MemoryAllocation() not implemented for rest.
 		;
 	}
 
-void Manager::InsertSession(detail::Key key, Session* session)
+void Manager::InsertSession(const detail::Key& key, Session* session)
 	{
 	session->SetInSessionTable(true);
-	key.CopyData();
-	session_map.insert_or_assign(std::move(key), session);
+	session_map.Insert(key, session);
 
 	std::string protocol = session->TransportIdentifier();
 
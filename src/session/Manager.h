@@ -3,7 +3,6 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
-#include <map>
 #include <utility>
 
 #include "zeek/Frag.h"
@@ -12,6 +11,7 @@
 #include "zeek/telemetry/Manager.h"
 #include "zeek/Hash.h"
 #include "zeek/session/Session.h"
+#include "zeek/session/SessionTable.h"
 
 namespace zeek {
 
@@ -87,7 +87,7 @@ public:
 
 	unsigned int CurrentSessions()
 		{
-		return session_map.size();
+		return session_map.Size();
 		}
 
 	[[deprecated("Remove in v5.1. Use CurrentSessions().")]]
@@ -108,16 +108,14 @@ public:
 
 private:
 
-	using SessionMap = std::map<detail::Key, Session*>;
-
 	// Inserts a new connection into the sessions map. If a connection with
 	// the same key already exists in the map, it will be overwritten by
 	// the new one.  Connection count stats get updated either way (so most
 	// cases should likely check that the key is not already in the map to
 	// avoid unnecessary incrementing of connecting counts).
-	void InsertSession(detail::Key key, Session* session);
+	void InsertSession(const detail::Key& key, Session* session);
 
-	SessionMap session_map;
+	detail::SessionTable session_map;
 	detail::ProtocolStats* stats;
 };
 
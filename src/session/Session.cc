@@ -107,14 +107,30 @@ void Session::SetInactivityTimeout(double timeout)
 	if ( timeout == inactivity_timeout )
 		return;
 
-	// First cancel and remove any existing inactivity timer.
+	zeek::detail::Timer* inactivity_timer = nullptr;
+
 	for ( const auto& timer : timers )
 		if ( timer->Type() == zeek::detail::TIMER_CONN_INACTIVITY )
 			{
-			zeek::detail::timer_mgr->Cancel(timer);
+			inactivity_timer = timer;
 			break;
 			}
 
+	// An existing timer that fires no later than the new deadline can
+	// stay in place, since InactivityTimer() checks the deadline against
+	// the session's last activity and re-arms itself for the remainder.
+	// That way, raising the timeout doesn't touch the timer manager.
+	if ( inactivity_timer && timeout &&
+	     inactivity_timer->Time() <= last_time + timeout )
+		{
+		inactivity_timeout = timeout;
+		return;
+		}
+
+	// Otherwise cancel and remove the existing inactivity timer.
+	if ( inactivity_timer )
+		zeek::detail::timer_mgr->Cancel(inactivity_timer);
+
 	if ( timeout )
 		ADD_TIMER(&Session::InactivityTimer,
 		          last_time + timeout, 0, zeek::detail::TIMER_CONN_INACTIVITY);
@@ -61,6 +61,14 @@ public:
 	 */
 	virtual detail::Key SessionKey(bool copy) const = 0;
 
+	/**
+	 * Returns true if the session's key equals the given one. The session
+	 * table calls this on hash matches instead of storing keys itself. The
+	 * default compares against SessionKey().
+	 */
+	virtual bool MatchesKey(const detail::Key& key) const
+		{ return SessionKey(false) == key; }
+
 	/**
 	 * Set whether this session is in the session table.
 	 */
@@ -0,0 +1,308 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/session/SessionTable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "zeek/Val.h"
+#include "zeek/session/Session.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::session::detail {
+
+size_t SessionTable::FindSlot(const std::vector<Slot>& array, const Key& key)
+	{
+	size_t mask = array.size() - 1;
+	size_t i = key.Hash() & mask;
+
+	while ( array[i].session &&
+	        ! (array[i].hash == key.Hash() && array[i].session->MatchesKey(key)) )
+		i = (i + 1) & mask;
+
+	return i;
+	}
+
+Session* SessionTable::Lookup(const Key& key) const
+	{
+	if ( num_entries == 0 )
+		return nullptr;
+
+	if ( Session* s = slots[FindSlot(slots, key)].session )
+		return s;
+
+	if ( Migrating() )
+		return old_slots[FindSlot(old_slots, key)].session;
+
+	return nullptr;
+	}
+
+Session* SessionTable::Insert(const Key& key, Session* session)
+	{
+	if ( (num_entries + 1) * MAX_LOAD_DENOMINATOR > slots.size() * MAX_LOAD_NUMERATOR )
+		Grow();
+
+	MigrateKey(key);
+	MigrateSome();
+
+	auto& slot = slots[FindSlot(slots, key)];
+	Session* old = slot.session;
+
+	if ( ! old )
+		++num_entries;
+
+	slot.hash = key.Hash();
+	slot.session = session;
+
+	return old;
+	}
+
+Session* SessionTable::Remove(const Key& key)
+	{
+	if ( num_entries == 0 )
+		return nullptr;
+
+	MigrateKey(key);
+	MigrateSome();
+
+	size_t mask = slots.size() - 1;
+	size_t hole = FindSlot(slots, key);
+	Session* old = slots[hole].session;
+
+	if ( ! old )
+		return nullptr;
+
+	--num_entries;
+
+	// Shift back any following entries of the probe run that would
+	// otherwise become unreachable through the hole.
+	for ( size_t i = (hole + 1) & mask; slots[i].session; i = (i + 1) & mask )
+		{
+		size_t home = slots[i].hash & mask;
+
+		if ( ((i - home) & mask) >= ((i - hole) & mask) )
+			{
+			slots[hole] = slots[i];
+			hole = i;
+			}
+		}
+
+	slots[hole] = Slot();
+
+	return old;
+	}
+
+void SessionTable::Clear()
+	{
+	std::vector<Slot>().swap(slots);
+	std::vector<Slot>().swap(old_slots);
+	num_entries = 0;
+	migrate_pos = migrate_left = 0;
+	}
+
+std::vector<Session*> SessionTable::SortedByKey() const
+	{
+	std::vector<std::pair<Key, Session*>> entries;
+	entries.reserve(num_entries);
+
+	for ( Session* s : *this )
+		entries.emplace_back(s->SessionKey(false), s);
+
+	std::sort(entries.begin(), entries.end(),
+	          [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	std::vector<Session*> sessions;
+	sessions.reserve(entries.size());
+
+	for ( const auto& e : entries )
+		sessions.push_back(e.second);
+
+	return sessions;
+	}
+
+void SessionTable::Grow()
+	{
+	FinishMigration();
+
+	if ( slots.empty() )
+		{
+		slots.resize(INITIAL_CAPACITY);
+		return;
+		}
+
+	old_slots = std::move(slots);
+	slots = std::vector<Slot>(old_slots.size() * 2);
+
+	// Start the cursor at an empty slot, of which the load limit always
+	// leaves some, so that it begins on a run boundary.
+	migrate_pos = 0;
+	while ( old_slots[migrate_pos].session )
+		++migrate_pos;
+
+	migrate_left = old_slots.size();
+	}
+
+void SessionTable::MigrateKey(const Key& key)
+	{
+	if ( ! Migrating() )
+		return;
+
+	size_t mask = old_slots.size() - 1;
+	size_t i = FindSlot(old_slots, key);
+
+	if ( ! old_slots[i].session )
+		return;
+
+	while ( old_slots[(i - 1) & mask].session )
+		i = (i - 1) & mask;
+
+	MigrateRun(i);
+	}
+
+void SessionTable::MigrateSome()
+	{
+	size_t migrated = 0;
+
+	while ( Migrating() && migrated < MIGRATION_STEP )
+		{
+		size_t n = MigrateRun(migrate_pos);
+		migrate_pos = (migrate_pos + n) & (old_slots.size() - 1);
+		migrated += n;
+
+		if ( n >= migrate_left )
+			// Back where the cursor started, so everything has moved.
+			std::vector<Slot>().swap(old_slots);
+		else
+			migrate_left -= n;
+		}
+	}
+
+size_t SessionTable::MigrateRun(size_t start)
+	{
+	size_t mask = old_slots.size() - 1;
+	size_t new_mask = slots.size() - 1;
+	size_t i = start;
+
+	for ( ; old_slots[i].session; i = (i + 1) & mask )
+		{
+		size_t j = old_slots[i].hash & new_mask;
+
+		while ( slots[j].session )
+			j = (j + 1) & new_mask;
+
+		slots[j] = old_slots[i];
+		old_slots[i] = Slot();
+		}
+
+	return ((i - start) & mask) + 1;
+	}
+
+void SessionTable::FinishMigration()
+	{
+	while ( Migrating() )
+		MigrateSome();
+	}
+
+TEST_SUITE_BEGIN("SessionTable");
+
+namespace {
+
+class TestSession final : public Session {
+public:
+	explicit TestSession(uint32_t arg_id) : Session(0, nullptr), id(arg_id)	{ }
+
+	void Done() override	{ }
+	void RemovalEvent() override	{ }
+	Key SessionKey(bool copy) const override
+		{ return Key(&id, sizeof(id), Key::CONNECTION_KEY_TYPE, copy); }
+	const RecordValPtr& GetVal() override	{ return val; }
+	unsigned int MemoryAllocationVal() const override	{ return 0; }
+	std::string TransportIdentifier() const override	{ return "test"; }
+
+	uint32_t id;
+	RecordValPtr val;
+};
+
+}
+
+TEST_CASE("session table insert and lookup")
+	{
+	SessionTable table;
+	TestSession s1(1);
+	TestSession s2(1);
+	Key lookup = s1.SessionKey(false);
+
+	CHECK(table.Lookup(lookup) == nullptr);
+	CHECK(table.Remove(lookup) == nullptr);
+
+	CHECK(table.Insert(lookup, &s1) == nullptr);
+	CHECK(table.Size() == 1);
+	CHECK(table.Lookup(lookup) == &s1);
+
+	CHECK(table.Insert(lookup, &s2) == &s1);
+	CHECK(table.Size() == 1);
+	CHECK(table.Lookup(lookup) == &s2);
+
+	CHECK(table.Remove(lookup) == &s2);
+	CHECK(table.Size() == 0);
+	CHECK(table.Lookup(lookup) == nullptr);
+	}
+
+TEST_CASE("session table growth and removal")
+	{
+	SessionTable table;
+	const uint32_t n = 5000;
+	std::vector<std::unique_ptr<TestSession>> sessions;
+
+	for ( uint32_t k = 0; k < n; ++k )
+		{
+		sessions.emplace_back(new TestSession(n - k));
+		table.Insert(sessions.back()->SessionKey(false), sessions.back().get());
+
+		// Everything stays reachable while the resizes are in
+		// progress.
+		if ( k % 97 == 0 )
+			for ( uint32_t l = 0; l <= k; l += 7 )
+				CHECK(table.Lookup(sessions[l]->SessionKey(false)) == sessions[l].get());
+		}
+
+	CHECK(table.Size() == n);
+	CHECK(table.Capacity() * 3 >= n * 4);
+
+	size_t iterated = 0;
+	for ( Session* s : table )
+		{
+		CHECK(s != nullptr);
+		++iterated;
+		}
+
+	CHECK(iterated == n);
+
+	auto sorted = table.SortedByKey();
+	REQUIRE(sorted.size() == n);
+	for ( uint32_t k = 1; k < n; ++k )
+		CHECK(sorted[k - 1]->SessionKey(false) < sorted[k]->SessionKey(false));
+
+	// Remove every other key, which exercises the back-shifting of
+	// colliding entries, then make sure all remaining ones are still
+	// reachable.
+	for ( uint32_t k = 0; k < n; k += 2 )
+		CHECK(table.Remove(sessions[k]->SessionKey(false)) == sessions[k].get());
+
+	CHECK(table.Size() == n / 2);
+
+	for ( uint32_t k = 0; k < n; ++k )
+		CHECK(table.Lookup(sessions[k]->SessionKey(false)) ==
+		      (k % 2 ? sessions[k].get() : nullptr));
+
+	table.Clear();
+	CHECK(table.Size() == 0);
+	CHECK(table.begin() == table.end());
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::session::detail
@@ -0,0 +1,201 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "zeek/session/Key.h"
+
+namespace zeek::session {
+
+class Session;
+
+namespace detail {
+
+/**
+ * An open-addressing hash table mapping session keys to sessions, used by
+ * the session manager to track all active sessions. Each slot holds only
+ * the key's hash and the session, which keeps its own key: on a hash
+ * match the table asks the session to compare (see Session::MatchesKey()).
+ * Collisions are resolved through linear probing, and removals shift
+ * subsequent entries back instead of leaving tombstones.
+ *
+ * When the table grows, entries move to the larger array a few probe runs
+ * at a time with each subsequent update, rather than all at once, so that
+ * a table with millions of sessions doesn't stall packet processing while
+ * rehashing. Until then, lookups check both arrays.
+ *
+ * Iteration order is unspecified; use SortedByKey() where it matters. The
+ * table must not be modified while iterating over it.
+ */
+class SessionTable {
+public:
+	struct Slot {
+		uint64_t hash = 0;
+		Session* session = nullptr;
+	};
+
+	class const_iterator {
+	public:
+		Session* operator*() const	{ return it->session; }
+
+		const_iterator& operator++()
+			{
+			++it;
+			SkipEmpty();
+			return *this;
+			}
+
+		bool operator==(const const_iterator& rhs) const	{ return it == rhs.it; }
+		bool operator!=(const const_iterator& rhs) const	{ return it != rhs.it; }
+
+	private:
+		friend class SessionTable;
+
+		// Iterates over [it, end), then over [next, next_end).
+		const_iterator(const Slot* arg_it, const Slot* arg_end,
+		               const Slot* arg_next = nullptr, const Slot* arg_next_end = nullptr)
+			: it(arg_it), end(arg_end), next(arg_next), next_end(arg_next_end)
+			{ SkipEmpty(); }
+
+		void SkipEmpty()
+			{
+			for ( ;; )
+				{
+				while ( it != end && ! it->session )
+					++it;
+
+				if ( it != end || next == next_end )
+					return;
+
+				it = next;
+				end = next_end;
+				next = next_end = nullptr;
+				}
+			}
+
+		const Slot* it;
+		const Slot* end;
+		const Slot* next;
+		const Slot* next_end;
+	};
+
+	/**
+	 * Returns the session stored under the given key, or null if there
+	 * isn't one.
+	 */
+	Session* Lookup(const Key& key) const;
+
+	/**
+	 * Stores a session under the given key, replacing any session
+	 * already stored under it. The session's own key must equal the given
+	 * one for as long as it remains in the table.
+	 *
+	 * @return The session previously stored under the key, or null if
+	 * there wasn't one.
+	 */
+	Session* Insert(const Key& key, Session* session);
+
+	/**
+	 * Removes the entry for the given key.
+	 *
+	 * @return The session that was stored under the key, or null if there
+	 * wasn't one.
+	 */
+	Session* Remove(const Key& key);
+
+	/**
+	 * Removes all entries and releases the table's memory.
+	 */
+	void Clear();
+
+	/**
+	 * Returns all sessions ordered by their keys. This is the order in
+	 * which the std::map that preceded this table iterated, and keeps
+	 * things like the removal events at shutdown deterministic.
+	 */
+	std::vector<Session*> SortedByKey() const;
+
+	/**
+	 * Returns the number of entries in the table.
+	 */
+	size_t Size() const	{ return num_entries; }
+
+	/**
+	 * Returns the number of slots currently allocated, including those
+	 * still being migrated away from after a resize.
+	 */
+	size_t Capacity() const	{ return slots.size() + old_slots.size(); }
+
+	/**
+	 * Returns the number of bytes allocated for the table's slots.
+	 */
+	size_t MemoryAllocation() const
+		{ return (slots.capacity() + old_slots.capacity()) * sizeof(Slot); }
+
+	const_iterator begin() const
+		{
+		return {slots.data(), slots.data() + slots.size(),
+		        old_slots.data(), old_slots.data() + old_slots.size()};
+		}
+
+	const_iterator end() const
+		{
+		const auto& last = old_slots.empty() ? slots : old_slots;
+		return {last.data() + last.size(), last.data() + last.size()};
+		}
+
+private:
+	// Returns the index of the slot in the given array holding the key, or
+	// of the empty slot at which the key's probe sequence ends. The array
+	// must not be empty.
+	static size_t FindSlot(const std::vector<Slot>& array, const Key& key);
+
+	// Doubles the number of slots. The entries stay in old_slots until
+	// migrated.
+	void Grow();
+
+	bool Migrating() const	{ return ! old_slots.empty(); }
+
+	// Migrates the probe run of old_slots holding the key, if any, so that
+	// the key can be updated in the new array alone.
+	void MigrateKey(const Key& key);
+
+	// Advances the migration cursor by at least MIGRATION_STEP slots.
+	void MigrateSome();
+
+	// Moves the run of entries starting at the given slot of old_slots
+	// into the new array. Returns the number of slots covered, including
+	// the empty one ending the run.
+	size_t MigrateRun(size_t start);
+
+	void FinishMigration();
+
+	// The number of slots is always zero or a power of two.
+	static constexpr size_t INITIAL_CAPACITY = 64;
+
+	// Grow once more than this fraction of the slots is in use.
+	static constexpr size_t MAX_LOAD_NUMERATOR = 3;
+	static constexpr size_t MAX_LOAD_DENOMINATOR = 4;
+
+	// The minimum number of old slots migrated per update. With the load
+	// limit above, the migration finishes well before the new array
+	// could fill up.
+	static constexpr size_t MIGRATION_STEP = 16;
+
+	std::vector<Slot> slots;
+	size_t num_entries = 0;
+
+	// The previous array while a resize is in progress. Migration moves a
+	// cursor over it, always sitting at the start of a probe run, since
+	// moving only part of a run would break the probe sequences of the
+	// rest.
+	std::vector<Slot> old_slots;
+	size_t migrate_pos = 0;
+	size_t migrate_left = 0;
+};
+
+} // namespace detail
+} // namespace zeek::session
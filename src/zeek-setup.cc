@@ -47,6 +47,7 @@ extern "C" {
 #include "zeek/EventRegistry.h"
 #include "zeek/Stats.h"
 #include "zeek/ScriptCoverageManager.h"
+#include "zeek/ScriptProfile.h"
 #include "zeek/Traverse.h"
 #include "zeek/Trigger.h"
 #include "zeek/Hash.h"
@@ -118,6 +119,7 @@ zeek::EventRegistry* zeek::event_registry = nullptr;
 zeek::detail::ProfileLogger* zeek::detail::profiling_logger = nullptr;
 zeek::detail::ProfileLogger* zeek::detail::segment_logger = nullptr;
 zeek::detail::SampleLogger* zeek::detail::sample_logger = nullptr;
+zeek::detail::ScriptProfileMgr* zeek::detail::script_profile_mgr = nullptr;
 
 zeek::detail::FragmentManager* zeek::detail::fragment_mgr = nullptr;
 
@@ -306,6 +308,9 @@ static void terminate_bro()
 	timer_mgr->Expire();
 	event_mgr.Drain();
 
+	if ( script_profile_mgr )
+		script_profile_mgr->Report();
+
 	if ( profiling_logger )
 		{
 		// FIXME: There are some occasional crashes in the memory
@@ -540,7 +545,14 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	createCurrentDoc("1.0");		// Set a global XML document
 #endif
 
-	timer_mgr = new PQ_TimerMgr();
+	const char* timer_mgr_type = getenv("ZEEK_TIMER_MGR");
+
+	if ( ! timer_mgr_type || strcmp(timer_mgr_type, "heap") == 0 )
+		timer_mgr = new PQ_TimerMgr();
+	else if ( strcmp(timer_mgr_type, "wheel") == 0 )
+		timer_mgr = new Wheel_TimerMgr();
+	else
+		reporter->FatalError("unknown timer manager '%s' in ZEEK_TIMER_MGR", timer_mgr_type);
 
 	auto zeekygen_cfg = options.zeekygen_config_file.value_or("");
 	zeekygen_mgr = new zeekygen::detail::Manager(zeekygen_cfg, zeek_argv[0]);
@@ -697,6 +709,7 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	broker_mgr->InitPostScript();
 	telemetry_mgr->InitPostScript();
 	timer_mgr->InitPostScript();
+	StageLatencies::Calibrate();
 	event_mgr.InitPostScript();
 
 	if ( supervisor_mgr )
@@ -845,6 +858,9 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 			segment_logger = profiling_logger;
 		}
 
+	if ( options.script_profile_prefix )
+		script_profile_mgr = new ScriptProfileMgr(*options.script_profile_prefix);
+
 	if ( ! run_state::reading_live && ! run_state::reading_traces )
 		// Set up network_time to track real-time, since
 		// we don't have any other source for it.